@@ -43,6 +43,7 @@ FILE(GLOB_RECURSE CMAKETESTFILES "${TOPDIR}/*CTestTestfile.cmake")
 FILE(GLOB TOPDIRECTORIES "${TOPDIR}/lib" 
                          "${TOPDIR}/dist" 
                          "${TOPDIR}/test"
+                         "${TOPDIR}/benchmark"
 )
 # CMake has trouble finding directories recursively, so locate these
 # files and then save the parent directory of the files
@@ -15,6 +15,10 @@
 !> ~~~~~~~~~~~~~
 !> call RGB(...)
 !> ~~~~~~~~~~~~~
+!> None of the functions keep state between calls, so they may be called
+!> from inside an `!$omp parallel do` loop.  To calculate many particles
+!> at once, [npspec_batch](\ref npspec_batch) accepts the usual column-major
+!> Fortran arrays, with one column per particle.
 !> Additionally, there is an additional function included that will convert
 !> a Fortran-style character string to a C-style character string for
 !> use in interfacing with the C functions.
@@ -31,6 +35,7 @@ Module NPSpecModule
 
 !   Parameters
     Public NLAMBDA
+    Public MAXTERMS
     Public Efficiency
     Public CrossSection
     Public Molar
@@ -48,10 +53,41 @@ Module NPSpecModule
     Public InvalidRefractiveIndex
     Public InvalidNumberOfLayers
     Public UnknownMaterial
+    Public InvalidResolution
+    Public InvalidPositions
+
+!   NanoparticleShapes
+    Public Sphere
+    Public Ellipsoid
+    Public Spheroid
+    Public Cube
+    Public Rod
+    Public Prism
+
+!   SolverModels
+    Public ModelSkipped
+    Public ModelQuasistatic
+    Public ModelRayleigh
+    Public ModelMie
+    Public ModelGeometric
 
 !   Functions
     Public material_index
     Public npspec
+    Public npspec_properties
+    Public npspec_polarized
+    Public npspec_auto
+    Public npspec_angular
+    Public npspec_coefficients
+    Public npspec_multipoles
+    Public npspec_nearfield
+    Public npspec_batch
+    Public npspec_profile
+    Public npspec_tmatrix
+    Public npspec_tmatrix_cache_clear
+    Public npspec_tmatrix_cache_size
+    Public npspec_dda
+    Public npspec_cluster
     Public RGB
     Public RGB_to_HSV
     Public make_C_string
@@ -61,6 +97,10 @@ Module NPSpecModule
     Integer(C_INT), Parameter                    :: NLAMBDA = 800
     !> Maximum number of layers the nanoparticle can contain.
     Real(C_DOUBLE), Bind(C, name="wavelengths")  :: wavelengths(NLAMBDA)
+    !> Maximum number of terms in the Mie series.
+    Integer(C_INT), Parameter                    :: MAXTERMS = 350
+    !> Default number of dipoles across a particle in npspec_dda.
+    Integer(C_INT), Parameter                    :: DDA_RESOLUTION = 8
 
 !   Had a hell of a time getting an enum to bind, so I am just redefining it here
     !> Calculate the efficiency spectra (unitless).
@@ -76,7 +116,7 @@ Module NPSpecModule
     !> No error has occured. 
     Integer(C_INT), Parameter :: NoError                = 0
     !> The nanoparticle size is too large.
-    Integer(C_INT), Parameter :: SizeParameterWarning   = -3
+    Integer(C_INT), Parameter :: SizeWarning            = -3
     !> The radius given is invalid.
     Integer(C_INT), Parameter :: InvalidRadius          = -4
     !> The relative radius given is invalid.
@@ -89,10 +129,40 @@ Module NPSpecModule
     Integer(C_INT), Parameter :: InvalidConcentration   = -8
     !> The refractive index given is invalid.
     Integer(C_INT), Parameter :: InvalidRefractiveIndex = -9
-    !> The number of layers is either negative or greater than 10.
+    !> The number of layers is less than 1.
     Integer(C_INT), Parameter :: InvalidNumberOfLayers  = -10
     !> The material requested is unknown.
     Integer(C_INT), Parameter :: UnknownMaterial        = -11
+    !> The number of dipoles is less than 1.
+    Integer(C_INT), Parameter :: InvalidResolution      = -12
+    !> The particles of a cluster overlap, or there are none.
+    Integer(C_INT), Parameter :: InvalidPositions       = -13
+
+!   NanoparticleShape enum
+    !> A sphere.
+    Integer(C_INT), Parameter :: Sphere    = 0
+    !> An ellipsoid.
+    Integer(C_INT), Parameter :: Ellipsoid = 1
+    !> A homogeneous spheroid, solved by the T-matrix method.
+    Integer(C_INT), Parameter :: Spheroid  = 2
+    !> A block with a square cross section.
+    Integer(C_INT), Parameter :: Cube      = 3
+    !> A cylinder with hemispherical caps.
+    Integer(C_INT), Parameter :: Rod       = 4
+    !> A prism with an equilateral triangle as its cross section.
+    Integer(C_INT), Parameter :: Prism     = 5
+
+!   SolverModel enum
+    !> Not solved; the size parameter is too small.
+    Integer(C_INT), Parameter :: ModelSkipped     = 0
+    !> The quasistatic (electrostatic dipole) approximation.
+    Integer(C_INT), Parameter :: ModelQuasistatic = 1
+    !> The small-particle (Rayleigh) series of the Mie coefficients.
+    Integer(C_INT), Parameter :: ModelRayleigh    = 2
+    !> The full Mie series.
+    Integer(C_INT), Parameter :: ModelMie         = 3
+    !> Geometric optics, for a sphere too large for the Mie series.
+    Integer(C_INT), Parameter :: ModelGeometric   = 4
 
 !   Interfaces to the C routines
     Interface
@@ -124,7 +194,303 @@ Module NPSpecModule
     End Interface
 
     Interface
-        Subroutine RGB (spec_in, inc, trans, r, g, b, o) Bind(C)
+        Integer(C_INT) Function npspec_properties (nlayers, rad, rel_rad, indx,    &
+                            mrefrac, size_correct, increment, path_length,      &
+                            concentration, spectra_type, qext, qscat, qabs,     &
+                            qback, qpr, albedo, asymmetry) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In)         :: rad(2)
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(nlayers,*)
+            Integer(C_INT),  Intent(In)         :: indx(*)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(Out)        :: qext(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qback(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qpr(*)
+            Real(C_DOUBLE),  Intent(Out)        :: albedo(*)
+            Real(C_DOUBLE),  Intent(Out)        :: asymmetry(*)
+        End Function npspec_properties
+    End Interface
+
+    Interface
+        Integer(C_INT) Function npspec_polarized (nlayers, rad, rel_rad, indx,     &
+                            mrefrac, size_correct, increment, path_length,      &
+                            concentration, spectra_type, polarization,          &
+                            qabs_axes, qscat_axes, qabs_pol, qscat_pol) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In)         :: rad(2)
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(nlayers,*)
+            Integer(C_INT),  Intent(In)         :: indx(*)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(In), Value  :: polarization
+            Real(C_DOUBLE),  Intent(Out)        :: qabs_axes(2,*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat_axes(2,*)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs_pol(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat_pol(*)
+        End Function npspec_polarized
+    End Interface
+
+    Interface
+        Integer(C_INT) Function npspec_auto (nlayers, rad, rel_rad, indx,          &
+                            mrefrac, size_correct, increment, path_length,      &
+                            concentration, spectra_type, tolerance, qext,       &
+                            qscat, qabs, model, nterms) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In)         :: rad(2)
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(nlayers,*)
+            Integer(C_INT),  Intent(In)         :: indx(*)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(In), Value  :: tolerance
+            Real(C_DOUBLE),  Intent(Out)        :: qext(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs(*)
+            Integer(C_INT),  Intent(Out)        :: model(*)
+            Integer(C_INT),  Intent(Out)        :: nterms(*)
+        End Function npspec_auto
+    End Interface
+
+    Interface
+        Integer(C_INT) Function npspec_angular (nlayers, radius, rel_rad, indx,   &
+                            mrefrac, size_correct, increment, nangles, theta,   &
+                            s1, s2) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In), Value  :: radius
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(nlayers)
+            Integer(C_INT),  Intent(In)         :: indx(nlayers)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Integer(C_INT),  Intent(In), Value  :: nangles
+            Real(C_DOUBLE),  Intent(In)         :: theta(nangles)
+            Complex(C_DOUBLE_COMPLEX), Intent(Out) :: s1(nangles,*)
+            Complex(C_DOUBLE_COMPLEX), Intent(Out) :: s2(nangles,*)
+        End Function npspec_angular
+    End Interface
+
+    Interface
+        Integer(C_INT) Function npspec_coefficients (nlayers, radius, rel_rad,  &
+                            indx, mrefrac, size_correct, increment, maxterms,   &
+                            an, bn, nterms) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Import :: NLAMBDA
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In), Value  :: radius
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(nlayers)
+            Integer(C_INT),  Intent(In)         :: indx(nlayers)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Integer(C_INT),  Intent(In), Value  :: maxterms
+            Complex(C_DOUBLE_COMPLEX), Intent(Out) :: an(maxterms,NLAMBDA)
+            Complex(C_DOUBLE_COMPLEX), Intent(Out) :: bn(maxterms,NLAMBDA)
+            Integer(C_INT),  Intent(Out)        :: nterms(NLAMBDA)
+        End Function npspec_coefficients
+    End Interface
+
+    Interface
+        Integer(C_INT) Function npspec_multipoles (nlayers, radius, rel_rad,    &
+                            indx, mrefrac, size_correct, increment, path_length, &
+                            concentration, spectra_type, qext, qscat, norders,   &
+                            ext_electric, ext_magnetic, sca_electric,            &
+                            sca_magnetic) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Import :: NLAMBDA
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In), Value  :: radius
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(nlayers)
+            Integer(C_INT),  Intent(In)         :: indx(nlayers)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(Out)        :: qext(NLAMBDA)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(NLAMBDA)
+            Integer(C_INT),  Intent(In), Value  :: norders
+            Real(C_DOUBLE),  Intent(Out)        :: ext_electric(norders,NLAMBDA)
+            Real(C_DOUBLE),  Intent(Out)        :: ext_magnetic(norders,NLAMBDA)
+            Real(C_DOUBLE),  Intent(Out)        :: sca_electric(norders,NLAMBDA)
+            Real(C_DOUBLE),  Intent(Out)        :: sca_magnetic(norders,NLAMBDA)
+        End Function npspec_multipoles
+    End Interface
+
+    Interface
+        Integer(C_INT) Function npspec_nearfield (nlayers, radius, rel_rad,     &
+                            indx, mrefrac, size_correct, increment, path_length, &
+                            concentration, spectra_type, qext, qscat, qabs,      &
+                            enhancement) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In), Value  :: radius
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(nlayers)
+            Integer(C_INT),  Intent(In)         :: indx(nlayers)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(Out)        :: qext(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs(*)
+            Real(C_DOUBLE),  Intent(Out)        :: enhancement(*)
+        End Function npspec_nearfield
+    End Interface
+
+    Interface
+        Integer(C_INT) Function npspec_batch (nparticles, nlayers, rad, rel_rad, &
+                            indx, mrefrac, size_correct, increment, path_length, &
+                            concentration, spectra_type, qext, qscat, qabs,      &
+                            retcodes) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Import :: NLAMBDA
+            Integer(C_INT),  Intent(In), Value  :: nparticles
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In)         :: rad(2,nparticles)
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(2,nlayers,nparticles)
+            Integer(C_INT),  Intent(In)         :: indx(nlayers,nparticles)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(Out)        :: qext(NLAMBDA,nparticles)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(NLAMBDA,nparticles)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs(NLAMBDA,nparticles)
+            Integer(C_INT),  Intent(Out)        :: retcodes(nparticles)
+        End Function npspec_batch
+    End Interface
+
+!   The profile is a Bind(C) subroutine (r, wavelength, data, n, k), with r,
+!   wavelength and data passed by value, given with C_FUNLOC
+    Interface
+        Integer(C_INT) Function npspec_profile (radius, profile, data, mrefrac, &
+                            increment, path_length, concentration,              &
+                            spectra_type, tolerance, qext, qscat, qabs,         &
+                            nshells) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Real(C_DOUBLE),  Intent(In), Value  :: radius
+            Type(C_FUNPTR),  Intent(In), Value  :: profile
+            Type(C_PTR),     Intent(In), Value  :: data
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(In), Value  :: tolerance
+            Real(C_DOUBLE),  Intent(Out)        :: qext(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs(*)
+            Integer(C_INT),  Intent(Out)        :: nshells(*)
+        End Function npspec_profile
+    End Interface
+
+!   rad holds the radii along the Z and XY axes of a homogeneous spheroid
+    Interface
+        Integer(C_INT) Function npspec_tmatrix (rad, indx, mrefrac,           &
+                            size_correct, increment, path_length,             &
+                            concentration, spectra_type, qext, qscat, qabs)   &
+                            Bind (C)
+            use, intrinsic :: iso_c_binding
+            Real(C_DOUBLE),  Intent(In)         :: rad(2)
+            Integer(C_INT),  Intent(In), Value  :: indx
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(Out)        :: qext(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs(*)
+        End Function npspec_tmatrix
+    End Interface
+
+    Interface
+        Subroutine npspec_tmatrix_cache_clear () Bind (C)
+        End Subroutine npspec_tmatrix_cache_clear
+    End Interface
+
+    Interface
+        Integer(C_INT) Function npspec_tmatrix_cache_size () Bind (C)
+            use, intrinsic :: iso_c_binding
+        End Function npspec_tmatrix_cache_size
+    End Interface
+
+!   shape is one of the NanoparticleShapes, with rad as for npspec_dda in
+!   npspec.h, and resolution the number of dipoles across the particle
+    Interface
+        Integer(C_INT) Function npspec_dda (shape, rad, indx, mrefrac,        &
+                            size_correct, increment, path_length,             &
+                            concentration, spectra_type, resolution, qext,    &
+                            qscat, qabs) Bind (C)
+            use, intrinsic :: iso_c_binding
+            Integer(C_INT),  Intent(In), Value  :: shape
+            Real(C_DOUBLE),  Intent(In)         :: rad(2)
+            Integer(C_INT),  Intent(In), Value  :: indx
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Integer(C_INT),  Intent(In), Value  :: resolution
+            Real(C_DOUBLE),  Intent(Out)        :: qext(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs(*)
+        End Function npspec_dda
+    End Interface
+
+!   positions(:,i) is the center of the i-th sphere in nm
+    Interface
+        Integer(C_INT) Function npspec_cluster (nparticles, positions,        &
+                            nlayers, radius, rel_rad, indx, mrefrac,          &
+                            size_correct, increment, path_length,             &
+                            concentration, spectra_type, qext, qscat, qabs)   &
+                            Bind (C)
+            use, intrinsic :: iso_c_binding
+            Integer(C_INT),  Intent(In), Value  :: nparticles
+            Real(C_DOUBLE),  Intent(In)         :: positions(3,*)
+            Integer(C_INT),  Intent(In), Value  :: nlayers
+            Real(C_DOUBLE),  Intent(In), Value  :: radius
+            Real(C_DOUBLE),  Intent(In)         :: rel_rad(*)
+            Integer(C_INT),  Intent(In)         :: indx(*)
+            Real(C_DOUBLE),  Intent(In), Value  :: mrefrac
+            Logical(C_BOOL), Intent(In), Value  :: size_correct
+            Integer(C_INT),  Intent(In), Value  :: increment
+            Real(C_DOUBLE),  Intent(In), Value  :: path_length
+            Real(C_DOUBLE),  Intent(In), Value  :: concentration
+            Integer(C_INT),  Intent(In), Value  :: spectra_type
+            Real(C_DOUBLE),  Intent(Out)        :: qext(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qscat(*)
+            Real(C_DOUBLE),  Intent(Out)        :: qabs(*)
+        End Function npspec_cluster
+    End Interface
+
+    Interface
+        Subroutine RGB (spec_in, inc, trans, r, g, b) Bind(C, name="RGB")
             use, intrinsic :: iso_c_binding
             Real(C_DOUBLE),  Intent(In)         :: spec_in(*)
             Integer(C_INT),  Intent(In),  Value :: inc
@@ -132,12 +498,11 @@ Module NPSpecModule
             Real(C_DOUBLE),  Intent(Out)        :: r
             Real(C_DOUBLE),  Intent(Out)        :: g
             Real(C_DOUBLE),  Intent(Out)        :: b
-            Real(C_DOUBLE),  Intent(Out)        :: o
         End Subroutine RGB
     End Interface
 
     Interface
-        Subroutine HSV_to_RGB (r, g, b, h, s, v) Bind(C)
+        Subroutine RGB_to_HSV (r, g, b, h, s, v) Bind(C, name="RGB_to_HSV")
             use, intrinsic :: iso_c_binding
             Real(C_DOUBLE),  Intent(In),  Value :: r
             Real(C_DOUBLE),  Intent(In),  Value :: g
@@ -145,7 +510,7 @@ Module NPSpecModule
             Real(C_DOUBLE),  Intent(Out)        :: h
             Real(C_DOUBLE),  Intent(Out)        :: s
             Real(C_DOUBLE),  Intent(Out)        :: v
-        End Subroutine HSV_to_RGB
+        End Subroutine RGB_to_HSV
     End Interface
 
 Contains
@@ -15,9 +15,26 @@ extern "C" {
 /*! Number of wavelengths that will be calculated. */
 const int NLAMBDA = 800;
 
-/*! Maximum number of layers the nanoparticle can contain. */
+/*! Maximum number of layers a [Nanoparticle](\ref Nanoparticle) can
+ *  contain.  The functions in npspec.h take any number of layers for
+ *  a sphere. */
 const int MAXLAYERS = 10;
 
+/*! Maximum number of terms in the Mie series, that of the largest
+ *  sphere it is used for (see [npspec](\ref npspec)). */
+const int MAXTERMS = 350;
+
+/*! The number of dipoles across the longest dimension of a particle that
+ *  a [Nanoparticle](\ref Nanoparticle) solved by the discrete dipole
+ *  approximation is divided into.  This keeps a spectrum to seconds, and
+ *  is within about 10% of the exact spectrum for a dielectric. */
+const int DDA_RESOLUTION = 8;
+
+/*! The finest wavelength increment that a [Nanoparticle](\ref Nanoparticle)
+ *  solved by the discrete dipole approximation is solved at.  A finer
+ *  increment is linearly interpolated from it. */
+const int DDA_INCREMENT = 20;
+
 /*! Enum for spectra type. */
 enum SpectraType { Efficiency,   /*!< Calculate the efficiency spectra (unitless). */
                    CrossSection, /*!< Calculate the CrossSection spectra (in nm\f$^{2}\f$). */
@@ -34,23 +51,53 @@ enum ErrorCode { NoError = 0, /*!< No error has occured. */
                  InvalidPathLength = -7, /*!< The path length chosen is invalid. */
                  InvalidConcentration = -8, /*!< The concentration given is invalid. */
                  InvalidRefractiveIndex = -9, /*!< The refractive index given is invalid. */
-                 InvalidNumberOfLayers = -10, /*!< The number of layers is either negative or greater than 10. */
-                 UnknownMaterial = -11 /*!< The material requested is unknown. */
+                 InvalidNumberOfLayers = -10, /*!< The number of layers is less than 1. */
+                 UnknownMaterial = -11, /*!< The material requested is unknown. */
+                 InvalidResolution = -12, /*!< The number of dipoles is less than 1. */
+                 InvalidPositions = -13 /*!< The particles of a cluster overlap,
+                                             or there are none. */
                };
 
+/*! Enum for the model used to solve a particle at one wavelength.  This is
+ *  reported by [npspec_auto](\ref npspec_auto).
+ */
+enum SolverModel { ModelSkipped = 0, /*!< Not solved; the size parameter is too small. */
+                   ModelQuasistatic, /*!< The quasistatic (electrostatic dipole) approximation. */
+                   ModelRayleigh,    /*!< The small-particle (Rayleigh) series of the Mie coefficients. */
+                   ModelMie,         /*!< The full Mie series. */
+                   ModelGeometric    /*!< Geometric optics, for a sphere too large for the Mie series. */
+                 };
+
 /*! Enum for shape. This is only used in conjunction with the
  * [Nanoparticle](\ref Nanoparticle) class.
  */
-enum NanoparticleShape { Sphere,   /*!< The nanoparticle is a sphere. */
-                         Ellipsoid /*!< The nanoparticle is an ellipsoid. */
+enum NanoparticleShape { Sphere,    /*!< The nanoparticle is a sphere. */
+                         Ellipsoid, /*!< The nanoparticle is an ellipsoid. */
+                         Spheroid,  /*!< The nanoparticle is a homogeneous spheroid,
+                                         solved exactly by the T-matrix method. */
+                         Cube,      /*!< The nanoparticle is a block with a square
+                                         cross section, a cube if its radii are
+                                         equal.  Solved by the discrete dipole
+                                         approximation. */
+                         Rod,       /*!< The nanoparticle is a cylinder with
+                                         hemispherical caps.  Solved by the
+                                         discrete dipole approximation. */
+                         Prism      /*!< The nanoparticle is a prism with an
+                                         equilateral triangle as its cross
+                                         section.  Solved by the discrete dipole
+                                         approximation. */
                        };
 
 /*! Enum for spectra property. This is only used in conjunction with the
  * [Nanoparticle](\ref Nanoparticle) class.
  */
-enum SpectraProperty { Extinction, /*!< Return the extinction spectra. */
-                       Absorbance, /*!< Return the absorbance spectra. */
-                       Scattering  /*!< Return the scattering spectra. */
+enum SpectraProperty { Extinction,        /*!< Return the extinction spectra. */
+                       Absorbance,        /*!< Return the absorbance spectra. */
+                       Scattering,        /*!< Return the scattering spectra. */
+                       Backscattering,    /*!< Return the backscattering spectra. */
+                       RadiationPressure, /*!< Return the radiation pressure spectra. */
+                       Albedo,            /*!< Return the single-scattering albedo (unitless). */
+                       Asymmetry          /*!< Return the asymmetry parameter (unitless). */
                      };
 
 /*! The wavelengths that will be calcuated over.  This is used internally but
@@ -0,0 +1,127 @@
+/*! \file instrument.h
+ *  \brief Optional hot-path instrumentation counters for the NPSpec library
+ *
+ *  When NPSpec is built with the CMake option `-DINSTRUMENT=ON` each thread
+ *  keeps counters and timers for the solver calls it makes.  These can be
+ *  read for the calling thread or summed over every thread, either as
+ *  a [InstrumentCounters](\ref InstrumentCounters) struct or as JSON.
+ *  When built without the option, the instrumentation is compiled out
+ *  entirely; these functions still exist but only ever report zeros.
+ */
+
+#ifndef NPSPEC_INSTRUMENT_H
+#define NPSPEC_INSTRUMENT_H
+
+/* Pull in the constants */
+#include "npspec/constants.h"
+
+#ifdef __cplusplus
+namespace NPSpec {
+extern "C" {
+#endif
+
+/*! Enum for the phases of a calculation that are timed. */
+enum InstrumentPhase { PhaseTotal,      /*!< All time spent inside [npspec](\ref npspec). */
+                       PhaseDielectric, /*!< Look up and size correction of the dielectric. */
+                       PhaseMie,        /*!< Time spent in the Mie theory solver. */
+                       PhaseQuasi,      /*!< Time spent in the quasistatic solver. */
+                       PhaseColor,      /*!< Time spent converting spectra to colors. */
+                       PhaseTMatrix,    /*!< Time spent in the T-matrix solver. */
+                       PhaseDDA,        /*!< Time spent in the discrete dipole solver. */
+                       PhaseCluster,    /*!< Time spent in the coupled dipole solver of clusters. */
+                       NumPhases        /*!< The number of timed phases. */
+                     };
+
+/*! Layout of the histograms of the Mie series order. */
+enum InstrumentHistogram { OrderBinWidth = 8,  /*!< Width of each bin of the histogram. */
+                           NumOrderBins  = 16  /*!< Number of bins. The last bin also
+                                                    counts all orders beyond it. */
+                         };
+
+/*! \brief The instrumentation counters and timers. */
+typedef struct InstrumentCounters {
+    long long npspec_calls;          /*!< Calls to [npspec](\ref npspec). */
+    long long mie_calls;             /*!< Calls to the Mie theory solver. */
+    long long quasi_calls;           /*!< Calls to the quasistatic solver. */
+    long long wavelengths_evaluated; /*!< Wavelengths that were solved. */
+    long long wavelengths_skipped;   /*!< Wavelengths skipped because the size
+                                          parameter was too small. */
+    long long size_corrections;      /*!< Size-corrected Drude evaluations. */
+    long long size_warnings;         /*!< Times a [SizeWarning](\ref SizeWarning)
+                                          was raised. */
+    long long color_calls;           /*!< Calls to [RGB](\ref RGB) and
+                                          [RGB_to_HSV](\ref RGB_to_HSV). */
+    long long tmatrix_calls;         /*!< Calls to the T-matrix solver. */
+    long long tmatrix_cache_hits;    /*!< T-matrix solves answered from the cache. */
+    long long dipole_solves;         /*!< Systems of coupled dipoles solved. */
+    long long dipole_iterations;     /*!< Iterations taken by those solves. */
+    long long num_histogram[NumOrderBins];  /*!< Histogram of the number of Mie
+                                                 terms requested (num). */
+    long long num1_histogram[NumOrderBins]; /*!< Histogram of the number of Mie
+                                                 terms actually summed (num1). */
+    double seconds[NumPhases];       /*!< Wall time spent in each
+                                          [InstrumentPhase](\ref InstrumentPhase). */
+} InstrumentCounters;
+
+#ifdef __cplusplus
+} // extern
+} // namespace NPSpec
+extern "C" {
+#endif
+
+/*! \brief Was the library compiled with instrumentation?
+ *
+ *  \return true if the counters are recorded, false if they were compiled out.
+ */
+bool npspec_instrument_enabled(void);
+
+/*! \brief Read the counters of the calling thread.
+ *
+ *  \param [out] counters The counters recorded by this thread since it
+ *                        started or since the last reset.
+ */
+#ifdef __cplusplus
+void npspec_counters_thread(NPSpec::InstrumentCounters *counters);
+#else
+void npspec_counters_thread(InstrumentCounters *counters);
+#endif
+
+/*! \brief Read the counters summed over every thread, including threads
+ *         that have already exited.
+ *
+ *  \param [out] counters The summed counters.
+ *
+ *  \remark The sum is exact only when no other thread is inside the
+ *          library; otherwise it may miss updates still in flight.
+ */
+#ifdef __cplusplus
+void npspec_counters_total(NPSpec::InstrumentCounters *counters);
+#else
+void npspec_counters_total(InstrumentCounters *counters);
+#endif
+
+/*! \brief Reset the counters of every thread to zero. */
+void npspec_counters_reset(void);
+
+/*! \brief Write the summed counters as a JSON object.
+ *
+ *  \param [out] buffer Where to write the null-terminated JSON.  May be NULL
+ *                      if len is 0, to query the size needed.
+ *  \param [in]  len The length of buffer.  The output is truncated to fit.
+ *  \return The length of the complete JSON, not counting the null terminator,
+ *          in the same way as snprintf.
+ */
+int npspec_counters_json(char *buffer, const int len);
+
+/*! \brief Write the summed counters as JSON to a file.
+ *
+ *  \param [in] filename The file to write.  It is overwritten.
+ *  \return 0 on success, or -1 if the file could not be written.
+ */
+int npspec_counters_dump(const char *filename);
+
+#ifdef __cplusplus
+} // extern
+#endif
+
+#endif /* NPSPEC_INSTRUMENT_H */
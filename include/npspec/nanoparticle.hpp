@@ -44,12 +44,15 @@ public:
     //! \brief Calculate the spectra.
     /*! This should only be used after the nanoparticle is defined.
      *  \return Returns 0 if the calculation was sucessful and
-     *          returns 1 if the nanoparticle may be too large and
-     *          thus the spectrum may not be trustworthy.
-     *  \exception std::out_of_range This is thrown if the number of layers is out of range
+     *          returns 1 if the nanoparticle may be too large, or a
+     *          Cube, Rod or Prism too metallic, and thus the spectrum
+     *          may not be trustworthy.
+     *  \exception std::out_of_range This is thrown if the number of layers is out of range,
+     *                               or is not 1 for a shape other than a Sphere or Ellipsoid
      *  \exception std::invalid_argument Unknown material or invalid increment
      *  \exception std::domain_error Radii, path length, concentration, or refractive index is negative, 
-     *                               relative radii don't sum to 1.0
+     *                               relative radii don't sum to 1.0, or a Rod is shorter than its
+     *                               diameter
      *
      *  \note For Python, the above exceptions are mapped as:
      *  - **out_of_range** -> **IndexError**
@@ -70,6 +73,25 @@ public:
      */
     void getSpectrum(double spec[NPSpec::NLAMBDA]) const;
 
+    //! Get a calculated spectrum of a given property.
+    /*! This should only be used after calling
+     *  [calculateSpectrum](\ref calculateSpectrum).  It allows any spectrum
+     *  from the last calculation to be read without recalculating, whatever
+     *  the current [SpectraProperty](\ref SpectraProperty) is.
+     *
+     *  \param prop The property of the spectrum to return.
+     *  \param spec The calculated spectrum.
+     *  \exception std::invalid_argument The backscattering, radiation pressure,
+     *              albedo or asymmetry was requested but was not calculated
+     *              (see [setExtraProperties](\ref setExtraProperties)).
+     *
+     *  \note
+     *  For Python, `spec` is a numpy array that is returned by the function,
+     *  and a **ValueError** is raised in place of **invalid_argument**.
+     */
+    void getPropertySpectrum(NPSpec::SpectraProperty prop,
+                             double spec[NPSpec::NLAMBDA]) const;
+
     //! Get the color associated with the calculated spectrum in RGB color space.
     /*! This should only be used after calling 
      *  [getSpectrum](\ref getSpectrum).  
@@ -123,6 +145,11 @@ public:
     /*! \return The property the spectrum was calculated. */
     NPSpec::SpectraProperty getSpectraProperty() const;
 
+    //! Get whether the extra properties are always calculated.
+    /*! \return True if the backscattering, radiation pressure, albedo
+     *          and asymmetry are calculated with every spectrum. */
+    bool getExtraProperties() const;
+
     //! Get the current sphere radius.
     /*! \return The nanoparticle sphere radius. 
      *
@@ -268,13 +295,30 @@ public:
 
     //! Sets the current nanoparticle shape.
     /* \param npshape The new shape of the nanoparticle.
-     *
-     *  \warning For an ellipse a max of two layers are allowed.
+     * \exception std::invalid_argument The shape is not a Sphere or
+     *             Ellipsoid and the spectra property is one of the extra
+     *             properties, which are not calculated for it.
      *
      * \remark
      * When you change the shape of the nanoparticle, the parameters for
      * the other shape remain in memory so you can switch back and forth
      * and not have to reset the parameters.
+     *
+     * A Spheroid uses the ellipsoid radii but is solved exactly by the
+     * T-matrix method.  It must have a single layer, and only its
+     * extinction, scattering and absorbance are calculated.
+     *
+     * A Cube, Rod or Prism also uses the ellipsoid radii, as the half
+     * length along Z and the half width across it (see npspec_dda), and
+     * is solved by the discrete dipole approximation with DDA_RESOLUTION
+     * dipoles along its longest dimension, every DDA_INCREMENT
+     * wavelengths at most.  The same restrictions apply, and the length
+     * of a Rod must not be less than its diameter.  Metals are only
+     * roughly approximated, and [calculateSpectrum](\ref calculateSpectrum)
+     * returns 1 for them.
+     *
+     * \note For Python, a **ValueError** is raised in place of
+     * **invalid_argument**.
      */
     void setShape(NPSpec::NanoparticleShape npshape);
 
@@ -285,9 +329,28 @@ public:
 
     //! Sets the property of the spectrum for which to calculate.
     /*! \param spec The property of the spectrum you wish to calculate.
+     *  \exception std::invalid_argument One of the extra properties was
+     *              given while the shape is not a Sphere or Ellipsoid.
+     *
+     *  \note For Python, a **ValueError** is raised in place of
+     *  **invalid_argument**.
      */
     void setSpectraProperty(NPSpec::SpectraProperty spec);
 
+    //! Sets whether to always calculate the extra properties.
+    /*! \param extra If true, the backscattering, radiation pressure, albedo
+     *               and asymmetry are calculated along with every spectrum,
+     *               so they can be read with
+     *               [getPropertySpectrum](\ref getPropertySpectrum).
+     *               If false (the default) they are only calculated when
+     *               the spectra property is one of them.
+     *
+     *  \remark
+     *  These come from the same solve as the extinction and scattering, but
+     *  add a little work at each wavelength, so they are off by default.
+     */
+    void setExtraProperties(bool extra);
+
     //! Sets the current spherical radius in nm.
     /*! \param rad The radius to set for a spherical nanoparticle.
      *  \exception std::domain_error A non-positive radius was given.
@@ -439,6 +502,7 @@ private:
     double pathLength;
     double concentration;
     double mediumRefractiveIndex;
+    bool extraProperties;
     std::string materials[NPSpec::MAXLAYERS];
     int  materialIndex[NPSpec::MAXLAYERS];
     double radius[2];
@@ -454,6 +518,11 @@ private:
     double extinction[NPSpec::NLAMBDA];
     double scattering[NPSpec::NLAMBDA];
     double absorbance[NPSpec::NLAMBDA];
+    double backscattering[NPSpec::NLAMBDA];
+    double radiationPressure[NPSpec::NLAMBDA];
+    double albedo[NPSpec::NLAMBDA];
+    double asymmetry[NPSpec::NLAMBDA];
+    bool extraCalculated;
     double red;
     double blue;
     double green;
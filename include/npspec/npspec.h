@@ -43,7 +43,7 @@ int material_index(const char *material);
 /*! \brief This function is used to calculate the spectra of a nanoparticle.
  *
  *  \param [in]  nlayers The number of layers in the nanoparticle.
- *                       This cannot be greater than 10.
+ *                       Any number of layers may be used.
  *  \param [in]  rad An array of length 2 representing the nanoparticle radius
  *                   on the Z axis and the radius on the XY axis. If the XY
  *                   axis component is <0, it is assumed that the particle is
@@ -55,6 +55,9 @@ int material_index(const char *material);
  *  \param [in]  indx The integer index of the material/element to calculate.
  *                    It is an array of length nlayers.
  *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *                       The index of each layer is taken relative to
+ *                       it, for a sphere as for an ellipsoid and as in
+ *                       the other solvers.
  *  \param [in]  size_correct Should we size correct the dielectric function?
  *  \param [in]  increment This is the increment to use when looping over the
  *                         wavelengths.  There are 800 wavelengths in increments
@@ -74,7 +77,25 @@ int material_index(const char *material);
  *  \return The error code indicating what went wrong if the
  *          calculation failed.
  *
- *  \warning For an ellipse a max of two layers are allowed.
+ *  Any of extinct, scat or absorb may be NULL if that spectrum is not
+ *  wanted.  Only the quantities needed for the requested spectra are
+ *  calculated, so an extinction-only or scattering-only calculation of a
+ *  sphere is cheaper.
+ *
+ *  The Mie series is summed for size parameters x up to 300, which needs
+ *  up to [MAXTERMS](\ref MAXTERMS) terms.  At wavelengths where a sphere
+ *  is larger, geometric optics with a diffraction correction is used
+ *  instead, so the cost stays bounded as the radius grows.  Those
+ *  results do not show the ripple of the exact solution.  They were
+ *  found within 5% of it for phase shifts 2 x |m - 1| of at least 40,
+ *  and [SizeWarning](\ref SizeWarning) is returned if geometric optics
+ *  is used below that.
+ *
+ *  Strongly absorbing layers, however thick, are evaluated stably.
+ *
+ *  \remark The layers of an ellipsoid are treated exactly only if they
+ *          are confocal; otherwise each interface uses the geometrical
+ *          factors of its own ellipsoid.
  */
 #ifdef __cplusplus
 NPSpec::ErrorCode npspec (const int nlayers,
@@ -99,6 +120,830 @@ enum ErrorCode npspec (const int nlayers,
                   double absorb[]
                 );
 
+/*! \brief This function calculates the spectra of a nanoparticle like
+ *         [npspec](\ref npspec), and additionally the backscattering,
+ *         radiation pressure, albedo and asymmetry parameter from the same solve.
+ *
+ *  The parameters are the same as [npspec](\ref npspec), followed by four
+ *  more outputs.  Any of the seven outputs may be NULL if it is not wanted,
+ *  and only the quantities needed for the requested outputs are calculated.
+ *  Backscattering and radiation pressure are converted to the requested
+ *  spectra_type in the same way as extinction.  The albedo (scattering over
+ *  extinction) and the asymmetry parameter \f$\langle\cos\theta\rangle\f$
+ *  are always unitless.
+ *
+ *  \param [out] backscat The backscattering spectra.
+ *  \param [out] rad_pressure The radiation pressure spectra.
+ *  \param [out] albedo The single-scattering albedo spectra.
+ *  \param [out] asymmetry The asymmetry parameter spectra.
+ *  \return The error code indicating what went wrong if the
+ *          calculation failed.
+ *
+ *  \remark For an ellipsoid the quasistatic approximation treats the
+ *          nanoparticle as a point dipole, so the backscattering is 3/2 of
+ *          the scattering, the radiation pressure equals the extinction, and
+ *          the asymmetry parameter is zero.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_properties (const int nlayers,
+#else
+enum ErrorCode npspec_properties (const int nlayers,
+#endif
+                  const double rad[2],
+                  const double rel_rad[][2],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  double extinct[],
+                  double scat[],
+                  double absorb[],
+                  double backscat[],
+                  double rad_pressure[],
+                  double albedo[],
+                  double asymmetry[]
+                );
+
+/*! \brief This function calculates the absorption and scattering of a
+ *         nanoparticle for polarized light.
+ *
+ *  The parameters before the polarization are the same as
+ *  [npspec](\ref npspec).  The spectra are found for light polarized
+ *  along the Z axis and along the XY axes of the particle, and for light
+ *  polarized at an angle to the Z axis, all from the same solve.  Any of
+ *  the four outputs may be NULL if it is not wanted.
+ *
+ *  \param [in]  polarization The angle in radians between the polarization
+ *                            and the Z axis.
+ *  \param [out] absorb_axes An array of NLAMBDA x 2 holding the absorption
+ *                           spectra for light polarized along the Z axis,
+ *                           then along the XY axes, for each wavelength.
+ *  \param [out] scat_axes The same as absorb_axes, for scattering.
+ *  \param [out] absorb_pol The absorption spectra at the given polarization,
+ *                          \f$\cos^2\theta\f$ of the Z axis and
+ *                          \f$\sin^2\theta\f$ of the XY axes.
+ *  \param [out] scat_pol The same as absorb_pol, for scattering.
+ *  \return The error code indicating what went wrong if the
+ *          calculation failed.
+ *
+ *  The layout of absorb_axes and scat_axes is that of a C `double
+ *  absorb_axes[NLAMBDA][2]`, or a Fortran `absorb_axes(2,NLAMBDA)`.
+ *
+ *  \remark The spectra of [npspec](\ref npspec) are for randomly oriented
+ *          particles.  Its absorption is the mean of the Z axis and the two
+ *          XY axes here.  A sphere responds the same to every polarization,
+ *          so both axes hold its Mie theory spectra.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_polarized (const int nlayers,
+#else
+enum ErrorCode npspec_polarized (const int nlayers,
+#endif
+                  const double rad[2],
+                  const double rel_rad[][2],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  const double polarization,
+                  double absorb_axes[],
+                  double scat_axes[],
+                  double absorb_pol[],
+                  double scat_pol[]
+                );
+
+/*! \brief This function calculates the spectra of a nanoparticle like
+ *         [npspec](\ref npspec), using at each wavelength the cheapest model
+ *         that is expected to be accurate to a given tolerance.
+ *
+ *  The parameters are the same as [npspec](\ref npspec), with the tolerance
+ *  added before the outputs and the model used reported after them.
+ *  For a sphere each wavelength is solved with the quasistatic
+ *  approximation, the small-particle (Rayleigh) series of the Mie
+ *  coefficients, or the full Mie series, whichever is cheapest of those
+ *  whose estimated relative error in the extinction and scattering is
+ *  within the tolerance.  A sphere too large for the Mie series uses
+ *  geometric optics as in [npspec](\ref npspec).  Sweeps over small
+ *  spheres are therefore much faster than with [npspec](\ref npspec).
+ *
+ *  The full Mie series is also cut short once the terms left out are
+ *  bounded by the tolerance, rather than summed until they underflow, and
+ *  its recurrences are started no higher than that needs.  This bound
+ *  holds for the extinction and scattering; the backscattering sums terms
+ *  of alternating sign, so its relative error may be larger.
+ *
+ *  \param [in] tolerance The relative accuracy wanted, such as 1e-3.
+ *                        With zero or less the full Mie series is always
+ *                        used for a sphere.  The error estimates are
+ *                        conservative for tolerances of 1e-6 and above;
+ *                        below that the full solver is not more accurate.
+ *  \param [out] model An array of length NLAMBDA holding the
+ *                     [SolverModel](\ref SolverModel) used at each
+ *                     wavelength, or ModelSkipped if it was not solved.
+ *                     May be NULL if not wanted.
+ *  \param [out] nterms An array of length NLAMBDA holding the number of
+ *                      Mie coefficients calculated at each wavelength, as
+ *                      for [npspec_coefficients](\ref npspec_coefficients).
+ *                      This is zero for the quasistatic approximation and
+ *                      geometric optics.  May be NULL if not wanted.
+ *  \return The error code indicating what went wrong if the
+ *          calculation failed.
+ *
+ *  \remark Only the quasistatic approximation exists for an ellipsoid, so
+ *          it is always used.  Instead of the check at 200 nm made by
+ *          [npspec](\ref npspec), [SizeWarning](\ref SizeWarning) is
+ *          returned if its estimated error exceeds the tolerance at any
+ *          wavelength.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_auto (const int nlayers,
+#else
+enum ErrorCode npspec_auto (const int nlayers,
+#endif
+                  const double rad[2],
+                  const double rel_rad[][2],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  const double tolerance,
+                  double extinct[],
+                  double scat[],
+                  double absorb[],
+                  int model[],
+                  int nterms[]
+                );
+
+/*! \brief This function calculates the scattering amplitudes
+ *         \f$S_1(\theta)\f$ and \f$S_2(\theta)\f$ of a layered sphere at
+ *         each wavelength for a set of scattering angles.
+ *
+ *  The amplitudes are those of Bohren and Huffman, and are found from the
+ *  same Mie coefficients that give the efficiencies of [npspec](\ref npspec).
+ *  As a check, the extinction efficiency is
+ *  \f$Q_{ext} = 4\,\mathrm{Re}\{S_1(0)\}/x^2\f$ and the backscattering
+ *  efficiency is \f$Q_{back} = 4|S_1(\pi)|^2/x^2\f$, where x is the size
+ *  parameter.
+ *
+ *  \param [in]  nlayers The number of layers in the sphere.
+ *                       There is no upper limit.
+ *  \param [in]  radius The radius of the sphere.
+ *  \param [in]  rel_rad An array of length nlayers holding the relative
+ *                       radius of each layer.  These must sum to 1.0.
+ *  \param [in]  indx The integer index of the material of each layer.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *  \param [in]  size_correct Should we size correct the dielectric function?
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  nangles The number of scattering angles.
+ *  \param [in]  theta An array of length nangles of the scattering angles
+ *                     in radians.
+ *  \param [out] s1 An array of NLAMBDA x nangles complex numbers, stored as
+ *                  interleaved real and imaginary parts, holding S1 for each
+ *                  wavelength and angle.  May be NULL if not wanted.
+ *  \param [out] s2 The same as s1, for S2.  May be NULL if not wanted.
+ *  \return The error code indicating what went wrong if the
+ *          calculation failed.
+ *
+ *  The layout of s1 and s2 is that of a C99 `double complex s1[NLAMBDA][nangles]`,
+ *  or a Fortran `complex(C_DOUBLE_COMPLEX) :: s1(nangles,NLAMBDA)`.
+ *  At wavelengths where geometric optics is used (see [npspec](\ref npspec))
+ *  the amplitudes are zero.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_angular (const int nlayers,
+#else
+enum ErrorCode npspec_angular (const int nlayers,
+#endif
+                  const double radius,
+                  const double rel_rad[],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const int nangles,
+                  const double theta[],
+                  double s1[],
+                  double s2[]
+                );
+
+/*! \brief This function calculates the near-field intensity enhancement
+ *         \f$\langle|E|^2\rangle/|E_0|^2\f$ averaged over the surface of a
+ *         layered sphere, along with its far-field spectra, from one solve.
+ *
+ *  The enhancement is found just outside the outer surface from the same
+ *  Mie coefficients as the far-field spectra, following Messinger et al.
+ *  (Phys. Rev. B 24, 649, 1981).  It tends to 1 when the sphere matches
+ *  the surrounding medium, and to \f$1+2|g|^2\f$ for a small sphere with
+ *  dipolar polarizability g.  It is unitless whatever the spectra_type.
+ *
+ *  \param [in]  nlayers The number of layers in the sphere.
+ *                       There is no upper limit.
+ *  \param [in]  radius The radius of the sphere.
+ *  \param [in]  rel_rad An array of length nlayers holding the relative
+ *                       radius of each layer.  These must sum to 1.0.
+ *  \param [in]  indx The integer index of the material of each layer.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *  \param [in]  size_correct Should we size correct the dielectric function?
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  path_length When calculating absorption, this is the
+ *                           Beer's law path length in cm to use.
+ *  \param [in]  concentration When calculating absorption, this is the
+ *                             Beer's law path concentration in molarity
+ *                             to use.
+ *  \param [in]  spectra_type The spectra type to calculate.  It is an enum of
+ *                            [SpectraType](\ref SpectraType).
+ *  \param [out] extinct The extinction spectra.
+ *  \param [out] scat The scattering spectra.
+ *  \param [out] absorb The absorbance spectra.
+ *  \param [out] enhancement The surface-averaged near-field enhancement spectra.
+ *  \return The error code indicating what went wrong if the
+ *          calculation failed.
+ *
+ *  Any of the outputs may be NULL if not wanted.  The enhancement is zero
+ *  where geometric optics is used (see [npspec](\ref npspec)).
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_nearfield (const int nlayers,
+#else
+enum ErrorCode npspec_nearfield (const int nlayers,
+#endif
+                  const double radius,
+                  const double rel_rad[],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  double extinct[],
+                  double scat[],
+                  double absorb[],
+                  double enhancement[]
+                );
+
+/*! \brief This function calculates the contribution of each electric and
+ *         magnetic multipole to the extinction and scattering spectra of a
+ *         layered sphere, along with the totals, from one solve.
+ *
+ *  Order n = 1 is the dipole, n = 2 the quadrupole, and so on.  The
+ *  electric terms come from \f$a_n\f$ and the magnetic terms from
+ *  \f$b_n\f$, so that for example the electric dipole extinction
+ *  efficiency is \f$3\cdot 2\,\mathrm{Re}\{a_1\}/x^2\f$.  Summed over
+ *  every order the contributions give the totals.
+ *
+ *  \param [in]  nlayers The number of layers in the sphere.
+ *                       There is no upper limit.
+ *  \param [in]  radius The radius of the sphere.
+ *  \param [in]  rel_rad An array of length nlayers holding the relative
+ *                       radius of each layer.  These must sum to 1.0.
+ *  \param [in]  indx The integer index of the material of each layer.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *  \param [in]  size_correct Should we size correct the dielectric function?
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  path_length When calculating absorption, this is the
+ *                           Beer's law path length in cm to use.
+ *  \param [in]  concentration When calculating absorption, this is the
+ *                             Beer's law path concentration in molarity
+ *                             to use.
+ *  \param [in]  spectra_type The spectra type to calculate.  It is an enum of
+ *                            [SpectraType](\ref SpectraType).
+ *  \param [out] extinct The total extinction spectra.
+ *  \param [out] scat The total scattering spectra.
+ *  \param [in]  norders The number of orders to return.
+ *  \param [out] ext_electric An array of NLAMBDA x norders holding the
+ *                            extinction of each electric multipole.
+ *  \param [out] ext_magnetic The same, for the magnetic multipoles.
+ *  \param [out] sca_electric The same, for the scattering of each
+ *                            electric multipole.
+ *  \param [out] sca_magnetic The same, for the scattering of each
+ *                            magnetic multipole.
+ *  \return The error code indicating what went wrong if the
+ *          calculation failed.
+ *
+ *  Any of the outputs may be NULL if not wanted.  Orders beyond the end of
+ *  the Mie series are zero, as are all orders where geometric optics is
+ *  used (see [npspec](\ref npspec)).  The per-order arrays are C arrays
+ *  `[NLAMBDA][norders]`, or Fortran arrays `(norders,NLAMBDA)`.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_multipoles (const int nlayers,
+#else
+enum ErrorCode npspec_multipoles (const int nlayers,
+#endif
+                  const double radius,
+                  const double rel_rad[],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  double extinct[],
+                  double scat[],
+                  const int norders,
+                  double ext_electric[],
+                  double ext_magnetic[],
+                  double sca_electric[],
+                  double sca_magnetic[]
+                );
+
+/*! \brief This function returns the Mie coefficients \f$a_n\f$ and
+ *         \f$b_n\f$ of a layered sphere at each wavelength.
+ *
+ *  These are the coefficients of Bohren and Huffman from which every
+ *  quantity calculated by [npspec](\ref npspec),
+ *  [npspec_properties](\ref npspec_properties) and
+ *  [npspec_angular](\ref npspec_angular) is found, so further analyses can
+ *  be built on a single Mie solve.  The first element of each row is
+ *  the n = 1 (dipole) term.
+ *
+ *  \param [in]  nlayers The number of layers in the sphere.
+ *                       There is no upper limit.
+ *  \param [in]  radius The radius of the sphere.
+ *  \param [in]  rel_rad An array of length nlayers holding the relative
+ *                       radius of each layer.  These must sum to 1.0.
+ *  \param [in]  indx The integer index of the material of each layer.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *  \param [in]  size_correct Should we size correct the dielectric function?
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  maxterms The number of terms stored for each wavelength.
+ *                        Using [MAXTERMS](\ref MAXTERMS) ensures that the
+ *                        series is never truncated.
+ *  \param [out] an An array of NLAMBDA x maxterms complex numbers, stored as
+ *                  interleaved real and imaginary parts, holding \f$a_n\f$.
+ *                  Terms past the end of the series are zero.
+ *                  May be NULL if not wanted.
+ *  \param [out] bn The same as an, for \f$b_n\f$.  May be NULL if not wanted.
+ *  \param [out] nterms An array of length NLAMBDA holding the number of terms
+ *                      stored for each wavelength.  This is zero where
+ *                      geometric optics is used (see [npspec](\ref npspec)).
+ *                      May be NULL if not wanted.
+ *  \return The error code indicating what went wrong if the
+ *          calculation failed.
+ *
+ *  The layout of an and bn is that of a C99 `double complex an[NLAMBDA][maxterms]`,
+ *  or a Fortran `complex(C_DOUBLE_COMPLEX) :: an(maxterms,NLAMBDA)`.
+ *  Each row has the same stride rather than being packed end to end, so
+ *  that the caller can size the arrays before the solve, the row of any
+ *  wavelength is found without a table of offsets, and Fortran sees an
+ *  ordinary two-dimensional array.  The series is longest at the
+ *  shortest wavelength, so a caller that wants the rows tight can first
+ *  call with an and bn NULL and then use the largest of nterms as maxterms.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_coefficients (const int nlayers,
+#else
+enum ErrorCode npspec_coefficients (const int nlayers,
+#endif
+                  const double radius,
+                  const double rel_rad[],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const int maxterms,
+                  double an[],
+                  double bn[],
+                  int nterms[]
+                );
+
+/*! \brief This function is used to calculate the spectra of many nanoparticles
+ *         that share the same number of layers in a single call.
+ *
+ *  Each particle is calculated exactly as if [npspec](\ref npspec) had been
+ *  called on it.  The arrays are laid out so that they are the natural
+ *  column-major arrays in Fortran, and the natural multi-dimensional arrays
+ *  in C, so no transposition is needed in either language.  In Fortran
+ *  notation, the shapes are `rad(2,nparticles)`,
+ *  `rel_rad(2,nlayers,nparticles)`, `indx(nlayers,nparticles)` and
+ *  `extinct(NLAMBDA,nparticles)`.
+ *
+ *  \param [in]  nparticles The number of nanoparticles in the batch.
+ *  \param [in]  nlayers The number of layers in each nanoparticle.
+ *                       Any number of layers may be used.
+ *  \param [in]  rad An array of length nparticles x 2 holding the radius of
+ *                   each nanoparticle, as in [npspec](\ref npspec).
+ *  \param [in]  rel_rad An array of length nparticles x nlayers x 2 holding
+ *                       the relative radius of each layer of each nanoparticle.
+ *  \param [in]  indx An array of length nparticles x nlayers holding the
+ *                    material index of each layer of each nanoparticle.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *  \param [in]  size_correct Should we size correct the dielectric function?
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  path_length When calculating absorption, this is the
+ *                           Beer's law path length in cm to use.
+ *  \param [in]  concentration When calculating absorption, this is the
+ *                             Beer's law path concentration in molarity
+ *                             to use.
+ *  \param [in]  spectra_type The spectra type to calculate.  It is an enum of
+ *                            [SpectraType](\ref SpectraType).
+ *  \param [out] extinct An array of length nparticles x NLAMBDA holding the
+ *                       extinction spectrum of each nanoparticle.
+ *  \param [out] scat An array of length nparticles x NLAMBDA holding the
+ *                    scattering spectrum of each nanoparticle.
+ *  \param [out] absorb An array of length nparticles x NLAMBDA holding the
+ *                      absorbance spectrum of each nanoparticle.
+ *  \param [out] retcodes An array of length nparticles holding the error code
+ *                        of each nanoparticle.  May be NULL if not wanted.
+ *  \return NoError if every nanoparticle was calculated without error,
+ *          otherwise the error code of the first nanoparticle that failed.
+ *
+ *  As with [npspec](\ref npspec), any of extinct, scat or absorb may be NULL.
+ *
+ *  \remark This function, [npspec](\ref npspec), [RGB](\ref RGB) and
+ *          [RGB_to_HSV](\ref RGB_to_HSV) keep no state between calls,
+ *          so they may be called concurrently from multiple threads
+ *          (e.g. inside an OpenMP parallel loop).
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_batch (const int nparticles,
+#else
+enum ErrorCode npspec_batch (const int nparticles,
+#endif
+                  const int nlayers,
+                  const double rad[][2],
+                  const double rel_rad[][2],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  double extinct[],
+                  double scat[],
+                  double absorb[],
+                  int retcodes[]
+                );
+
+/*! \brief A refractive index that varies with the distance from the centre
+ *         of a sphere, for [npspec_profile](\ref npspec_profile).
+ *
+ *  \param [in]  r The distance from the centre of the sphere in nm, from 0
+ *                 to its radius.
+ *  \param [in]  wavelength The wavelength in nm, one of
+ *                          [wavelengths](\ref wavelengths).
+ *  \param [in]  data The pointer passed to [npspec_profile](\ref npspec_profile),
+ *                    for any parameters of the profile.
+ *  \param [out] n The real part of the refractive index, not relative to
+ *                 the medium.
+ *  \param [out] k The imaginary part of the refractive index.
+ */
+typedef void (*RadialProfile)(const double r,
+                              const double wavelength,
+                              void *data,
+                              double *n,
+                              double *k);
+
+/*! \brief This function calculates the spectra of a sphere whose refractive
+ *         index varies continuously with radius, such as an alloy gradient
+ *         or an oxide diffusing in from the surface.
+ *
+ *  At each wavelength the sphere is divided into concentric shells, each
+ *  taking the mean of the profile across it.  The shells across which the
+ *  index changes most are halved until the extinction and scattering
+ *  change by less than the tolerance from one division to the next, so
+ *  fine shells are only used where the profile is steep.  The samples of
+ *  the profile and the work for each shell that is not halved are reused
+ *  from one division to the next.  Tabulated samples of a profile can be
+ *  used by interpolating them in the callback.
+ *
+ *  \param [in]  radius The radius of the sphere.
+ *  \param [in]  profile The refractive index at a given radius and
+ *                       wavelength, as a [RadialProfile](\ref RadialProfile).
+ *                       It is used as the index of a material would be
+ *                       in [npspec](\ref npspec), and is only called from
+ *                       the thread that calls this function.
+ *  \param [in]  data Passed on to every call of profile.  May be NULL.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *                       The profile is taken relative to it.
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  path_length When calculating absorption, this is the
+ *                           Beer's law path length in cm to use.
+ *  \param [in]  concentration When calculating absorption, this is the
+ *                             Beer's law path concentration in molarity
+ *                             to use.
+ *  \param [in]  spectra_type The spectra type to calculate.  It is an enum of
+ *                            [SpectraType](\ref SpectraType).
+ *  \param [in]  tolerance The relative accuracy wanted, such as 1e-3.  With
+ *                         zero or less the sphere is always divided into
+ *                         the most shells allowed, 2048.
+ *  \param [out] extinct The extinction spectrum.
+ *  \param [out] scat The scattering spectrum.
+ *  \param [out] absorb The absorbance spectrum.
+ *  \param [out] nshells An array of length NLAMBDA holding the number of
+ *                       shells used at each wavelength, or zero if it was
+ *                       not solved.  May be NULL if not wanted.
+ *  \return The error code indicating what went wrong if the calculation
+ *          failed.  InvalidRefractiveIndex is returned if profile is NULL,
+ *          and [SizeWarning](\ref SizeWarning) if the spectrum had not
+ *          converged to the tolerance at some wavelength with the most
+ *          shells allowed.
+ *
+ *  As with [npspec](\ref npspec), any of extinct, scat or absorb may be NULL.
+ *  A sphere too large for the Mie series uses geometric optics as in
+ *  [npspec](\ref npspec), with the shells of the first division, and
+ *  gives the same [SizeWarning](\ref SizeWarning) outside the bounds
+ *  where it was checked.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_profile (const double radius,
+#else
+enum ErrorCode npspec_profile (const double radius,
+#endif
+                  const RadialProfile profile,
+                  void *data,
+                  const double mrefrac,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  const double tolerance,
+                  double extinct[],
+                  double scat[],
+                  double absorb[],
+                  int nshells[]
+                );
+
+/*! \brief Calculate the spectra of a homogeneous spheroid exactly, by the
+ *         T-matrix (extended boundary condition) method.
+ *
+ *  This is the [Spheroid](\ref Spheroid) shape of the
+ *  [Nanoparticle](\ref Nanoparticle) class.  Unlike the quasistatic
+ *  approximation that [npspec](\ref npspec) uses for an ellipsoid, it holds
+ *  for a spheroid of any size, such as a nanorod whose longest axis is
+ *  comparable to the wavelength.  The spectra are averaged over every
+ *  orientation of the spheroid.
+ *
+ *  The T-matrix of each wavelength is kept in a cache shared by all
+ *  threads, so that asking again for the same spheroid, material and
+ *  wavelengths does not solve them again; only the conversion to
+ *  spectra_type is repeated.  The cache holds at most 64 MB, dropping the
+ *  T-matrices least recently used.
+ *
+ *  \param [in]  rad An array of length 2 holding the radius on the Z axis,
+ *                   the axis of symmetry, and on the XY axis.  Both must be
+ *                   positive.
+ *  \param [in]  indx The integer index of the material.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *  \param [in]  size_correct Should we size correct the dielectric function?
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  path_length When calculating absorption, this is the
+ *                           Beer's law path length in cm to use.
+ *  \param [in]  concentration When calculating absorption, this is the
+ *                             Beer's law path concentration in molarity
+ *                             to use.
+ *  \param [in]  spectra_type The spectra type to calculate.  It is an enum of
+ *                            [SpectraType](\ref SpectraType).
+ *  \param [out] extinct The extinction spectrum.
+ *  \param [out] scat The scattering spectrum.
+ *  \param [out] absorb The absorbance spectrum.
+ *  \return The error code indicating what went wrong if the calculation
+ *          failed.  [SizeWarning](\ref SizeWarning) is returned if the
+ *          T-matrix did not converge at some wavelength, which happens
+ *          when the spheroid is too large or too elongated for the
+ *          precision of the method.
+ *
+ *  As with [npspec](\ref npspec), any of extinct, scat or absorb may be NULL,
+ *  and the efficiencies are relative to the sphere of the same volume.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_tmatrix (const double rad[2],
+#else
+enum ErrorCode npspec_tmatrix (const double rad[2],
+#endif
+                  const int indx,
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  double extinct[],
+                  double scat[],
+                  double absorb[]
+                );
+
+/*! \brief Empty the cache of T-matrices kept by
+ *         [npspec_tmatrix](\ref npspec_tmatrix).
+ */
+void npspec_tmatrix_cache_clear(void);
+
+/*! \brief The number of T-matrices held in the cache of
+ *         [npspec_tmatrix](\ref npspec_tmatrix).
+ */
+int npspec_tmatrix_cache_size(void);
+
+/*! \brief Calculate the spectra of a particle of any shape by the discrete
+ *         dipole approximation.
+ *
+ *  The particle is divided into dipoles on a cubic lattice, resolution of
+ *  them across its longest dimension, which are solved for iteratively
+ *  with the interactions between them found by FFT.  This is the solver
+ *  for the [Cube](\ref Cube), [Rod](\ref Rod) and [Prism](\ref Prism)
+ *  shapes of the [Nanoparticle](\ref Nanoparticle) class, but any
+ *  [NanoparticleShape](\ref NanoparticleShape) may be given, which is a
+ *  check of the approximation against the exact solvers.
+ *
+ *  The spectra are averaged over light incident along each of the three
+ *  axes, polarized along a different axis each time, which approaches
+ *  the average over every orientation for particles small beside the
+ *  wavelength.
+ *  The approximation is accurate when |m| k d < 1 for the refractive
+ *  index m, wavenumber k and dipole spacing d, and when |m - 1| < 2.
+ *  Metals such as Au and Ag exceed the latter through most of the
+ *  visible, where the spectrum is only a rough guide however many
+ *  dipoles are used.  The time taken grows a little faster than the
+ *  cube of resolution.
+ *
+ *  \param [in]  shape The shape of the particle.  Its size is given by rad:
+ *                    - [Sphere](\ref Sphere): rad[0] is the radius.
+ *                    - [Ellipsoid](\ref Ellipsoid) or
+ *                      [Spheroid](\ref Spheroid): the radii on the Z axis,
+ *                      the axis of symmetry, and on the XY axis.
+ *                    - [Cube](\ref Cube): half the length on the Z axis,
+ *                      and half the width of the square across it.
+ *                    - [Rod](\ref Rod): half the length on the Z axis,
+ *                      caps included, and the radius across it.  The
+ *                      length may not be less than the width.
+ *                    - [Prism](\ref Prism): half the thickness on the Z
+ *                      axis, and half the side of the triangle across it.
+ *  \param [in]  rad An array of length 2 holding the sizes given above.
+ *  \param [in]  indx The integer index of the material.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *  \param [in]  size_correct Should we size correct the dielectric function?
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  path_length When calculating absorption, this is the
+ *                           Beer's law path length in cm to use.
+ *  \param [in]  concentration When calculating absorption, this is the
+ *                             Beer's law path concentration in molarity
+ *                             to use.
+ *  \param [in]  spectra_type The spectra type to calculate.  It is an enum of
+ *                            [SpectraType](\ref SpectraType).
+ *  \param [in]  resolution The number of dipoles across the longest
+ *                          dimension of the particle.
+ *                          [DDA_RESOLUTION](\ref DDA_RESOLUTION) is a
+ *                          reasonable default.
+ *  \param [out] extinct The extinction spectrum.
+ *  \param [out] scat The scattering spectrum.
+ *  \param [out] absorb The absorbance spectrum.
+ *  \return The error code indicating what went wrong if the calculation
+ *          failed.  [SizeWarning](\ref SizeWarning) is returned if
+ *          |m| k d exceeded 1 or the dipoles did not converge at some
+ *          wavelength, meaning a larger resolution is needed, or if
+ *          |m - 1| exceeded 2, meaning the material is too metallic for
+ *          the approximation.
+ *
+ *  As with [npspec](\ref npspec), any of extinct, scat or absorb may be NULL,
+ *  and the efficiencies are relative to the sphere of the same volume.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_dda (const NPSpec::NanoparticleShape shape,
+#else
+enum ErrorCode npspec_dda (const enum NanoparticleShape shape,
+#endif
+                  const double rad[2],
+                  const int indx,
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  const int resolution,
+                  double extinct[],
+                  double scat[],
+                  double absorb[]
+                );
+
+/*! \brief Calculate the spectra of a cluster of identical spheres, such as
+ *         a dimer, a chain, an array or an aggregate.
+ *
+ *  Each sphere is a point dipole with the electric dipole polarizability
+ *  that Mie theory gives it, and the dipoles are coupled through the
+ *  fields they radiate at each other.  When every sphere lies on a common
+ *  cubic lattice the coupling is found by FFT, whose cost grows as
+ *  N log N in the number of spheres; otherwise it is summed over every
+ *  pair, whose cost grows as N^2.  Aggregates that are not on a lattice
+ *  are therefore limited in practice to a few thousand spheres: the
+ *  interaction of each pair is kept between iterations for up to about
+ *  a thousand spheres, and found again in every iteration beyond that.
+ *  The magnetic dipole and higher multipoles of each sphere are not
+ *  coupled, but are added to the spectra as if the spheres were
+ *  isolated, so a single sphere or spheres far apart give the spectra
+ *  of Mie theory.
+ *
+ *  As with [npspec_dda](\ref npspec_dda), the spectra are averaged over
+ *  light incident along each of the three axes, polarized along a
+ *  different axis each time, and the refractive index of each layer is
+ *  taken relative to the medium.
+ *
+ *  \param [in]  nparticles The number of spheres in the cluster.
+ *  \param [in]  positions An array of length nparticles x 3 holding the
+ *                         center of each sphere in nm.  The spheres may
+ *                         touch but not overlap.
+ *  \param [in]  nlayers The number of layers in each sphere.
+ *  \param [in]  radius The radius of each sphere.
+ *  \param [in]  rel_rad An array of length nlayers holding the relative
+ *                       radius of each layer, summing to 1.0.
+ *  \param [in]  indx An array of length nlayers holding the material
+ *                    index of each layer.
+ *  \param [in]  mrefrac The refractive index of the surrounding medium.
+ *  \param [in]  size_correct Should we size correct the dielectric function?
+ *  \param [in]  increment The increment to use when looping over the wavelengths.
+ *  \param [in]  path_length When calculating absorption, this is the
+ *                           Beer's law path length in cm to use.
+ *  \param [in]  concentration When calculating absorption, this is the
+ *                             Beer's law path concentration in molarity
+ *                             of clusters to use.
+ *  \param [in]  spectra_type The spectra type to calculate.  It is an enum of
+ *                            [SpectraType](\ref SpectraType).
+ *  \param [out] extinct The extinction spectrum.
+ *  \param [out] scat The scattering spectrum.
+ *  \param [out] absorb The absorbance spectrum.
+ *  \return The error code indicating what went wrong if the calculation
+ *          failed.  [InvalidPositions](\ref InvalidPositions) is returned
+ *          if there are no spheres or two overlap.
+ *          [SizeWarning](\ref SizeWarning) is returned if the uncoupled
+ *          multipoles reach more than a tenth of the peak extinction of
+ *          a sphere, or the dipoles did not converge at some wavelength.
+ *
+ *  Any of extinct, scat or absorb may be NULL.  The spectra are of the
+ *  whole cluster, with efficiencies relative to the sphere of the same
+ *  volume as all of the spheres together.
+ */
+#ifdef __cplusplus
+NPSpec::ErrorCode npspec_cluster (const int nparticles,
+#else
+enum ErrorCode npspec_cluster (const int nparticles,
+#endif
+                  const double positions[][3],
+                  const int nlayers,
+                  const double radius,
+                  const double rel_rad[],
+                  const int indx[],
+                  const double mrefrac,
+                  const bool size_correct,
+                  const int increment,
+                  const double path_length,
+                  const double concentration,
+#ifdef __cplusplus
+                  const NPSpec::SpectraType spectra_type,
+#else
+                  const enum SpectraType spectra_type,
+#endif
+                  double extinct[],
+                  double scat[],
+                  double absorb[]
+                );
+
 /*! \brief Given a spectra as calculated by npspec,
  *         return the color in RGB color space
  *
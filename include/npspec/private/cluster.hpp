@@ -0,0 +1,87 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "npspec/private/dda.hpp"
+#include <complex>
+#include <vector>
+
+/* A cluster is solved on a lattice when the lattice box holds at most
+   this many sites for each particle, which keeps the FFT cheaper than
+   summing over every pair */
+const int CLUSTER_MAXFILL = 8;
+
+/* A SizeWarning is given when the multipoles beyond the electric dipole,
+   which are not coupled, reach more than this fraction of the peak
+   extinction of each sphere */
+const double CLUSTER_MAXHIGHER = 0.1;
+
+/* The interaction of each pair is kept for the wavenumber when there are
+   at most this many pairs (about 50 MB), so is not found again for every
+   iteration */
+const long CLUSTER_MAXPAIRS = 1L << 19;
+
+/* The field of point dipoles at arbitrary positions, summed over every
+   pair.  This costs O(N^2) for N dipoles in every iteration, so is only
+   used for clusters that do not lie on a lattice.  There is no tree or
+   multipole approximation of the far pairs, so the sum is exact; beyond
+   CLUSTER_MAXPAIRS pairs (about 1000 dipoles) each pair is also found
+   again in every iteration, which is several times slower again. */
+class DipolePairs : public DipoleInteraction {
+public:
+    /* The x, y and z of each site in turn, in units of d */
+    explicit DipolePairs(const std::vector<double>& positions);
+
+    int nsites() const { return static_cast<int>(positions_.size() / 3); }
+
+    void set_wavenumber(const double kd);
+
+    void apply(const std::complex<double> dipoles[],
+               std::complex<double> field[]);
+
+private:
+    void tensor(const int i, const int j, std::complex<double> t[6]) const;
+
+    std::vector<double> positions_;
+    double kd_;
+    std::vector< std::complex<double> > tensors_;
+};
+
+/* A cluster of identical spheres, each a point dipole with the electric
+   dipole polarizability of the sphere, found in cluster.cpp.  The
+   interaction is by FFT when the spheres lie on a common cubic lattice
+   and by direct summation otherwise.  As with the DDA the dipoles of the
+   last solve are the first guess of the next. */
+class Cluster {
+public:
+    /* The positions (nm) of each particle in turn */
+    Cluster(const int nparticles, const double positions[][3]);
+    ~Cluster();
+
+    int nparticles() const { return interaction_->nsites(); }
+    bool on_lattice() const { return lattice_ != NULL; }
+
+    /* The cross sections (nm^2) of the whole cluster, averaged over the
+       DDA_INCIDENCES incident fields, given the a(1) Mie coefficient of
+       each sphere and the wavenumber in the medium in 1/nm.  1 is
+       returned if the dipoles did not converge. */
+    int solve(const std::complex<double> a1, const double k,
+              double *extinct, double *scat, double *absorb);
+
+private:
+    Cluster(const Cluster&);
+    Cluster& operator=(const Cluster&);
+
+    double spacing_;
+    std::vector<double> positions_;
+    DipoleLattice *lattice_;
+    DipoleInteraction *interaction_;
+    std::vector< std::complex<double> > dipoles_[DDA_INCIDENCES];
+};
+
+/* True if any two spheres of the given radius overlap */
+bool cluster_overlaps (const int nparticles,
+                       const double positions[][3],
+                       const double radius
+                     );
+
+#endif // CLUSTER_H
@@ -0,0 +1,132 @@
+#ifndef DDA_H
+#define DDA_H
+
+#include "npspec/constants.h"
+#include "npspec/private/fft.hpp"
+#include <complex>
+#include <vector>
+
+/* Limits of the discrete dipole approximation.  The dipoles are solved
+   for iteratively until the residual is DDA_TOLERANCE of the incident
+   field, for at most DDA_MAXITER iterations.  The approximation is only
+   accurate while |m| k d, for a dipole spacing d, is below DDA_MAXKD,
+   and while |m - 1| is below DDA_MAXINDEX (Draine & Flatau).  Beyond
+   that, as for Au and Ag through most of the visible, a sphere of 8 to
+   16 dipoles across is off by 30% and more from Mie theory, against 10%
+   and less below it, and each solve takes many more iterations. */
+const double DDA_TOLERANCE = 1e-5;
+const int    DDA_MAXITER   = 2000;
+const double DDA_MAXKD     = 1.0;
+const double DDA_MAXINDEX  = 2.0;
+
+/* The number of incident fields a spectrum is averaged over: along each
+   of the three axes, each polarized along a different axis */
+const int DDA_INCIDENCES = 3;
+
+/* The occupied sites of a cubic lattice of dims[0] x dims[1] x dims[2]
+   points, each given by its index x + dims[0] * ( y + dims[1] * z ) */
+struct DipoleSites {
+    DipoleSites() : dims(), sites() {}
+    int dims[3];
+    std::vector<int> sites;
+};
+
+/* The field that a set of point dipoles radiate at each other, with
+   lengths in some unit d.  This is all the solver needs to know of how
+   the dipoles are arranged. */
+class DipoleInteraction {
+public:
+    virtual ~DipoleInteraction() {}
+
+    virtual int nsites() const = 0;
+
+    /* Set the wavenumber, in units of d */
+    virtual void set_wavenumber(const double kd) = 0;
+
+    /* field = the field at each site from the dipoles at every other.
+       Both hold the x, y and z components for each site in turn. */
+    virtual void apply(const std::complex<double> dipoles[],
+                       std::complex<double> field[]) = 0;
+};
+
+/* The point dipoles on the sites of a lattice of unit spacing, and the
+   field each radiates at the others.  The interaction only depends on
+   the separation of two sites, so it is a convolution over the lattice
+   and is applied by FFT on a grid of about twice the lattice. */
+class DipoleLattice : public DipoleInteraction {
+public:
+    explicit DipoleLattice(const DipoleSites& sites);
+
+    int nsites() const { return static_cast<int>(sites_.size()); }
+    const int *dims() const { return dims_; }
+
+    /* The position of a site on the lattice */
+    void position(const int site, int xyz[3]) const;
+
+    void set_wavenumber(const double kd);
+    double wavenumber() const { return kd_; }
+
+    void apply(const std::complex<double> dipoles[],
+               std::complex<double> field[]);
+
+private:
+    int dims_[3];
+    int grid_[3];
+    std::vector<int> sites_;
+    std::vector<int> cells_;
+    FFT3 fft_;
+    double kd_;
+    std::vector< std::complex<double> > tensor_[6];
+    std::vector< std::complex<double> > work_[3];
+};
+
+/* Solve for the dipoles p from alpha_inv[i] p_i - sum_j G_ij p_j = e_i,
+   given the inverse polarizability of each site.  dipoles holds a first
+   guess on entry.  The number of iterations is returned, or -1 if it
+   did not converge. */
+int dipole_solve (DipoleInteraction& interaction,
+                  const std::vector< std::complex<double> >& alpha_inv,
+                  const std::complex<double> field[],
+                  std::complex<double> dipoles[]
+                );
+
+/* The orientation averaged efficiencies of a particle of any of the
+   NanoparticleShapes by the discrete dipole approximation, found in
+   dda.cpp.  The dipoles of the last solve are kept as the first guess
+   of the next, which is close when stepping through the wavelengths. */
+class DDA {
+public:
+    /* Place the dipoles, resolution across the longest dimension.  The
+       spacing is then set so that they have the volume of the shape. */
+    DDA(const NPSpec::NanoparticleShape shape, const double rad[2],
+        const int resolution);
+
+    int ndipoles() const { return lattice_.nsites(); }
+    double spacing() const { return spacing_; }
+
+    /* The radius of the sphere with the volume of the dipoles */
+    double volume_radius() const;
+
+    /* Efficiencies relative to the sphere of the same volume, for the
+       dielectric relative to the medium and the wavenumber in the medium
+       in 1/nm.  1 is returned if |m| k d exceeds DDA_MAXKD, |m - 1|
+       exceeds DDA_MAXINDEX or the dipoles did not converge. */
+    int solve(const std::complex<double> dielec, const double k,
+              double *extinct, double *scat, double *absorb);
+
+private:
+    double spacing_;
+    double volume_;
+    DipoleLattice lattice_;
+    std::vector< std::complex<double> > dipoles_[DDA_INCIDENCES];
+};
+
+/* The sites of a shape on a lattice of the given spacing (nm), and its
+   exact volume */
+DipoleSites dda_sites (const NPSpec::NanoparticleShape shape,
+                       const double rad[2],
+                       const double spacing,
+                       double *volume
+                     );
+
+#endif // DDA_H
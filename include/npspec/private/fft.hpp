@@ -0,0 +1,68 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <vector>
+
+/* A complex product without the checks for infinities and NaNs that
+   std::complex makes, which otherwise dominate the time of a transform */
+inline std::complex<double> mul(const std::complex<double>& a,
+                                const std::complex<double>& b) {
+    return std::complex<double>(real(a) * real(b) - imag(a) * imag(b),
+                                real(a) * imag(b) + imag(a) * real(b));
+}
+
+/* A mixed radix fast Fourier transform of one length, found in fft.cpp.
+   Any length may be used, but those whose only factors are 2, 3 and 5
+   (see fft_size) are much the fastest. */
+class FFT {
+public:
+    explicit FFT(const int n);
+
+    int size() const { return n_; }
+
+    /* out[k] = sum_j in[j*stride] exp(-+2 pi i j k / n), the sign being
+       positive for the inverse.  The inverse is not divided by n.  out
+       must not overlap in. */
+    void transform(const std::complex<double> *in, const int stride,
+                   std::complex<double> *out, const bool inverse) const;
+
+private:
+    void work(std::complex<double> *out, const std::complex<double> *in,
+              const int fstride, const int in_stride, const int *factors,
+              const bool inverse) const;
+
+    int n_;
+    std::vector<int> factors_;
+    std::vector< std::complex<double> > twiddles_[2];
+};
+
+/* The smallest length of at least n whose only factors are 2, 3 and 5 */
+int fft_size(const int n);
+
+/* A three dimensional transform of a grid stored with x varying fastest.
+   The pruned transforms assume that only the box of the first box[3]
+   points on each axis is non-zero going forward, and only need that box
+   coming back, which saves close to half of the work for a grid that is
+   twice the box on each axis. */
+class FFT3 {
+public:
+    FFT3(const int dims[3]);
+
+    int size() const { return dims_[0] * dims_[1] * dims_[2]; }
+    const int *dims() const { return dims_; }
+
+    void forward(std::complex<double> grid[]) const;
+    void forward(std::complex<double> grid[], const int box[3]) const;
+    void inverse(std::complex<double> grid[], const int box[3]) const;
+
+private:
+    void lines(std::complex<double> grid[], const int axis, const int nlines[2],
+               const bool inverse) const;
+
+    int dims_[3];
+    FFT fft_[3];
+    mutable std::vector< std::complex<double> > line_;
+};
+
+#endif // FFT_H
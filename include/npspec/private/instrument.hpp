@@ -0,0 +1,99 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/* Hooks for the optional instrumentation layer.  Unless NPSPEC_INSTRUMENT
+ * is defined every macro here expands to nothing, so the hot paths are
+ * identical to an uninstrumented build. */
+
+#include "npspec/instrument.h"
+
+#ifdef NPSPEC_INSTRUMENT
+
+#include <atomic>
+#include <chrono>
+
+namespace NPSpec {
+namespace Instrument {
+
+/* The counters kept per thread.  Each thread only ever writes its own
+ * counters, so relaxed loads and stores are enough; they are atomic only
+ * so that other threads can read them without a data race. */
+enum Counter { NPSpecCalls, MieCalls, QuasiCalls, WavelengthsEvaluated,
+               WavelengthsSkipped, SizeCorrections, SizeWarnings,
+               ColorCalls, TMatrixCalls, TMatrixCacheHits, DipoleSolves,
+               DipoleIterations, NumCounters };
+
+struct ThreadCounters {
+    std::atomic<long long> counts[NumCounters];
+    std::atomic<long long> num[NumOrderBins];
+    std::atomic<long long> num1[NumOrderBins];
+    std::atomic<double> seconds[NumPhases];
+};
+
+/* This thread's counters, or NULL until it first records something */
+extern thread_local ThreadCounters *current;
+
+/* Register this thread's counters */
+ThreadCounters& attach();
+
+inline ThreadCounters& local() {
+    ThreadCounters *c = current;
+    return c != NULL ? *c : attach();
+}
+
+template <typename T>
+inline void add(std::atomic<T>& a, const T n) {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline int order_bin(const int n) {
+    const int bin = n / OrderBinWidth;
+    return bin < NumOrderBins ? bin : NumOrderBins - 1;
+}
+
+inline void count(const Counter c, const long long n) {
+    add(local().counts[c], n);
+}
+
+inline void order(const int num, const int num1) {
+    ThreadCounters& c = local();
+    add(c.num[order_bin(num)], 1LL);
+    add(c.num1[order_bin(num1)], 1LL);
+}
+
+/* Adds the time between construction and destruction to a phase */
+class Timer {
+public:
+    explicit Timer(const InstrumentPhase phase)
+        : phase_(phase), start_(std::chrono::steady_clock::now()) {}
+    ~Timer() {
+        const std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - start_;
+        add(local().seconds[phase_], dt.count());
+    }
+private:
+    const InstrumentPhase phase_;
+    const std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace Instrument
+} // namespace NPSpec
+
+#define NPSPEC_COUNT(counter) \
+    NPSpec::Instrument::count(NPSpec::Instrument::counter, 1)
+#define NPSPEC_COUNT_N(counter, n) \
+    NPSpec::Instrument::count(NPSpec::Instrument::counter, (n))
+#define NPSPEC_ORDER(num, num1) NPSpec::Instrument::order((num), (num1))
+#define NPSPEC_TIME(phase) \
+    NPSpec::Instrument::Timer npspec_timer_##phase(NPSpec::phase)
+
+#else
+
+#define NPSPEC_COUNT(counter) ((void)0)
+#define NPSPEC_COUNT_N(counter, n) ((void)0)
+#define NPSPEC_ORDER(num, num1) ((void)0)
+#define NPSPEC_TIME(phase)
+
+#endif /* NPSPEC_INSTRUMENT */
+
+#endif // INSTRUMENT_H
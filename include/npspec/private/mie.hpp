@@ -0,0 +1,86 @@
+#ifndef MIE_H
+#define MIE_H
+
+#include "npspec/constants.h"
+#include <complex>
+#include <vector>
+
+/* Number of terms of the Mie series kept on the stack, which is enough
+   for spheres up to a size parameter of about 65.  Longer series, up to
+   MAXTERMS, are allocated (see SeriesArray). */
+const int MAXNUM = 100;
+
+/* One value for each of num terms of the Mie series.  Up to N are kept
+   on the stack, so the common short series allocate nothing. */
+template <typename T, int N = MAXNUM>
+class SeriesArray {
+public:
+    explicit SeriesArray(const int num) : stack_(), heap_(num > N ? num : 0) {}
+    operator T*() { return heap_.empty() ? stack_ : &heap_[0]; }
+
+private:
+    SeriesArray(const SeriesArray&);
+    SeriesArray& operator=(const SeriesArray&);
+
+    T stack_[N];
+    std::vector<T> heap_;
+};
+
+/* The small-particle series replaces the full Mie solver where its
+   relative error in the efficiencies is within SMALLX_TOLERANCE.  For a
+   homogeneous sphere the series of mie_rayleigh was found within
+   SMALLX_BOUND times the larger of (m x)^4 and c^2, where c = 0.6 x^2
+   |m^2 - 2| / |m^2 + 2| is its correction to the dipole, which grows
+   near the plasmon resonance, for m of 0.05 to 6 with absorption up to
+   10.  That is a radius of 1 to 3 nm in the visible for metals and
+   dielectrics alike.  A layered sphere instead keeps only the first
+   SMALLX_ORDERS orders of the full recurrences, when the series has
+   converged to the tolerance within them. */
+const double SMALLX_TOLERANCE = 1.0e-6;
+const double SMALLX_BOUND     = 4.0;
+const int    SMALLX_ORDERS    = 4;
+
+/* The number of equal shells a radial profile is first divided into, and
+   the most it may be divided into before giving up on convergence */
+const int PROFILE_SHELLS    = 16;
+const int PROFILE_MAXSHELLS = 2048;
+
+/* Supporting functions of the Mie theory solver, found in mie.cpp */
+int nm(const double x);
+
+void aa1 (const std::complex<double> rx, const int num, std::complex<double> ru[]);
+
+void aax (const double a, const int num, double ru[]);
+
+int abn1 (const int nlayers,
+          const std::complex<double> refrac_indx[],
+          const double rel_rad[],
+          const double size_param,
+          const int num,
+          std::complex<double> rd11[],
+          std::complex<double> rd3x[],
+          std::complex<double> rcx[],
+          double d1x[],
+          std::complex<double> ra[],
+          std::complex<double> rb[],
+          const double tolerance = 0.0
+        );
+
+void bcd (const std::complex<double> rx, const int num,
+          std::complex<double> rd1[], std::complex<double> rd3[],
+          std::complex<double> rcc[]);
+
+void shell_ratios (const std::complex<double> rx1,
+                   const std::complex<double> rx2, const int num,
+                   std::complex<double> rd1[], std::complex<double> rd3[],
+                   std::complex<double> sd1[], std::complex<double> sd3[],
+                   std::complex<double> rq[]);
+
+void cd3x (const double x, const int num, double d1x[],
+           std::complex<double> rd3x[], std::complex<double> rcx[]);
+
+void qq1 (const double a, const int num1, double *extinct, double *scat,
+          double *backscat, double *rad_pressure,
+          std::complex<double> ra[], std::complex<double> rb[]);
+
+#endif // MIE_H
@@ -1,9 +1,45 @@
 #ifndef SOLVERS_H
 #define SOLVERS_H
 
+#include "npspec/constants.h"
 #include <complex>
+#include <cstddef>
+#include <vector>
 
-/* Quasistatic approx */
+/* The geometry of a layered ellipsoid for the quasistatic approx.
+   It depends only on the shape, so is found once for all wavelengths. */
+struct QuasiGeometry {
+    QuasiGeometry() : nlayers(0), vol(), gf() {}
+    int nlayers;
+    std::vector<double> vol;   /* Volume inside each layer, relative to the whole */
+    std::vector<double> gf[2]; /* Geometrical factors of each layer, per axis */
+};
+
+void quasi_geometry (const int nlayers,
+                     const double rel_rad[][2],
+                     const double rad[],
+                     QuasiGeometry& geometry
+                   );
+
+/* Quasistatic approx for many wavelengths at once.  The real and
+   imaginary parts of the dielectric are separate arrays, each holding
+   every wavelength of the core, then of each shell in turn.  The
+   efficiencies for light polarized along the Z and XY axes are stored
+   as pairs for each wavelength if the arrays are not NULL. */
+void quasi_spectra (const QuasiGeometry& geometry,
+                    const int nlambda,
+                    const double dielec_re[],
+                    const double dielec_im[],
+                    const double mdie,
+                    const double size_param[],
+                    double extinct[],
+                    double scat[],
+                    double absorb[],
+                    double absorb_axes[],
+                    double scat_axes[]
+                  );
+
+/* Quasistatic approx for one wavelength */
 int quasi (const int nlayers,
            const std::complex<double> dielec[],
            const double mdie,
@@ -15,7 +51,24 @@ int quasi (const int nlayers,
            double *absorb
          );
 
-/* Mie theory */
+/* The estimated relative error of the quasistatic approx */
+double quasi_error (const int nlayers,
+                    const std::complex<double> dielec[],
+                    const double mdie,
+                    const double size_param
+                  );
+
+/* Which efficiencies the Mie solver calculates.  Anything not asked for
+   is returned as zero, and the sums for it are skipped entirely. */
+enum MieOutputs { MieExtinction        = 1,
+                  MieScattering        = 2,
+                  MieBackscattering    = 4,
+                  MieRadiationPressure = 8,
+                  MieAll               = 15
+                };
+
+/* Mie theory.  1 is returned if the sphere is too large for the series
+   and outside the bounds of geometric optics below. */
 int mie (const int nlayers,
          const std::complex<double> refrac_indx[],
          const double rel_rad[],
@@ -26,7 +79,176 @@ int mie (const int nlayers,
          double *backscat,
          double *rad_pressure,
          double *albedo,
-         double *asymmetry
+         double *asymmetry,
+         const int outputs = MieAll
         );
 
+/* True if the sphere is past GEOMETRIC_MINSIZE, where geometric optics
+   replaces the Mie series */
+bool mie_asymptotic (const double size_param);
+
+/* Geometric optics was checked against the exact series for spheres of
+   index 0.05 to 6 with absorption up to 10.  Its extinction, scattering
+   and absorption are within 5% of the extinction once the size parameter
+   is at least GEOMETRIC_MINSIZE and the phase shift 2x|m - 1| across the
+   sphere at least GEOMETRIC_MINPHASE.  Near m = 1 it misses the
+   anomalous diffraction, and for smaller spheres the ripple and the
+   surface waves. */
+const double GEOMETRIC_MINSIZE  = 300.0;
+const double GEOMETRIC_MINPHASE = 40.0;
+
+/* The efficiencies of a large sphere from geometric optics.  1 is
+   returned if the sphere is outside the bounds above. */
+int mie_geometric (const int nlayers,
+                    const std::complex<double> refrac_indx[],
+                    const double rel_rad[],
+                    const double size_param,
+                    const int outputs,
+                    double *extinct,
+                    double *scat,
+                    double *absorb,
+                    double *backscat,
+                    double *rad_pressure,
+                    double *albedo,
+                    double *asymmetry
+                  );
+
+/* The efficiencies of a small sphere from its electrostatic dipole */
+void mie_quasistatic (const int nlayers,
+                      const std::complex<double> refrac_indx[],
+                      const double rel_rad[],
+                      const double size_param,
+                      const int outputs,
+                      double *extinct,
+                      double *scat,
+                      double *absorb,
+                      double *backscat,
+                      double *rad_pressure,
+                      double *albedo,
+                      double *asymmetry
+                    );
+
+/* The Mie coefficients of a small sphere from their series in the size
+   parameter.  ra and rb must hold at least 3 terms. */
+void mie_rayleigh (const int nlayers,
+                   const std::complex<double> refrac_indx[],
+                   const double rel_rad[],
+                   const double size_param,
+                   std::complex<double> ra[],
+                   std::complex<double> rb[],
+                   int *nterms
+                 );
+
+/* The cheapest model of a sphere that is accurate to the tolerance */
+NPSpec::SolverModel mie_model (const int nlayers,
+                               const std::complex<double> refrac_indx[],
+                               const double rel_rad[],
+                               const double size_param,
+                               const double tolerance
+                             );
+
+/* The Mie coefficients a(n), b(n) of a layered sphere.  ra and rb must
+   hold nm(size_param) terms; the number calculated is returned in nterms.  With
+   a tolerance the series is cut where the relative error it leaves in
+   the extinction and scattering is within it.  Strongly absorbing
+   layers of any thickness are evaluated stably, through the ratios of
+   each shell. */
+void mie_coefficients (const int nlayers,
+                       const std::complex<double> refrac_indx[],
+                       const double rel_rad[],
+                       const double size_param,
+                       std::complex<double> ra[],
+                       std::complex<double> rb[],
+                       int *nterms,
+                       const double tolerance = 0.0
+                     );
+
+/* A refractive index that varies with the radius of a sphere.  It is
+   given the radius relative to the outer radius, and the data that was
+   passed along with it. */
+typedef std::complex<double> (*IndexProfile)(const double r, void *data);
+
+/* The Mie efficiencies of a sphere with a radial index profile, which is
+   divided into shells until the extinction and scattering change by less
+   than the tolerance.  The number of shells used is returned in nshells.
+   1 is returned if that did not converge. */
+int mie_profile (const IndexProfile profile,
+                 void *data,
+                 const double size_param,
+                 const double tolerance,
+                 const int outputs,
+                 double *extinct,
+                 double *scat,
+                 double *absorb,
+                 double *backscat,
+                 double *rad_pressure,
+                 double *albedo,
+                 double *asymmetry,
+                 int *nshells
+               );
+
+/* The Mie efficiencies from the coefficients */
+void mie_efficiencies (const int outputs,
+                       const double size_param,
+                       const int nterms,
+                       const std::complex<double> ra[],
+                       const std::complex<double> rb[],
+                       double *extinct,
+                       double *scat,
+                       double *absorb,
+                       double *backscat,
+                       double *rad_pressure,
+                       double *albedo,
+                       double *asymmetry
+                     );
+
+/* The extinction and scattering efficiency of each Mie multipole */
+void mie_multipoles (const double size_param,
+                     const int nterms,
+                     const std::complex<double> ra[],
+                     const std::complex<double> rb[],
+                     const int norders,
+                     double ext_electric[],
+                     double ext_magnetic[],
+                     double sca_electric[],
+                     double sca_magnetic[]
+                   );
+
+/* The surface-averaged near-field enhancement |E|^2/|E0|^2 */
+double mie_nearfield (const double size_param,
+                      const int nterms,
+                      const std::complex<double> ra[],
+                      const std::complex<double> rb[]
+                    );
+
+/* The Mie scattering amplitudes S1 and S2 at the angles whose cosines
+   are given in mu */
+void mie_angular (const int nterms,
+                  const std::complex<double> ra[],
+                  const std::complex<double> rb[],
+                  const int nangles,
+                  const double mu[],
+                  std::complex<double> s1[],
+                  std::complex<double> s2[]
+                );
+
+/* Limits of the T-matrix solver.  Terms are added TMATRIX_CHECKTERMS
+   at a time until two solutions agree to TMATRIX_TOLERANCE.
+   Solved T-matrices are cached up to TMATRIX_CACHE_BYTES in all. */
+const int    TMATRIX_MAXTERMS    = 60;
+const int    TMATRIX_CHECKTERMS  = 4;
+const double TMATRIX_TOLERANCE   = 1e-3;
+const size_t TMATRIX_CACHE_BYTES = 64 << 20;
+
+/* The orientation averaged efficiencies of a homogeneous spheroid by
+   the T-matrix method, for size parameters along its Z and XY axes.
+   They are relative to the sphere of the same volume.  1 is returned
+   if the T-matrix did not converge. */
+int tmatrix (const std::complex<double> refrac_indx,
+             const double size_param[2],
+             double *extinct,
+             double *scat,
+             double *absorb
+           );
+
 #endif // SOLVERS_H
@@ -1,13 +1,21 @@
-from npspec import Absorbance,    \
-                   Absorption,    \
-                   CrossSection,  \
-                   Efficiency,    \
-                   Ellipsoid,     \
-                   Extinction,    \
-                   MAXLAYERS,     \
-                   Molar,         \
-                   NLAMBDA,       \
-                   Nanoparticle,  \
-                   Scattering,    \
-                   Sphere,        \
+from npspec import Absorbance,        \
+                   Absorption,        \
+                   Albedo,            \
+                   Asymmetry,         \
+                   Backscattering,    \
+                   CrossSection,      \
+                   Cube,              \
+                   Efficiency,        \
+                   Ellipsoid,         \
+                   Extinction,        \
+                   MAXLAYERS,         \
+                   Molar,             \
+                   NLAMBDA,           \
+                   Nanoparticle,      \
+                   Prism,             \
+                   RadiationPressure, \
+                   Rod,               \
+                   Scattering,        \
+                   Sphere,            \
+                   Spheroid,          \
                    wavelengths
@@ -46,8 +46,9 @@ namespace NPSpec {
     %constant const int NLAMBDA = 800;
     %constant const int MAXLAYERS = 10;
     enum SpectraType { Efficiency, CrossSection, Molar, Absorption };
-    enum NanoparticleShape { Sphere, Ellipsoid };
-    enum SpectraProperty { Extinction, Absorbance, Scattering };
+    enum NanoparticleShape { Sphere, Ellipsoid, Spheroid, Cube, Rod, Prism };
+    enum SpectraProperty { Extinction, Absorbance, Scattering, Backscattering,
+                           RadiationPressure, Albedo, Asymmetry };
 }
 
 /* Make a function to output the wavelengths 
@@ -90,6 +90,7 @@ class Nanoparticle(object):
         except: self.this = this
     def calculateSpectrum(self): return _npspec.Nanoparticle_calculateSpectrum(self)
     def getSpectrum(self): return _npspec.Nanoparticle_getSpectrum(self)
+    def getPropertySpectrum(self, *args): return _npspec.Nanoparticle_getPropertySpectrum(self, *args)
     def getRGB(self): return _npspec.Nanoparticle_getRGB(self)
     def getHSV(self): return _npspec.Nanoparticle_getHSV(self)
     def getOpacity(self): return _npspec.Nanoparticle_getOpacity(self)
@@ -97,6 +98,7 @@ class Nanoparticle(object):
     def getShape(self): return _npspec.Nanoparticle_getShape(self)
     def getSpectraType(self): return _npspec.Nanoparticle_getSpectraType(self)
     def getSpectraProperty(self): return _npspec.Nanoparticle_getSpectraProperty(self)
+    def getExtraProperties(self): return _npspec.Nanoparticle_getExtraProperties(self)
     def getSphereRadius(self): return _npspec.Nanoparticle_getSphereRadius(self)
     def getEllipsoidZRadius(self): return _npspec.Nanoparticle_getEllipsoidZRadius(self)
     def getEllipsoidXYRadius(self): return _npspec.Nanoparticle_getEllipsoidXYRadius(self)
@@ -114,6 +116,7 @@ class Nanoparticle(object):
     def setShape(self, *args): return _npspec.Nanoparticle_setShape(self, *args)
     def setSpectraType(self, *args): return _npspec.Nanoparticle_setSpectraType(self, *args)
     def setSpectraProperty(self, *args): return _npspec.Nanoparticle_setSpectraProperty(self, *args)
+    def setExtraProperties(self, *args): return _npspec.Nanoparticle_setExtraProperties(self, *args)
     def setSphereRadius(self, *args): return _npspec.Nanoparticle_setSphereRadius(self, *args)
     def setEllipsoidRadius(self, *args): return _npspec.Nanoparticle_setEllipsoidRadius(self, *args)
     def setSphereLayerRelativeRadius(self, *args): return _npspec.Nanoparticle_setSphereLayerRelativeRadius(self, *args)
@@ -137,9 +140,17 @@ Molar = _npspec.Molar
 Absorption = _npspec.Absorption
 Sphere = _npspec.Sphere
 Ellipsoid = _npspec.Ellipsoid
+Spheroid = _npspec.Spheroid
+Cube = _npspec.Cube
+Rod = _npspec.Rod
+Prism = _npspec.Prism
 Extinction = _npspec.Extinction
 Absorbance = _npspec.Absorbance
 Scattering = _npspec.Scattering
+Backscattering = _npspec.Backscattering
+RadiationPressure = _npspec.RadiationPressure
+Albedo = _npspec.Albedo
+Asymmetry = _npspec.Asymmetry
 
 def _get_wavelengths():
   return _npspec._get_wavelengths()
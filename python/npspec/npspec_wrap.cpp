@@ -3585,6 +3585,62 @@ fail:
 }
 
 
+SWIGINTERN PyObject *_wrap_Nanoparticle_getPropertySpectrum(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
+  PyObject *resultobj = 0;
+  Nanoparticle *arg1 = (Nanoparticle *) 0 ;
+  NPSpec::SpectraProperty arg2 ;
+  double *arg3 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  int val2 ;
+  int ecode2 = 0 ;
+  PyObject *array3 = NULL ;
+  PyObject * obj0 = 0 ;
+  PyObject * obj1 = 0 ;
+  
+  {
+    npy_intp dims[1] = {
+      NPSpec::NLAMBDA 
+    };
+    array3 = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+    if (!array3) SWIG_fail;
+    arg3 = (double *) array_data(array3);
+  }
+  if(!PyArg_UnpackTuple(args,(char *)"Nanoparticle_getPropertySpectrum",2,2,&obj0,&obj1)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(obj0, &argp1,SWIGTYPE_p_Nanoparticle, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Nanoparticle_getPropertySpectrum" "', argument " "1"" of type '" "Nanoparticle const *""'"); 
+  }
+  arg1 = reinterpret_cast< Nanoparticle * >(argp1);
+  ecode2 = SWIG_AsVal_int(obj1, &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "Nanoparticle_getPropertySpectrum" "', argument " "2"" of type '" "NPSpec::SpectraProperty""'");
+  } 
+  arg2 = static_cast< NPSpec::SpectraProperty >(val2);
+  {
+    try {
+      ((Nanoparticle const *)arg1)->getPropertySpectrum(arg2,arg3);
+    } catch (std::out_of_range& e) {
+      PyErr_SetString(PyExc_IndexError, e.what());
+      return NULL;
+    } catch (std::domain_error& e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    } catch (std::invalid_argument& e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    }
+  }
+  resultobj = SWIG_Py_Void();
+  {
+    resultobj = SWIG_Python_AppendOutput(resultobj,array3);
+  }
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
 SWIGINTERN PyObject *_wrap_Nanoparticle_getRGB(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
   PyObject *resultobj = 0;
   Nanoparticle *arg1 = (Nanoparticle *) 0 ;
@@ -3888,6 +3944,41 @@ fail:
 }
 
 
+SWIGINTERN PyObject *_wrap_Nanoparticle_getExtraProperties(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
+  PyObject *resultobj = 0;
+  Nanoparticle *arg1 = (Nanoparticle *) 0 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  PyObject * obj0 = 0 ;
+  bool result;
+  
+  if(!PyArg_UnpackTuple(args,(char *)"Nanoparticle_getExtraProperties",1,1,&obj0)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(obj0, &argp1,SWIGTYPE_p_Nanoparticle, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Nanoparticle_getExtraProperties" "', argument " "1"" of type '" "Nanoparticle const *""'"); 
+  }
+  arg1 = reinterpret_cast< Nanoparticle * >(argp1);
+  {
+    try {
+      result = (bool)((Nanoparticle const *)arg1)->getExtraProperties();
+    } catch (std::out_of_range& e) {
+      PyErr_SetString(PyExc_IndexError, e.what());
+      return NULL;
+    } catch (std::domain_error& e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    } catch (std::invalid_argument& e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    }
+  }
+  resultobj = SWIG_From_bool(static_cast< bool >(result));
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
 SWIGINTERN PyObject *_wrap_Nanoparticle_getSphereRadius(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
   PyObject *resultobj = 0;
   Nanoparticle *arg1 = (Nanoparticle *) 0 ;
@@ -4560,6 +4651,49 @@ fail:
 }
 
 
+SWIGINTERN PyObject *_wrap_Nanoparticle_setExtraProperties(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
+  PyObject *resultobj = 0;
+  Nanoparticle *arg1 = (Nanoparticle *) 0 ;
+  bool arg2 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  bool val2 ;
+  int ecode2 = 0 ;
+  PyObject * obj0 = 0 ;
+  PyObject * obj1 = 0 ;
+  
+  if(!PyArg_UnpackTuple(args,(char *)"Nanoparticle_setExtraProperties",2,2,&obj0,&obj1)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(obj0, &argp1,SWIGTYPE_p_Nanoparticle, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Nanoparticle_setExtraProperties" "', argument " "1"" of type '" "Nanoparticle *""'"); 
+  }
+  arg1 = reinterpret_cast< Nanoparticle * >(argp1);
+  ecode2 = SWIG_AsVal_bool(obj1, &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "Nanoparticle_setExtraProperties" "', argument " "2"" of type '" "bool""'");
+  } 
+  arg2 = static_cast< bool >(val2);
+  {
+    try {
+      (arg1)->setExtraProperties(arg2);
+    } catch (std::out_of_range& e) {
+      PyErr_SetString(PyExc_IndexError, e.what());
+      return NULL;
+    } catch (std::domain_error& e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    } catch (std::invalid_argument& e) {
+      PyErr_SetString(PyExc_ValueError, e.what());
+      return NULL;
+    }
+  }
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
 SWIGINTERN PyObject *_wrap_Nanoparticle_setSphereRadius(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
   PyObject *resultobj = 0;
   Nanoparticle *arg1 = (Nanoparticle *) 0 ;
@@ -5120,6 +5254,7 @@ static PyMethodDef SwigMethods[] = {
 	 { (char *)"new_Nanoparticle", _wrap_new_Nanoparticle, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_calculateSpectrum", _wrap_Nanoparticle_calculateSpectrum, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getSpectrum", _wrap_Nanoparticle_getSpectrum, METH_VARARGS, NULL},
+	 { (char *)"Nanoparticle_getPropertySpectrum", _wrap_Nanoparticle_getPropertySpectrum, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getRGB", _wrap_Nanoparticle_getRGB, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getHSV", _wrap_Nanoparticle_getHSV, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getOpacity", _wrap_Nanoparticle_getOpacity, METH_VARARGS, NULL},
@@ -5127,6 +5262,7 @@ static PyMethodDef SwigMethods[] = {
 	 { (char *)"Nanoparticle_getShape", _wrap_Nanoparticle_getShape, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getSpectraType", _wrap_Nanoparticle_getSpectraType, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getSpectraProperty", _wrap_Nanoparticle_getSpectraProperty, METH_VARARGS, NULL},
+	 { (char *)"Nanoparticle_getExtraProperties", _wrap_Nanoparticle_getExtraProperties, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getSphereRadius", _wrap_Nanoparticle_getSphereRadius, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getEllipsoidZRadius", _wrap_Nanoparticle_getEllipsoidZRadius, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_getEllipsoidXYRadius", _wrap_Nanoparticle_getEllipsoidXYRadius, METH_VARARGS, NULL},
@@ -5144,6 +5280,7 @@ static PyMethodDef SwigMethods[] = {
 	 { (char *)"Nanoparticle_setShape", _wrap_Nanoparticle_setShape, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_setSpectraType", _wrap_Nanoparticle_setSpectraType, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_setSpectraProperty", _wrap_Nanoparticle_setSpectraProperty, METH_VARARGS, NULL},
+	 { (char *)"Nanoparticle_setExtraProperties", _wrap_Nanoparticle_setExtraProperties, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_setSphereRadius", _wrap_Nanoparticle_setSphereRadius, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_setEllipsoidRadius", _wrap_Nanoparticle_setEllipsoidRadius, METH_VARARGS, NULL},
 	 { (char *)"Nanoparticle_setSphereLayerRelativeRadius", _wrap_Nanoparticle_setSphereLayerRelativeRadius, METH_VARARGS, NULL},
@@ -5876,9 +6013,17 @@ SWIG_init(void) {
   SWIG_Python_SetConstant(d, "Absorption",SWIG_From_int(static_cast< int >(NPSpec::Absorption)));
   SWIG_Python_SetConstant(d, "Sphere",SWIG_From_int(static_cast< int >(NPSpec::Sphere)));
   SWIG_Python_SetConstant(d, "Ellipsoid",SWIG_From_int(static_cast< int >(NPSpec::Ellipsoid)));
+  SWIG_Python_SetConstant(d, "Spheroid",SWIG_From_int(static_cast< int >(NPSpec::Spheroid)));
+  SWIG_Python_SetConstant(d, "Cube",SWIG_From_int(static_cast< int >(NPSpec::Cube)));
+  SWIG_Python_SetConstant(d, "Rod",SWIG_From_int(static_cast< int >(NPSpec::Rod)));
+  SWIG_Python_SetConstant(d, "Prism",SWIG_From_int(static_cast< int >(NPSpec::Prism)));
   SWIG_Python_SetConstant(d, "Extinction",SWIG_From_int(static_cast< int >(NPSpec::Extinction)));
   SWIG_Python_SetConstant(d, "Absorbance",SWIG_From_int(static_cast< int >(NPSpec::Absorbance)));
   SWIG_Python_SetConstant(d, "Scattering",SWIG_From_int(static_cast< int >(NPSpec::Scattering)));
+  SWIG_Python_SetConstant(d, "Backscattering",SWIG_From_int(static_cast< int >(NPSpec::Backscattering)));
+  SWIG_Python_SetConstant(d, "RadiationPressure",SWIG_From_int(static_cast< int >(NPSpec::RadiationPressure)));
+  SWIG_Python_SetConstant(d, "Albedo",SWIG_From_int(static_cast< int >(NPSpec::Albedo)));
+  SWIG_Python_SetConstant(d, "Asymmetry",SWIG_From_int(static_cast< int >(NPSpec::Asymmetry)));
 #if PY_VERSION_HEX >= 0x03000000
   return m;
 #else
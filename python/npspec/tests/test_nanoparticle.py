@@ -199,7 +199,7 @@ def test_MediumRefractiveIndex():
     np.setMediumRefractiveIndex(2.0)
     np.calculateSpectrum()
     spec = np.getSpectrum()
-    assert_approx_equal(1.0698792522825473, spec[0])
+    assert_approx_equal(0.5179788913931199, spec[0])
 
 def test_Color():
     np = Nanoparticle()
@@ -0,0 +1,491 @@
+/* Microbenchmarks for the Mie, quasistatic, T-matrix, discrete dipole and
+ * cluster solvers, the color
+ * conversions, and end-to-end spectrum calculations.
+ *
+ * Run with --benchmark_out=<file> --benchmark_out_format=json to keep
+ * a JSON record that can be compared between versions. */
+
+#include "npspec/npspec.h"
+#include "npspec/nanoparticle.hpp"
+#include "npspec/private/solvers.hpp"
+#include "npspec/private/mie.hpp"
+#include "npspec/private/cluster.hpp"
+#include "npspec/private/dda.hpp"
+#include "benchmark/benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace NPSpec;
+
+const double pi = 4.0 * atan(1.0);
+
+/* A representative refractive index (Au at ~520 nm) and size parameter */
+const complex<double> refrac(0.47, 2.40);
+const double size_param = 2.0 * pi * 20.0 / 520.0;
+
+/* Materials the end-to-end benchmarks are run over */
+const char *materials[] = { "Ag", "Au", "Si" };
+
+/*******************
+ * Mie supporting functions
+ *******************/
+
+static void BM_aa1(benchmark::State& state) {
+    const int num = state.range(0);
+    complex<double> ru[MAXNUM];
+    for (auto _ : state) {
+        aa1(refrac * size_param, num, ru);
+        benchmark::DoNotOptimize(ru);
+    }
+    state.SetItemsProcessed(state.iterations() * num);
+}
+BENCHMARK(BM_aa1)->Arg(10)->Arg(25)->Arg(50)->Arg(MAXNUM);
+
+static void BM_bcd(benchmark::State& state) {
+    const int num = state.range(0);
+    complex<double> rd1[MAXNUM], rd3[MAXNUM], rcc[MAXNUM];
+    for (auto _ : state) {
+        bcd(refrac * size_param, num, rd1, rd3, rcc);
+        benchmark::DoNotOptimize(rcc);
+    }
+    state.SetItemsProcessed(state.iterations() * num);
+}
+BENCHMARK(BM_bcd)->Arg(10)->Arg(25)->Arg(50)->Arg(MAXNUM);
+
+static void BM_cd3x(benchmark::State& state) {
+    const int num = state.range(0);
+    double d1x[MAXNUM];
+    complex<double> rd3x[MAXNUM], rcx[MAXNUM];
+    aax(1.0 / size_param, num, d1x);
+    for (auto _ : state) {
+        cd3x(size_param, num, d1x, rd3x, rcx);
+        benchmark::DoNotOptimize(rcx);
+    }
+    state.SetItemsProcessed(state.iterations() * num);
+}
+BENCHMARK(BM_cd3x)->Arg(10)->Arg(25)->Arg(50)->Arg(MAXNUM);
+
+static void BM_abn1(benchmark::State& state) {
+    const int nlayers = state.range(0);
+    const int num = nm(size_param);
+
+    /* Build the inputs the same way mie() does, with equal-width layers */
+    vector< complex<double> > m(nlayers);
+    vector<double> rel_rad(nlayers, 1.0 / nlayers);
+    for (int i = 0; i < nlayers; ++i)
+        m[i] = i % 2 == 0 ? refrac : complex<double>(1.5, 0.0);
+    double d1x[MAXNUM];
+    complex<double> rd3x[MAXNUM], rcx[MAXNUM], rd11[MAXNUM];
+    aax(1.0 / size_param, num, d1x);
+    cd3x(size_param, num, d1x, rd3x, rcx);
+    aa1(m[0] * size_param / static_cast<double>(nlayers), num, rd11);
+
+    complex<double> ra[MAXNUM], rb[MAXNUM];
+    for (auto _ : state) {
+        int num1 = abn1(nlayers, &m[0], &rel_rad[0], size_param, num,
+                        rd11, rd3x, rcx, d1x, ra, rb);
+        benchmark::DoNotOptimize(num1);
+        benchmark::DoNotOptimize(ra);
+        benchmark::DoNotOptimize(rb);
+    }
+}
+BENCHMARK(BM_abn1)->DenseRange(1, MAXLAYERS)->Arg(100)->Arg(500);
+
+static void BM_qq1(benchmark::State& state) {
+    const int num = state.range(0);
+    complex<double> ra[MAXNUM], rb[MAXNUM];
+    for (int i = 0; i < num; ++i) {
+        ra[i] = complex<double>(1.0, 0.5) / pow(2.0, i);
+        rb[i] = complex<double>(0.5, 1.0) / pow(3.0, i);
+    }
+    double extinct, scat, backscat, rad_pressure;
+    for (auto _ : state) {
+        qq1(1.0 / size_param, num, &extinct, &scat, &backscat, &rad_pressure, ra, rb);
+        benchmark::DoNotOptimize(extinct);
+        benchmark::DoNotOptimize(scat);
+        benchmark::DoNotOptimize(backscat);
+        benchmark::DoNotOptimize(rad_pressure);
+    }
+    state.SetItemsProcessed(state.iterations() * num);
+}
+BENCHMARK(BM_qq1)->Arg(10)->Arg(25)->Arg(50)->Arg(MAXNUM);
+
+static void BM_mie(benchmark::State& state) {
+    const int nlayers = state.range(0);
+    vector< complex<double> > m(nlayers);
+    vector<double> rel_rad(nlayers);
+    for (int i = 0; i < nlayers; ++i) {
+        m[i] = i % 2 == 0 ? refrac : complex<double>(1.5, 0.0);
+        rel_rad[i] = 1.0 / nlayers;
+    }
+    double extinct, scat, absorb, backscat, rad_pressure, albedo, asymmetry;
+    for (auto _ : state) {
+        mie(nlayers, &m[0], &rel_rad[0], size_param, &extinct, &scat, &absorb,
+            &backscat, &rad_pressure, &albedo, &asymmetry);
+        benchmark::DoNotOptimize(extinct);
+    }
+}
+BENCHMARK(BM_mie)->DenseRange(1, MAXLAYERS)->Arg(100)->Arg(500);
+
+static void BM_mie_angular(benchmark::State& state) {
+    const int nangles = state.range(0);
+    const double rel_rad[1] = { 1.0 };
+    complex<double> ra[MAXNUM], rb[MAXNUM];
+    int nterms;
+    mie_coefficients(1, &refrac, rel_rad, size_param, ra, rb, &nterms);
+    vector<double> mu(nangles);
+    for (int k = 0; k < nangles; ++k)
+        mu[k] = cos(pi * k / max(nangles - 1, 1));
+    vector< complex<double> > s1(nangles), s2(nangles);
+    for (auto _ : state) {
+        mie_angular(nterms, ra, rb, nangles, &mu[0], &s1[0], &s2[0]);
+        benchmark::DoNotOptimize(&s1[0]);
+        benchmark::DoNotOptimize(&s2[0]);
+    }
+    state.SetItemsProcessed(state.iterations() * nangles);
+}
+BENCHMARK(BM_mie_angular)->Arg(1)->Arg(16)->Arg(181);
+
+/*******************
+ * Quasistatic solver
+ *******************/
+
+static void BM_quasi(benchmark::State& state) {
+    const int nlayers = state.range(0);
+    const double rad[2] = { 20.0, 10.0 };
+    const double rel_rad[3][2] = { { 0.6, 0.6 }, { 0.2, 0.2 }, { 0.2, 0.2 } };
+    const complex<double> dielec[3] = { complex<double>(-10.0, 1.2),
+                                        complex<double>(2.1, 0.0),
+                                        complex<double>(-4.0, 2.5) };
+    double extinct, scat, absorb;
+    for (auto _ : state) {
+        quasi(nlayers, dielec, 1.0, rel_rad, rad, size_param,
+              &extinct, &scat, &absorb);
+        benchmark::DoNotOptimize(extinct);
+    }
+}
+BENCHMARK(BM_quasi)->Arg(1)->Arg(2)->Arg(3);
+
+/* Every wavelength at once, with the geometry found once */
+static void BM_quasi_spectra(benchmark::State& state) {
+    const int nlayers = state.range(0);
+    const double rad[2] = { 20.0, 10.0 };
+    const double rel_rad[3][2] = { { 0.6, 0.6 }, { 0.2, 0.2 }, { 0.2, 0.2 } };
+    vector<double> dielec_re(nlayers * NLAMBDA), dielec_im(nlayers * NLAMBDA);
+    vector<double> x(NLAMBDA), extinct(NLAMBDA), scat(NLAMBDA), absorb(NLAMBDA);
+    for (int i = 0; i < NLAMBDA; ++i) {
+        x[i] = 2.0 * pi * 14.0 / ( 200.0 + i );
+        for (int j = 0; j < nlayers; ++j) {
+            dielec_re[j * NLAMBDA + i] = -10.0 + 0.01 * i + j;
+            dielec_im[j * NLAMBDA + i] = 1.2;
+        }
+    }
+    QuasiGeometry geometry;
+    quasi_geometry(nlayers, rel_rad, rad, geometry);
+    for (auto _ : state) {
+        quasi_spectra(geometry, NLAMBDA, &dielec_re[0], &dielec_im[0], 1.0,
+                      &x[0], &extinct[0], &scat[0], &absorb[0], NULL, NULL);
+        benchmark::DoNotOptimize(&extinct[0]);
+    }
+    state.SetItemsProcessed(state.iterations() * NLAMBDA);
+}
+BENCHMARK(BM_quasi_spectra)->Arg(1)->Arg(2)->Arg(3);
+
+/*******************
+ * T-matrix solver
+ *******************/
+
+/* One spheroid of the given aspect ratio with the volume of a 20 nm
+   sphere, solved from scratch or found in the cache */
+static void BM_tmatrix(benchmark::State& state) {
+    const double ratio = state.range(0);
+    const bool cached = state.range(1) != 0;
+    const double xxy = size_param / cbrt(ratio);
+    const double x[2] = { ratio * xxy, xxy };
+    double extinct, scat, absorb;
+    npspec_tmatrix_cache_clear();
+    for (auto _ : state) {
+        if (!cached)
+            npspec_tmatrix_cache_clear();
+        tmatrix(refrac, x, &extinct, &scat, &absorb);
+        benchmark::DoNotOptimize(extinct);
+    }
+    npspec_tmatrix_cache_clear();
+}
+BENCHMARK(BM_tmatrix)->ArgNames({ "ratio", "cached" })
+    ->ArgsProduct({ { 1, 2, 4 }, { 0, 1 } });
+
+/* The field of every dipole at every other in a cube of n^3 dipoles, the
+   product each iteration of the discrete dipole solver is spent on */
+static void BM_dipole_apply(benchmark::State& state) {
+    const int n = state.range(0);
+    DipoleSites sites;
+    sites.dims[0] = sites.dims[1] = sites.dims[2] = n;
+    for (int i = 0; i < n * n * n; ++i)
+        sites.sites.push_back(i);
+    DipoleLattice lattice(sites);
+    lattice.set_wavenumber(0.1);
+    vector< complex<double> > p(3 * lattice.nsites(), 1.0);
+    vector< complex<double> > e(3 * lattice.nsites());
+    for (auto _ : state) {
+        lattice.apply(&p[0], &e[0]);
+        benchmark::DoNotOptimize(e[0]);
+    }
+    state.counters["dipoles"] = lattice.nsites();
+}
+BENCHMARK(BM_dipole_apply)->Arg(8)->Arg(16)->Arg(32);
+
+/* One wavelength of a dielectric cube of the volume of a 20 nm sphere,
+   stepping back and forth by 1 nm so that each solve starts from the
+   dipoles of a neighbouring wavelength, as it does in a spectrum */
+static void BM_dda(benchmark::State& state) {
+    const int resolution = state.range(0);
+    const double edge = cbrt(pi / 6.0) * 20.0;
+    const double rad[2] = { edge, edge };
+    DDA dda(Cube, rad, resolution);
+    const complex<double> dielec(6.25, 0.1);
+    double extinct, scat, absorb;
+    int step = 0;
+    for (auto _ : state) {
+        const double lambda = step++ % 2 == 0 ? 520.0 : 521.0;
+        dda.solve(dielec, 2.0 * pi / lambda, &extinct, &scat, &absorb);
+        benchmark::DoNotOptimize(extinct);
+    }
+    state.counters["dipoles"] = dda.ndipoles();
+}
+BENCHMARK(BM_dda)->Arg(8)->Arg(16)->Arg(24)->Unit(benchmark::kMillisecond);
+
+/* One wavelength of a cube of n^3 gold spheres 20 nm across, either on a
+   lattice of 30 nm, or nudged off it so every pair is summed */
+static void BM_cluster(benchmark::State& state) {
+    const int n = state.range(0);
+    const bool lattice = state.range(1) != 0;
+    vector<double> xyz;
+    for (int i = 0; i < n * n * n; ++i) {
+        const double nudge = lattice ? 0.0 : 1e-3 * ( i % 7 );
+        xyz.push_back(30.0 * ( i % n ) + nudge);
+        xyz.push_back(30.0 * ( ( i / n ) % n ));
+        xyz.push_back(30.0 * ( i / ( n * n ) ));
+    }
+    Cluster cluster(n * n * n, reinterpret_cast<const double(*)[3]>(&xyz[0]));
+    /* a(1) of the spheres at 520 nm */
+    const complex<double> a1 = complex<double>(6.3e-4, -1.9e-3);
+    double extinct, scat, absorb;
+    int step = 0;
+    for (auto _ : state) {
+        const double lambda = step++ % 2 == 0 ? 520.0 : 521.0;
+        cluster.solve(a1, 2.0 * pi / lambda, &extinct, &scat, &absorb);
+        benchmark::DoNotOptimize(extinct);
+    }
+    state.counters["spheres"] = cluster.nparticles();
+}
+BENCHMARK(BM_cluster)->ArgNames({ "n", "lattice" })
+    ->Args({ 4, 0 })->Args({ 8, 0 })->Args({ 4, 1 })->Args({ 8, 1 })
+    ->Args({ 16, 1 })->Unit(benchmark::kMillisecond);
+
+/* A random aggregate of n gold spheres 20 nm across, each touching one
+   placed before it, as a colloid grows.  These never lie on a lattice,
+   so show how the pair summation scales with n, with the pairs cached
+   up to CLUSTER_MAXPAIRS and found again every iteration beyond */
+static void BM_cluster_aggregate(benchmark::State& state) {
+    const int n = state.range(0);
+    mt19937 rng(12345);
+    uniform_real_distribution<double> uniform(-1.0, 1.0);
+    uniform_int_distribution<int> pick;
+    vector<double> xyz(3, 0.0);
+    while (static_cast<int>(xyz.size()) < 3 * n) {
+        const int j = pick(rng) % ( xyz.size() / 3 );
+        double d[3], r2;
+        do {
+            for (int c = 0; c < 3; ++c)
+                d[c] = uniform(rng);
+            r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        } while (r2 > 1.0 || r2 < 1e-6);
+        double x[3];
+        for (int c = 0; c < 3; ++c)
+            x[c] = xyz[3*j+c] + 20.0 * d[c] / sqrt(r2);
+        bool clear = true;
+        for (size_t i = 0; clear && i < xyz.size(); i += 3) {
+            const double dx = x[0] - xyz[i], dy = x[1] - xyz[i+1],
+                         dz = x[2] - xyz[i+2];
+            clear = dx * dx + dy * dy + dz * dz >= 400.0 * ( 1.0 - 1e-9 );
+        }
+        if (clear)
+            xyz.insert(xyz.end(), x, x + 3);
+    }
+    Cluster cluster(n, reinterpret_cast<const double(*)[3]>(&xyz[0]));
+    /* a(1) of the spheres at 520 nm */
+    const complex<double> a1 = complex<double>(6.3e-4, -1.9e-3);
+    double extinct, scat, absorb;
+    int step = 0;
+    for (auto _ : state) {
+        const double lambda = step++ % 2 == 0 ? 520.0 : 521.0;
+        cluster.solve(a1, 2.0 * pi / lambda, &extinct, &scat, &absorb);
+        benchmark::DoNotOptimize(extinct);
+    }
+    state.counters["spheres"] = cluster.nparticles();
+    state.SetComplexityN(n);
+}
+BENCHMARK(BM_cluster_aggregate)->ArgName("n")->RangeMultiplier(2)
+    ->Range(64, 2048)->Complexity(benchmark::oNSquared)
+    ->Unit(benchmark::kMillisecond);
+
+/*******************
+ * Color conversions
+ *******************/
+
+static void BM_RGB(benchmark::State& state) {
+    const int inc = state.range(0);
+    double spec[NLAMBDA];
+    for (int i = 0; i < NLAMBDA; ++i)
+        spec[i] = exp(-pow((wavelengths[i] - 520.0) / 40.0, 2));
+    double r, g, b;
+    for (auto _ : state) {
+        RGB(spec, inc, false, &r, &g, &b);
+        benchmark::DoNotOptimize(r);
+        benchmark::DoNotOptimize(g);
+        benchmark::DoNotOptimize(b);
+    }
+}
+BENCHMARK(BM_RGB)->Arg(1)->Arg(10);
+
+static void BM_RGB_to_HSV(benchmark::State& state) {
+    double r = 0.12381521, g = 0.10589667, b = 0.48082513;
+    double h, s, v;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(r);
+        RGB_to_HSV(r, g, b, &h, &s, &v);
+        benchmark::DoNotOptimize(h);
+        benchmark::DoNotOptimize(s);
+        benchmark::DoNotOptimize(v);
+    }
+}
+BENCHMARK(BM_RGB_to_HSV);
+
+/*************************************************************
+ * End-to-end.  Arguments are layers, radius (nm), material and
+ * increment.  Layers alternate between the material and quartz.
+ *************************************************************/
+
+static void EndToEndArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "layers", "radius", "material", "increment" });
+    b->ArgsProduct({ { 1, 2, 3, 5, 10 },
+                     { 1, 10, 50, 100, 200 },
+                     { 0, 1, 2 },
+                     { 1, 10 } });
+}
+
+static void BM_npspec(benchmark::State& state) {
+    const int nlayers = state.range(0);
+    const double radius[2] = { static_cast<double>(state.range(1)), -1.0 };
+    const int mat = material_index(materials[state.range(2)]);
+    const int quartz = material_index("Quartz");
+    const int inc = state.range(3);
+    double rel_rad[MAXLAYERS][2];
+    int indx[MAXLAYERS];
+    for (int i = 0; i < nlayers; ++i) {
+        rel_rad[i][0] = rel_rad[i][1] = 1.0 / nlayers;
+        indx[i] = i % 2 == 0 ? mat : quartz;
+    }
+    double qext[NLAMBDA], qscat[NLAMBDA], qabs[NLAMBDA];
+    for (auto _ : state) {
+        ErrorCode result = npspec(nlayers, radius, rel_rad, indx, 1.0, true,
+                                  inc, 1.0, 1.0, Efficiency, qext, qscat, qabs);
+        benchmark::DoNotOptimize(result);
+        benchmark::DoNotOptimize(qabs);
+    }
+    state.SetItemsProcessed(state.iterations() * ( NLAMBDA / inc ));
+}
+BENCHMARK(BM_npspec)->Apply(EndToEndArgs);
+
+/* Automatic model selection for small spheres.  Arguments are the
+   radius (nm), material and the tolerance as a negative power of 10
+   (0 for the full solver everywhere). */
+static void BM_npspec_auto(benchmark::State& state) {
+    const double radius[2] = { static_cast<double>(state.range(0)), -1.0 };
+    const int indx[1] = { material_index(materials[state.range(1)]) };
+    const double rel_rad[1][2] = { { 1.0, 1.0 } };
+    const double tol = state.range(2) > 0 ? pow(10.0, -state.range(2)) : 0.0;
+    double qext[NLAMBDA], qscat[NLAMBDA], qabs[NLAMBDA];
+    int model[NLAMBDA];
+    for (auto _ : state) {
+        ErrorCode result = npspec_auto(1, radius, rel_rad, indx, 1.0, true, 1,
+                                       1.0, 1.0, Efficiency, tol,
+                                       qext, qscat, qabs, model, NULL);
+        benchmark::DoNotOptimize(result);
+        benchmark::DoNotOptimize(qabs);
+    }
+    state.SetItemsProcessed(state.iterations() * NLAMBDA);
+}
+BENCHMARK(BM_npspec_auto)->ArgNames({ "radius", "material", "tolerance" })
+                         ->ArgsProduct({ { 2, 5 }, { 0, 1, 2 }, { 0, 2, 4 } });
+
+/* A 50 nm sphere whose index is graded linearly from core to surface */
+static void graded_profile(const double r, const double wavelength, void *,
+                           double *n, double *k) {
+    *n = 1.4 + 1.2 * r / 50.0;
+    *k = 0.05 + 0.3 * r / 50.0 * 500.0 / wavelength;
+}
+
+/* npspec_profile with the tolerance as a negative power of 10, or with
+   0, the same sphere as 1000 equal layers given to mie() */
+static void BM_npspec_profile(benchmark::State& state) {
+    const int inc = 10;
+    double qext[NLAMBDA], qscat[NLAMBDA], qabs[NLAMBDA];
+    if (state.range(0) > 0) {
+        const double tol = pow(10.0, -state.range(0));
+        for (auto _ : state) {
+            ErrorCode result = npspec_profile(50.0, graded_profile, NULL, 1.0,
+                                              inc, 1.0, 1.0, Efficiency, tol,
+                                              qext, qscat, qabs, NULL);
+            benchmark::DoNotOptimize(result);
+            benchmark::DoNotOptimize(qabs);
+        }
+    } else {
+        const int nlayers = 1000;
+        vector< complex<double> > m(nlayers);
+        vector<double> rel_rad(nlayers, 1.0 / nlayers);
+        for (auto _ : state) {
+            for (int i = 0; i < NLAMBDA; i += inc) {
+                for (int j = 0; j < nlayers; ++j) {
+                    double n, k;
+                    graded_profile(50.0 * ( j + 0.5 ) / nlayers, wavelengths[i],
+                                   NULL, &n, &k);
+                    m[j] = complex<double>(n, k);
+                }
+                double bak, pre, alb, asy;
+                mie(nlayers, &m[0], &rel_rad[0], 2.0 * pi * 50.0 / wavelengths[i],
+                    &qext[i], &qscat[i], &qabs[i], &bak, &pre, &alb, &asy,
+                    MieExtinction | MieScattering);
+            }
+            benchmark::DoNotOptimize(qabs);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * ( NLAMBDA / inc ));
+}
+BENCHMARK(BM_npspec_profile)->ArgName("tolerance")->Arg(0)->Arg(2)->Arg(3)->Arg(4);
+
+static void BM_calculateSpectrum(benchmark::State& state) {
+    const int nlayers = state.range(0);
+    Nanoparticle np;
+    np.setNLayers(nlayers);
+    for (int i = 1; i <= nlayers; ++i) {
+        np.setSphereLayerRelativeRadius(i, 1.0 / nlayers);
+        np.setLayerMaterial(i, i % 2 == 1 ? materials[state.range(2)] : "Quartz");
+    }
+    np.setSphereRadius(static_cast<double>(state.range(1)));
+    np.setIncrement(state.range(3));
+    np.setSizeCorrect(true);
+    for (auto _ : state) {
+        int result = np.calculateSpectrum();
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * ( NLAMBDA / state.range(3) ));
+}
+BENCHMARK(BM_calculateSpectrum)->Apply(EndToEndArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,337 @@
+/* Thread-scaling throughput harness.
+ *
+ * Runs a fixed, mixed workload of small Ag spheres, 10-layer spheres and
+ * two-layer ellipsoids (which go through the quasistatic solver) at
+ * increasing thread counts.  For each thread count the throughput in
+ * spectra per second, the p50 and p99 latency of a single spectrum, and
+ * the scaling efficiency relative to one thread are reported.
+ *
+ * Two figures show where the scaling is limited by the machine rather
+ * than the solvers.  The peak stack a spectrum uses, found by painting
+ * the stack of each thread, is the per-thread working set that has to
+ * stay in cache.  The STREAM triad bandwidth with the same number of
+ * threads shows when the memory bus saturates; if the efficiency falls
+ * off at the same thread count as the triad bandwidth stops growing, the
+ * workload is bandwidth bound.
+ *
+ * Usage: throughput [max_threads [particles_per_workload [repeats]]]
+ *
+ * max_threads defaults to the number of hardware threads.  Thread counts
+ * are doubled from 1 up to max_threads (max_threads itself is always run). */
+
+#include "npspec/npspec.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace NPSpec;
+
+typedef chrono::steady_clock Clock;
+
+#if defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+/* Bytes of stack painted below each worker, which is well inside the
+ * default thread stack on every platform */
+const size_t STACK_PROBE = 256 * 1024;
+const unsigned char STACK_PAINT = 0xa5;
+
+/* Doubles in each STREAM triad array (32 MB, far beyond any cache), and
+ * the number of passes of which the fastest is kept */
+const size_t TRIAD_SIZE = 1 << 22;
+const int TRIAD_PASSES = 5;
+
+/* One kind of particle in the mixed workload.  Each workload is a batch
+ * of particles sharing a layer count, stored exactly as npspec_batch
+ * expects them. */
+struct Workload {
+    string name;
+    int nlayers;
+    int nparticles;
+    vector<double> rad;     /* nparticles x 2 */
+    vector<double> rel_rad; /* nparticles x nlayers x 2 */
+    vector<int> indx;       /* nparticles x nlayers */
+};
+
+/* A single spectrum to compute: which workload and which particle in it */
+struct Task {
+    int workload;
+    int particle;
+};
+
+static Workload small_spheres(const int n) {
+    Workload w;
+    w.name = "Ag sphere";
+    w.nlayers = 1;
+    w.nparticles = n;
+    const int ag = material_index("Ag");
+    for (int p = 0; p < n; ++p) {
+        /* Radii between 5 and 25 nm */
+        w.rad.push_back(5.0 + 20.0 * p / n);
+        w.rad.push_back(-1.0);
+        w.rel_rad.push_back(1.0);
+        w.rel_rad.push_back(1.0);
+        w.indx.push_back(ag);
+    }
+    return w;
+}
+
+static Workload layered_spheres(const int n) {
+    Workload w;
+    w.name = "10-layer sphere";
+    w.nlayers = 10;
+    w.nparticles = n;
+    const int au = material_index("Au");
+    const int quartz = material_index("Quartz");
+    for (int p = 0; p < n; ++p) {
+        /* Radii between 20 and 100 nm */
+        w.rad.push_back(20.0 + 80.0 * p / n);
+        w.rad.push_back(-1.0);
+        for (int l = 0; l < w.nlayers; ++l) {
+            w.rel_rad.push_back(0.1);
+            w.rel_rad.push_back(0.1);
+            w.indx.push_back(l % 2 == 0 ? au : quartz);
+        }
+    }
+    return w;
+}
+
+static Workload ellipsoids(const int n) {
+    Workload w;
+    w.name = "ellipsoid";
+    w.nlayers = 2;
+    w.nparticles = n;
+    const int au = material_index("Au");
+    const int quartz = material_index("Quartz");
+    for (int p = 0; p < n; ++p) {
+        /* Aspect ratios between 1.5 and 4 */
+        const double rxy = 10.0;
+        w.rad.push_back(rxy * ( 1.5 + 2.5 * p / n ));
+        w.rad.push_back(rxy);
+        w.rel_rad.push_back(0.8);
+        w.rel_rad.push_back(0.8);
+        w.rel_rad.push_back(0.2);
+        w.rel_rad.push_back(0.2);
+        w.indx.push_back(au);
+        w.indx.push_back(quartz);
+    }
+    return w;
+}
+
+/* Compute one spectrum and return how long it took in microseconds */
+static double run_task(const Workload& w, const int p,
+                       double ext[], double scat[], double absorb[]) {
+    const double *rad = &w.rad[2 * p];
+    const double (*rel_rad)[2] =
+        reinterpret_cast<const double (*)[2]>(&w.rel_rad[2 * w.nlayers * p]);
+    const int *indx = &w.indx[w.nlayers * p];
+    const Clock::time_point start = Clock::now();
+    npspec(w.nlayers, rad, rel_rad, indx, 1.0, true, 1, 1.0, 1.0e-6,
+           Efficiency, ext, scat, absorb);
+    const Clock::time_point stop = Clock::now();
+    return chrono::duration<double, micro>(stop - start).count();
+}
+
+/* Fill STACK_PROBE bytes below the caller's frame with STACK_PAINT and
+ * return the address of the lowest.  It must not be inlined, so that its
+ * frame lies below the caller's as the frames of later calls will.  The
+ * address is returned as an integer since the frame is gone by the time
+ * it is used. */
+static NOINLINE uintptr_t paint_stack() {
+    volatile unsigned char buf[STACK_PROBE];
+    for (size_t i = 0; i < STACK_PROBE; ++i)
+        buf[i] = STACK_PAINT;
+    return reinterpret_cast<uintptr_t>(buf);
+}
+
+/* Bytes of the painted range that calls made since have overwritten.
+ * The stack grows down, so this is the distance from the top to the
+ * deepest byte that no longer holds the paint. */
+static size_t stack_used(const uintptr_t painted) {
+    const volatile unsigned char *p =
+        reinterpret_cast<const volatile unsigned char *>(painted);
+    size_t clean = 0;
+    while (clean < STACK_PROBE && p[clean] == STACK_PAINT)
+        ++clean;
+    return STACK_PROBE - clean;
+}
+
+/* The STREAM triad a = b + s*c split over nthreads threads, in GB/s.
+ * Two arrays are read and one written for each element. */
+static double triad_bandwidth(vector<double>& a, const vector<double>& b,
+                              const vector<double>& c, const int nthreads) {
+    double best = 0.0;
+    for (int pass = 0; pass < TRIAD_PASSES; ++pass) {
+        const Clock::time_point start = Clock::now();
+        vector<thread> pool;
+        for (int t = 0; t < nthreads; ++t) {
+            pool.push_back(thread([&, t]() {
+                const size_t lo = a.size() * t / nthreads;
+                const size_t hi = a.size() * ( t + 1 ) / nthreads;
+                for (size_t i = lo; i < hi; ++i)
+                    a[i] = b[i] + 3.0 * c[i];
+            }));
+        }
+        for (size_t t = 0; t < pool.size(); ++t)
+            pool[t].join();
+        const double dt = chrono::duration<double>(Clock::now() - start).count();
+        best = max(best, 3.0 * sizeof(double) * a.size() / dt * 1.0e-9);
+    }
+    return best;
+}
+
+/* Percentile of an already sorted set of latencies */
+static double percentile(const vector<double>& sorted, const double pct) {
+    if (sorted.empty())
+        return 0.0;
+    size_t i = static_cast<size_t>(pct / 100.0 * ( sorted.size() - 1 ) + 0.5);
+    return sorted[min(i, sorted.size() - 1)];
+}
+
+struct Result {
+    double seconds;
+    long spectra;
+    size_t stack;                    /* peak bytes of any thread */
+    vector<vector<double> > latency; /* per workload, sorted */
+};
+
+/* Run every task once using nthreads threads.  Tasks are handed out
+ * dynamically so that the expensive 10-layer spheres do not leave the
+ * other threads idle. */
+static Result run(const vector<Workload>& workloads,
+                  const vector<Task>& tasks,
+                  const int nthreads,
+                  const int repeats) {
+    const long ntasks = static_cast<long>(tasks.size()) * repeats;
+    atomic<long> next(0);
+    vector<vector<vector<double> > > lat(nthreads,
+        vector<vector<double> >(workloads.size()));
+    vector<size_t> stack(nthreads);
+
+    const Clock::time_point start = Clock::now();
+    vector<thread> pool;
+    for (int t = 0; t < nthreads; ++t) {
+        pool.push_back(thread([&, t]() {
+            vector<double> ext(NLAMBDA), scat(NLAMBDA), absorb(NLAMBDA);
+            const uintptr_t painted = paint_stack();
+            for (long i = next++; i < ntasks; i = next++) {
+                const Task& task = tasks[i % tasks.size()];
+                lat[t][task.workload].push_back(
+                    run_task(workloads[task.workload], task.particle,
+                             &ext[0], &scat[0], &absorb[0]));
+            }
+            stack[t] = stack_used(painted);
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+    const Clock::time_point stop = Clock::now();
+
+    Result r;
+    r.seconds = chrono::duration<double>(stop - start).count();
+    r.spectra = ntasks;
+    r.stack = *max_element(stack.begin(), stack.end());
+    r.latency.resize(workloads.size() + 1);
+    for (int t = 0; t < nthreads; ++t) {
+        for (size_t w = 0; w < workloads.size(); ++w) {
+            r.latency[w].insert(r.latency[w].end(),
+                                lat[t][w].begin(), lat[t][w].end());
+            r.latency.back().insert(r.latency.back().end(),
+                                    lat[t][w].begin(), lat[t][w].end());
+        }
+    }
+    for (size_t w = 0; w < r.latency.size(); ++w)
+        sort(r.latency[w].begin(), r.latency[w].end());
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+
+    int max_threads = thread::hardware_concurrency();
+    if (max_threads < 1)
+        max_threads = 1;
+    int nper = 64;
+    int repeats = 1;
+    if (argc > 1) max_threads = max(1, atoi(argv[1]));
+    if (argc > 2) nper = max(1, atoi(argv[2]));
+    if (argc > 3) repeats = max(1, atoi(argv[3]));
+
+    vector<Workload> workloads;
+    workloads.push_back(small_spheres(nper));
+    workloads.push_back(layered_spheres(nper));
+    workloads.push_back(ellipsoids(nper));
+
+    /* Interleave the workloads so each thread sees the same mix */
+    vector<Task> tasks;
+    for (int p = 0; p < nper; ++p) {
+        for (size_t w = 0; w < workloads.size(); ++w) {
+            Task t = { static_cast<int>(w), p };
+            tasks.push_back(t);
+        }
+    }
+
+    /* Sanity check the workload (and warm the caches) with the batch API */
+    for (size_t w = 0; w < workloads.size(); ++w) {
+        const Workload& wl = workloads[w];
+        vector<double> ext(NLAMBDA * wl.nparticles),
+                       scat(NLAMBDA * wl.nparticles),
+                       absorb(NLAMBDA * wl.nparticles);
+        const ErrorCode rc = npspec_batch(wl.nparticles, wl.nlayers,
+            reinterpret_cast<const double (*)[2]>(&wl.rad[0]),
+            reinterpret_cast<const double (*)[2]>(&wl.rel_rad[0]),
+            &wl.indx[0], 1.0, true, 1, 1.0, 1.0e-6, Efficiency,
+            &ext[0], &scat[0], &absorb[0], NULL);
+        if (rc != NoError && rc != SizeWarning) {
+            fprintf(stderr, "Workload '%s' failed with error %d\n",
+                    wl.name.c_str(), static_cast<int>(rc));
+            return 1;
+        }
+    }
+
+    vector<int> counts;
+    for (int n = 1; n < max_threads; n *= 2)
+        counts.push_back(n);
+    counts.push_back(max_threads);
+
+    printf("%d spectra per pass (%d of each workload), %d pass(es)\n\n",
+           static_cast<int>(tasks.size()), nper, repeats);
+    printf("%7s  %-16s %10s %12s %12s %12s %10s %12s %12s\n", "threads",
+           "workload", "seconds", "spectra/s", "p50 (us)", "p99 (us)",
+           "efficiency", "stack (KiB)", "triad GB/s");
+
+    vector<double> a(TRIAD_SIZE, 0.0), b(TRIAD_SIZE, 1.0), c(TRIAD_SIZE, 2.0);
+    double base = 0.0;
+    for (size_t n = 0; n < counts.size(); ++n) {
+        const Result r = run(workloads, tasks, counts[n], repeats);
+        const double rate = r.spectra / r.seconds;
+        if (n == 0)
+            base = rate;
+        for (size_t w = 0; w < workloads.size(); ++w)
+            printf("%7d  %-16s %10s %12s %12.1f %12.1f %10s %12s %12s\n",
+                   counts[n], workloads[w].name.c_str(), "", "",
+                   percentile(r.latency[w], 50.0),
+                   percentile(r.latency[w], 99.0), "", "", "");
+        char stack[32];
+        snprintf(stack, sizeof(stack), "%s%.1f",
+                 r.stack >= STACK_PROBE ? ">" : "", r.stack / 1024.0);
+        printf("%7d  %-16s %10.3f %12.1f %12.1f %12.1f %9.1f%% %12s %12.2f\n",
+               counts[n], "mixed", r.seconds, rate,
+               percentile(r.latency.back(), 50.0),
+               percentile(r.latency.back(), 99.0),
+               100.0 * rate / ( base * counts[n] ), stack,
+               triad_bandwidth(a, b, c, counts[n]));
+    }
+
+    return 0;
+}
@@ -1,17 +1,15 @@
 #include "npspec/npspec.h"
 #include "npspec/private/standard_color_matching.hpp"
+#include "npspec/private/instrument.hpp"
 #include <cmath>
 #include <algorithm>
 #include <numeric>
 using namespace NPSpec;
 
-/* Static variables that need to be calculated only once */
-static bool first = true;
-static double XARRAY[NLAMBDA], YARRAY[NLAMBDA], ZARRAY[NLAMBDA];
-
 /* Convert a spectrum to RGB color space.  Note that RGV is on [0,1], but
  * the conversion may result in values <0 or >1, which means that not
- * all possible colors can be represented by RGB */
+ * all possible colors can be represented by RGB.  No state is kept
+ * between calls so that this may be called from multiple threads. */
 void RGB(const double spec_in[], 
          const int inc, 
          const bool trans, 
@@ -19,15 +17,8 @@ void RGB(const double spec_in[],
          double *g,
          double *b) {
 
-    /* These produts are the same each time.  Only calculate the first time */
-    if (first) {
-        for (int i = 0; i < NLAMBDA; ++i) {
-            XARRAY[i] = CIE_X[i] * CIE_D65[i];
-            YARRAY[i] = CIE_Y[i] * CIE_D65[i];
-            ZARRAY[i] = CIE_Z[i] * CIE_D65[i];
-        }
-        first = false;
-    }
+    NPSPEC_COUNT(ColorCalls);
+    NPSPEC_TIME(PhaseColor);
 
     /* First, normalize the spectra.  How this is done is based on the type.
      * Also extract the numbers from the CIE arrays that are needed. */
@@ -48,9 +39,9 @@ void RGB(const double spec_in[],
     int j = 0;
     for (int i = 0; i < NLAMBDA; i += inc) {
         spec[j] = trans ? std::pow(10, -spec_in[i]) : spec_in[i] * invmax;
-        XARR[j] = XARRAY[i];
-        YARR[j] = YARRAY[i];
-        ZARR[j] = ZARRAY[i];
+        XARR[j] = CIE_X[i] * CIE_D65[i];
+        YARR[j] = CIE_Y[i] * CIE_D65[i];
+        ZARR[j] = CIE_Z[i] * CIE_D65[i];
         j++;
     }
 
@@ -110,6 +101,9 @@ void RGB_to_HSV(const double r,
                 double *s,
                 double *v) {
 
+    NPSPEC_COUNT(ColorCalls);
+    NPSPEC_TIME(PhaseColor);
+
     double min = std::min(std::min(r, g), b);
     double max = std::max(std::max(r, g), b);
     double delta = max - min;
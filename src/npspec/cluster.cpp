@@ -0,0 +1,327 @@
+/*******************************************************************
+ * **********   cluster - Arrays and aggregates of spheres
+ *                    Theory:   coupled electric dipoles
+ *                    Results:  cross sections of the whole cluster
+ * Each sphere of the cluster is a point dipole at its center, polarized
+ * by the incident field and the fields of all the others.  Its
+ * polarizability is that of its electric dipole in Mie theory,
+ * alpha = 3i a(1) / 2k^3, which includes the radiative reaction and is
+ * exact for an isolated sphere of any size.  The coupled dipoles are
+ * solved by the same iterative solver as the DDA.
+ *
+ * When every sphere lies on a common cubic lattice, as for dimers,
+ * chains and periodic arrays, the interaction is a convolution over the
+ * lattice done by FFT, so the cost grows as N log N.  Any other cluster
+ * is summed over every pair, which grows as N^2; no tree or multipole
+ * approximation of the far pairs is made (see BM_cluster_aggregate for
+ * how this scales).
+ *
+ * Only the electric dipoles are coupled.  The magnetic dipole and the
+ * higher multipoles of each sphere are added to the spectrum as if the
+ * spheres were isolated (see npspec_cluster), which is good while the
+ * spheres are small beside the wavelength and not touching.
+ *******************************************************************/
+
+#include "npspec/private/cluster.hpp"
+#include "npspec/private/instrument.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+const double pi = 4.0 * atan(1.0);
+const complex<double> I(0.0, 1.0);
+
+inline double sqr(double x) { return x*x; }
+
+DipolePairs::DipolePairs(const vector<double>& positions)
+    : positions_(positions),
+      kd_(-1.0),
+      tensors_()
+{
+}
+
+/* The field at site i of a unit dipole at site j, as for the lattice */
+void DipolePairs::tensor(const int i, const int j, complex<double> t[6]) const {
+    const double *x = &positions_[0];
+    const double d[3] = { x[3*j] - x[3*i], x[3*j+1] - x[3*i+1],
+                          x[3*j+2] - x[3*i+2] };
+    const double r2 = sqr(d[0]) + sqr(d[1]) + sqr(d[2]);
+    const double r = sqrt(r2);
+    const double kr = kd_ * r;
+    const complex<double> g = polar(1.0 / ( r * r2 ), kr);
+    const complex<double> a = mul(g, complex<double>(kr*kr - 1.0, kr));
+    const complex<double> b = mul(g, complex<double>(kr*kr - 3.0, 3.0*kr)) / r2;
+    t[0] = a - b * ( d[0] * d[0] );
+    t[1] =   - b * ( d[0] * d[1] );
+    t[2] =   - b * ( d[0] * d[2] );
+    t[3] = a - b * ( d[1] * d[1] );
+    t[4] =   - b * ( d[1] * d[2] );
+    t[5] = a - b * ( d[2] * d[2] );
+}
+
+void DipolePairs::set_wavenumber(const double kd) {
+
+    if (kd == kd_)
+        return;
+    kd_ = kd;
+
+    const long n = nsites();
+    const long npairs = n * ( n - 1 ) / 2;
+    if (npairs > CLUSTER_MAXPAIRS) {
+        tensors_.clear();
+        return;
+    }
+    tensors_.resize(6 * npairs);
+    complex<double> *t = tensors_.empty() ? NULL : &tensors_[0];
+    for (int i = 0; i < n; ++i)
+        for (int j = i + 1; j < n; ++j, t += 6)
+            tensor(i, j, t);
+
+}
+
+void DipolePairs::apply(const complex<double> dipoles[],
+                        complex<double> field[]) {
+
+    const int n = nsites();
+    fill(field, field + 3 * n, 0.0);
+
+    /* The interaction is symmetric, so each pair is found once and
+       applied both ways */
+    const complex<double> *cached = tensors_.empty() ? NULL : &tensors_[0];
+    for (int i = 0; i < n; ++i) {
+        const complex<double> *p1 = dipoles + 3*i;
+        complex<double> *e1 = field + 3*i;
+        for (int j = i + 1; j < n; ++j) {
+            complex<double> found[6];
+            const complex<double> *t = found;
+            if (cached) {
+                t = cached;
+                cached += 6;
+            } else {
+                tensor(i, j, found);
+            }
+            const complex<double> *p2 = dipoles + 3*j;
+            complex<double> *e2 = field + 3*j;
+            e1[0] += mul(t[0], p2[0]) + mul(t[1], p2[1]) + mul(t[2], p2[2]);
+            e1[1] += mul(t[1], p2[0]) + mul(t[3], p2[1]) + mul(t[4], p2[2]);
+            e1[2] += mul(t[2], p2[0]) + mul(t[4], p2[1]) + mul(t[5], p2[2]);
+            e2[0] += mul(t[0], p1[0]) + mul(t[1], p1[1]) + mul(t[2], p1[2]);
+            e2[1] += mul(t[1], p1[0]) + mul(t[3], p1[1]) + mul(t[4], p1[2]);
+            e2[2] += mul(t[2], p1[0]) + mul(t[4], p1[1]) + mul(t[5], p1[2]);
+        }
+    }
+
+}
+
+/* The greatest common divisor of two lengths, to within tol */
+static double common_divisor(double a, double b, const double tol) {
+    if (a < b)
+        swap(a, b);
+    while (b > tol) {
+        double r = fmod(a, b);
+        if (b - r <= tol)
+            r = 0.0;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+Cluster::Cluster(const int nparticles, const double positions[][3])
+    : spacing_(1.0),
+      positions_(3 * nparticles),
+      lattice_(NULL),
+      interaction_(NULL)
+{
+
+    /* The positions relative to the corner of the bounding box */
+    double origin[3], extent[3];
+    for (int c = 0; c < 3; ++c) {
+        origin[c] = extent[c] = positions[0][c];
+        for (int i = 1; i < nparticles; ++i) {
+            origin[c] = min(origin[c], positions[i][c]);
+            extent[c] = max(extent[c], positions[i][c]);
+        }
+        extent[c] -= origin[c];
+    }
+    const double tol = 1e-6 * max(*max_element(extent, extent + 3), 1.0);
+
+    /* The largest spacing of a lattice that every sphere lies on */
+    double spacing = 0.0;
+    for (int i = 0; i < nparticles; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            const double x = positions[i][c] - origin[c];
+            if (x > tol)
+                spacing = spacing == 0.0 ? x : common_divisor(spacing, x, tol);
+        }
+    }
+    if (spacing == 0.0)
+        spacing = 1.0;
+
+    /* Use the lattice if its box is not too sparse, and it truly holds
+       every sphere */
+    bool lattice = true;
+    double cells = 1.0;
+    for (int c = 0; c < 3; ++c)
+        cells *= floor(extent[c] / spacing + 0.5) + 1.0;
+    if (cells > static_cast<double>(CLUSTER_MAXFILL) * nparticles)
+        lattice = false;
+    for (int i = 0; lattice && i < nparticles; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            const double x = positions[i][c] - origin[c];
+            if (fabs(x - spacing * floor(x / spacing + 0.5)) > tol)
+                lattice = false;
+        }
+    }
+
+    if (lattice) {
+        spacing_ = spacing;
+        DipoleSites sites;
+        for (int c = 0; c < 3; ++c)
+            sites.dims[c] = static_cast<int>(floor(extent[c] / spacing + 0.5)) + 1;
+        for (int i = 0; i < nparticles; ++i) {
+            int xyz[3];
+            for (int c = 0; c < 3; ++c) {
+                xyz[c] = static_cast<int>(floor(( positions[i][c] - origin[c] )
+                                                / spacing + 0.5));
+                positions_[3*i+c] = xyz[c];
+            }
+            sites.sites.push_back(xyz[0] + sites.dims[0]
+                                         * ( xyz[1] + sites.dims[1] * xyz[2] ));
+        }
+        lattice_ = new DipoleLattice(sites);
+        interaction_ = lattice_;
+    } else {
+        for (int i = 0; i < nparticles; ++i)
+            for (int c = 0; c < 3; ++c)
+                positions_[3*i+c] = positions[i][c] - origin[c];
+        interaction_ = new DipolePairs(positions_);
+    }
+
+}
+
+Cluster::~Cluster() {
+    delete interaction_;
+}
+
+int Cluster::solve(const complex<double> a1, const double k,
+                   double *extinct, double *scat, double *absorb)
+{
+
+    NPSPEC_TIME(PhaseCluster);
+
+    *extinct = *scat = *absorb = 0.0;
+    if (a1 == 0.0)
+        return 0;
+
+    const int n = nparticles();
+    const double kd = k * spacing_;
+    interaction_->set_wavenumber(kd);
+
+    /* The inverse of the polarizability 3i a(1) / 2k^3, in units of the
+       spacing cubed */
+    const complex<double> ainv = -2.0 / 3.0 * I * kd * sqr(kd) / a1;
+    const vector< complex<double> > alpha_inv(n, ainv);
+    const double loss = -imag(ainv) - 2.0 / 3.0 * kd * sqr(kd);
+
+    int status = 0;
+    double cext = 0.0, cabs = 0.0;
+    vector< complex<double> > field(3 * n);
+    for (int inc = 0; inc < DDA_INCIDENCES; ++inc) {
+
+        /* Along one axis, polarized along the next, as for the DDA */
+        const int axis = inc;
+        const int pol = ( axis + 1 ) % 3;
+        fill(field.begin(), field.end(), 0.0);
+        for (int s = 0; s < n; ++s)
+            field[3*s+pol] = exp(I * ( kd * positions_[3*s+axis] ));
+
+        vector< complex<double> >& p = dipoles_[inc];
+        if (p.size() != field.size()) {
+            p.resize(field.size());
+            for (size_t i = 0; i < p.size(); ++i)
+                p[i] = field[i] / ainv;
+        }
+        if (dipole_solve(*interaction_, alpha_inv, &field[0], &p[0]) < 0)
+            status = 1;
+
+        for (int i = 0; i < 3 * n; ++i) {
+            cext += 4.0 * pi * kd * imag(conj(field[i]) * p[i]);
+            cabs += 4.0 * pi * kd * loss * norm(p[i]);
+        }
+
+    }
+
+    /* Average, in nm^2 */
+    const double area = sqr(spacing_) / DDA_INCIDENCES;
+    *extinct = cext * area;
+    *absorb  = cabs * area;
+    *scat    = *extinct - *absorb;
+
+    return status;
+
+}
+
+/* The cell of a grid of the given size that a point lies in */
+struct ClusterCell {
+    long x, y, z;
+    bool operator<(const ClusterCell& o) const {
+        if (x != o.x) return x < o.x;
+        if (y != o.y) return y < o.y;
+        return z < o.z;
+    }
+    bool operator==(const ClusterCell& o) const {
+        return x == o.x && y == o.y && z == o.z;
+    }
+};
+
+bool cluster_overlaps (const int nparticles,
+                       const double positions[][3],
+                       const double radius)
+{
+
+    /* Sort the spheres into cells one diameter wide, so that each only
+       needs to be compared with those in the neighbouring cells */
+    const double size = 2.0 * radius;
+    vector< pair<ClusterCell, int> > cells(nparticles);
+    for (int i = 0; i < nparticles; ++i) {
+        ClusterCell c = { static_cast<long>(floor(positions[i][0] / size)),
+                          static_cast<long>(floor(positions[i][1] / size)),
+                          static_cast<long>(floor(positions[i][2] / size)) };
+        cells[i] = make_pair(c, i);
+    }
+    sort(cells.begin(), cells.end());
+
+    /* Touching spheres are allowed */
+    const double limit = sqr(size) * ( 1.0 - 1e-9 );
+    for (int i = 0; i < nparticles; ++i) {
+        const ClusterCell& c = cells[i].first;
+        for (long dz = -1; dz <= 1; ++dz) {
+            for (long dy = -1; dy <= 1; ++dy) {
+                for (long dx = -1; dx <= 1; ++dx) {
+                    ClusterCell nc = { c.x + dx, c.y + dy, c.z + dz };
+                    vector< pair<ClusterCell, int> >::const_iterator it =
+                        lower_bound(cells.begin(), cells.end(),
+                                    make_pair(nc, -1));
+                    for (; it != cells.end() && it->first == nc; ++it) {
+                        const int a = cells[i].second, b = it->second;
+                        if (b <= a)
+                            continue;
+                        const double d2 = sqr(positions[a][0] - positions[b][0])
+                                        + sqr(positions[a][1] - positions[b][1])
+                                        + sqr(positions[a][2] - positions[b][2]);
+                        if (d2 < limit)
+                            return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+
+}
@@ -0,0 +1,424 @@
+/*******************************************************************
+ * **********   dda - Particles of any shape
+ *                    Theory:   discrete dipole approximation
+ *                    Results:  efficiency factors averaged over three
+ *                              incident fields
+ * The particle is replaced by point dipoles on a cubic lattice, each
+ * polarized by the incident field and the fields of all the others
+ * (Purcell & Pennypacker; Draine & Flatau, JOSA A 11, 1491, 1994).
+ * The polarizability of each dipole is the lattice dispersion relation
+ * of Draine & Goodman (ApJ 405, 685, 1993).  The coupled dipoles are
+ * solved for iteratively by the complex symmetric form of BiCG, which
+ * needs half the products of BiCGStab or fewer.  Because the field of
+ * a dipole only depends on the separation of two sites each product
+ * with the interaction matrix is a convolution, done by FFT in
+ * O(N log N) (Goodman, Draine & Flatau, Opt. Lett. 16, 1198, 1991).
+ *
+ * Like any DDA, it converges slowly with the number of dipoles for
+ * metals whose dielectric is large and negative, as the corners of the
+ * lattice resonate; fine lattices are needed for gold and silver far
+ * to the red of their plasmon resonance.
+ *
+ * Rather than averaging over every orientation, the efficiencies are
+ * averaged over light incident along each of the three axes, polarized
+ * along Y, Z and X in turn so that each axis is polarized once.  This
+ * is exact in the dipole limit, and close for particles that are not
+ * much larger than the wavelength.
+ *******************************************************************/
+
+#include "npspec/private/dda.hpp"
+#include "npspec/private/instrument.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+using namespace std;
+using namespace NPSpec;
+
+const double pi = 4.0 * atan(1.0);
+const complex<double> I(0.0, 1.0);
+
+inline double sqr(double x) { return x*x; }
+
+/* The lattice dispersion relation coefficients of Draine & Goodman.
+   The third multiplies a term that vanishes for light incident along
+   an axis of the lattice, so it is not needed here. */
+const double LDR_B1 = -1.8915316;
+const double LDR_B2 =  0.1648469;
+
+/* The position of a grid point relative to the origin, given that the
+   grid wraps around.  False if it is further than a lattice can reach. */
+inline bool separation(const int i, const int n, const int m, int *d) {
+    if (i < n)
+        *d = i;
+    else if (i > m - n)
+        *d = i - m;
+    else
+        return false;
+    return true;
+}
+
+/* The bilinear (not Hermitian) product, under which the interaction
+   matrix is symmetric */
+inline complex<double> dot(const vector< complex<double> >& a,
+                           const vector< complex<double> >& b) {
+    complex<double> sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+        sum += mul(a[i], b[i]);
+    return sum;
+}
+
+inline double norm2(const vector< complex<double> >& a) {
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+        sum += norm(a[i]);
+    return sqrt(sum);
+}
+
+/* The size of the grid the lattice is embedded in so that the
+   convolution does not wrap around onto itself */
+static int *grid_dims(const int dims[3], int grid[3]) {
+    for (int i = 0; i < 3; ++i)
+        grid[i] = fft_size(2 * dims[i] - 1);
+    return grid;
+}
+
+DipoleLattice::DipoleLattice(const DipoleSites& sites)
+    : sites_(sites.sites),
+      cells_(),
+      fft_(grid_dims(sites.dims, grid_)),
+      kd_(-1.0)
+{
+    copy(sites.dims, sites.dims + 3, dims_);
+    for (int c = 0; c < 3; ++c)
+        work_[c].resize(fft_.size());
+
+    /* Where each site lies on the grid */
+    cells_.resize(sites_.size());
+    for (int s = 0; s < nsites(); ++s) {
+        int xyz[3];
+        position(s, xyz);
+        cells_[s] = xyz[0] + grid_[0] * ( xyz[1] + grid_[1] * xyz[2] );
+    }
+}
+
+void DipoleLattice::position(const int site, int xyz[3]) const {
+    const int i = sites_[site];
+    xyz[0] = i % dims_[0];
+    xyz[1] = ( i / dims_[0] ) % dims_[1];
+    xyz[2] = i / ( dims_[0] * dims_[1] );
+}
+
+void DipoleLattice::set_wavenumber(const double kd) {
+
+    if (kd == kd_)
+        return;
+    kd_ = kd;
+
+    /* The field at r of a unit dipole at the origin is
+           exp(ikr)/r^3 [ (k^2 r^2 + ikr - 1) I - (k^2 r^2 + 3ikr - 3) rr ]
+       with rr the outer product of the unit vector.  Each of the six
+       distinct elements is transformed once for every wavenumber. */
+    const int *grid = grid_;
+    const double scale = 1.0 / fft_.size();
+    for (int t = 0; t < 6; ++t)
+        tensor_[t].assign(fft_.size(), 0.0);
+    for (int z = 0; z < grid[2]; ++z) {
+        for (int y = 0; y < grid[1]; ++y) {
+            for (int x = 0; x < grid[0]; ++x) {
+                int d[3];
+                if (!separation(x, dims_[0], grid[0], &d[0]) ||
+                    !separation(y, dims_[1], grid[1], &d[1]) ||
+                    !separation(z, dims_[2], grid[2], &d[2]))
+                    continue;
+                if (d[0] == 0 && d[1] == 0 && d[2] == 0)
+                    continue;
+                const double r = sqrt(static_cast<double>(
+                                      d[0]*d[0] + d[1]*d[1] + d[2]*d[2]));
+                const double kr = kd * r;
+                const complex<double> g = exp(I * kr) / ( r * r * r ) * scale;
+                const complex<double> a = g * complex<double>(kr*kr - 1.0, kr);
+                const complex<double> b = g * complex<double>(kr*kr - 3.0, 3.0*kr)
+                                        / ( r * r );
+                const int i = x + grid[0] * ( y + grid[1] * z );
+                tensor_[0][i] = a - b * static_cast<double>(d[0]*d[0]);
+                tensor_[1][i] =   - b * static_cast<double>(d[0]*d[1]);
+                tensor_[2][i] =   - b * static_cast<double>(d[0]*d[2]);
+                tensor_[3][i] = a - b * static_cast<double>(d[1]*d[1]);
+                tensor_[4][i] =   - b * static_cast<double>(d[1]*d[2]);
+                tensor_[5][i] = a - b * static_cast<double>(d[2]*d[2]);
+            }
+        }
+    }
+    for (int t = 0; t < 6; ++t)
+        fft_.forward(&tensor_[t][0]);
+
+}
+
+void DipoleLattice::apply(const complex<double> dipoles[],
+                          complex<double> field[]) {
+
+    const int n = nsites();
+
+    /* Place the dipoles on the grid and transform them */
+    for (int c = 0; c < 3; ++c)
+        fill(work_[c].begin(), work_[c].end(), 0.0);
+    for (int s = 0; s < n; ++s)
+        for (int c = 0; c < 3; ++c)
+            work_[c][cells_[s]] = dipoles[3*s+c];
+    for (int c = 0; c < 3; ++c)
+        fft_.forward(&work_[c][0], dims_);
+
+    /* The convolution is now a product with the symmetric tensor */
+    complex<double> *px = &work_[0][0], *py = &work_[1][0], *pz = &work_[2][0];
+    for (int i = 0; i < fft_.size(); ++i) {
+        const complex<double> x = px[i], y = py[i], z = pz[i];
+        px[i] = mul(tensor_[0][i], x) + mul(tensor_[1][i], y) + mul(tensor_[2][i], z);
+        py[i] = mul(tensor_[1][i], x) + mul(tensor_[3][i], y) + mul(tensor_[4][i], z);
+        pz[i] = mul(tensor_[2][i], x) + mul(tensor_[4][i], y) + mul(tensor_[5][i], z);
+    }
+
+    /* Transform back and read off the field at each site */
+    for (int c = 0; c < 3; ++c)
+        fft_.inverse(&work_[c][0], dims_);
+    for (int s = 0; s < n; ++s)
+        for (int c = 0; c < 3; ++c)
+            field[3*s+c] = work_[c][cells_[s]];
+
+}
+
+/* y = A x for the coupled dipole system */
+static void interact(DipoleInteraction& interaction,
+                     const vector< complex<double> >& alpha_inv,
+                     const vector< complex<double> >& x,
+                     vector< complex<double> >& y) {
+    interaction.apply(&x[0], &y[0]);
+    for (size_t i = 0; i < y.size(); ++i)
+        y[i] = alpha_inv[i/3] * x[i] - y[i];
+}
+
+int dipole_solve (DipoleInteraction& interaction,
+                  const vector< complex<double> >& alpha_inv,
+                  const complex<double> field[],
+                  complex<double> dipoles[])
+{
+
+    NPSPEC_COUNT(DipoleSolves);
+
+    const size_t n = 3 * interaction.nsites();
+    vector< complex<double> > x(dipoles, dipoles + n), b(field, field + n);
+    vector< complex<double> > r(n), p(n), q(n);
+
+    /* The conjugate orthogonal conjugate gradient method (van der Vorst
+       & Melissen, 1990), which is BiCG for a complex symmetric matrix
+       and so needs one product with it each iteration */
+    interact(interaction, alpha_inv, x, r);
+    for (size_t i = 0; i < n; ++i)
+        r[i] = b[i] - r[i];
+    p = r;
+    complex<double> rho = dot(r, r);
+    const double target = DDA_TOLERANCE * norm2(b);
+
+    int iter = 0;
+    bool converged = norm2(r) <= target;
+    while (!converged && iter < DDA_MAXITER) {
+        ++iter;
+        interact(interaction, alpha_inv, p, q);
+        const complex<double> pq = dot(p, q);
+        if (pq == 0.0 || rho == 0.0)
+            break;
+        const complex<double> alpha = rho / pq;
+        for (size_t i = 0; i < n; ++i) {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+        converged = norm2(r) <= target;
+        const complex<double> rho1 = dot(r, r);
+        const complex<double> beta = rho1 / rho;
+        for (size_t i = 0; i < n; ++i)
+            p[i] = r[i] + beta * p[i];
+        rho = rho1;
+    }
+
+    NPSPEC_COUNT_N(DipoleIterations, iter);
+    copy(x.begin(), x.end(), dipoles);
+    return converged ? iter : -1;
+
+}
+
+/* The extent of a shape along each axis */
+static void extents(const NanoparticleShape shape, const double rad[2],
+                    double extent[3]) {
+    switch (shape) {
+    case Sphere:
+        extent[0] = extent[1] = extent[2] = 2.0 * rad[0];
+        break;
+    case Prism:
+        extent[0] = 2.0 * rad[1];
+        extent[1] = sqrt(3.0) * rad[1];
+        extent[2] = 2.0 * rad[0];
+        break;
+    default:
+        extent[0] = extent[1] = 2.0 * rad[1];
+        extent[2] = 2.0 * rad[0];
+        break;
+    }
+}
+
+/* Whether a point, relative to the center of its bounding box, lies
+   within the shape */
+static bool inside(const NanoparticleShape shape, const double rad[2],
+                   const double x, const double y, const double z) {
+    switch (shape) {
+    case Sphere:
+        return sqr(x) + sqr(y) + sqr(z) <= sqr(rad[0]);
+    case Ellipsoid:
+    case Spheroid:
+        return ( sqr(x) + sqr(y) ) / sqr(rad[1]) + sqr(z / rad[0]) <= 1.0;
+    case Cube:
+        return true;
+    case Rod: {
+        const double h = max(fabs(z) - ( rad[0] - rad[1] ), 0.0);
+        return sqr(x) + sqr(y) + sqr(h) <= sqr(rad[1]);
+    }
+    case Prism:
+        return sqrt(3.0) * fabs(x) + y <= sqrt(3.0) * rad[1] / 2.0;
+    }
+    return false;
+}
+
+/* The volume of a shape */
+static double volume(const NanoparticleShape shape, const double rad[2]) {
+    switch (shape) {
+    case Sphere:
+        return 4.0 / 3.0 * pi * rad[0] * sqr(rad[0]);
+    case Ellipsoid:
+    case Spheroid:
+        return 4.0 / 3.0 * pi * rad[0] * sqr(rad[1]);
+    case Cube:
+        return 8.0 * rad[0] * sqr(rad[1]);
+    case Rod:
+        return 2.0 * pi * ( rad[0] - rad[1] ) * sqr(rad[1])
+             + 4.0 / 3.0 * pi * rad[1] * sqr(rad[1]);
+    case Prism:
+        return 2.0 * sqrt(3.0) * rad[0] * sqr(rad[1]);
+    }
+    return 0.0;
+}
+
+DipoleSites dda_sites (const NanoparticleShape shape,
+                       const double rad[2],
+                       const double spacing,
+                       double *vol)
+{
+
+    DipoleSites lattice;
+    double extent[3];
+    extents(shape, rad, extent);
+    for (int i = 0; i < 3; ++i)
+        lattice.dims[i] = max(1, static_cast<int>(floor(extent[i] / spacing + 0.5)));
+
+    /* Sites are at the centers of the cells of the bounding box */
+    const int *n = lattice.dims;
+    for (int k = 0; k < n[2]; ++k) {
+        const double z = ( k + 0.5 - n[2] / 2.0 ) * spacing;
+        for (int j = 0; j < n[1]; ++j) {
+            const double y = ( j + 0.5 - n[1] / 2.0 ) * spacing;
+            for (int i = 0; i < n[0]; ++i) {
+                const double x = ( i + 0.5 - n[0] / 2.0 ) * spacing;
+                if (inside(shape, rad, x, y, z))
+                    lattice.sites.push_back(i + n[0] * ( j + n[1] * k ));
+            }
+        }
+    }
+
+    *vol = volume(shape, rad);
+    return lattice;
+
+}
+
+static double longest(const NanoparticleShape shape, const double rad[2]) {
+    double extent[3];
+    extents(shape, rad, extent);
+    return *max_element(extent, extent + 3);
+}
+
+DDA::DDA(const NanoparticleShape shape, const double rad[2],
+         const int resolution)
+    : spacing_(longest(shape, rad) / resolution),
+      volume_(0.0),
+      lattice_(dda_sites(shape, rad, spacing_, &volume_))
+{
+    /* Scale the lattice so the dipoles fill the volume of the shape */
+    spacing_ = cbrt(volume_ / ndipoles());
+}
+
+double DDA::volume_radius() const {
+    return cbrt(3.0 * volume_ / ( 4.0 * pi ));
+}
+
+int DDA::solve(const complex<double> dielec, const double k,
+               double *extinct, double *scat, double *absorb)
+{
+
+    NPSPEC_TIME(PhaseDDA);
+
+    const int n = ndipoles();
+    const double kd = k * spacing_;
+    lattice_.set_wavenumber(kd);
+
+    /* The lattice dispersion relation polarizability, in units of the
+       volume of a lattice cell */
+    const complex<double> cm = 3.0 / ( 4.0 * pi ) * ( dielec - 1.0 )
+                                                   / ( dielec + 2.0 );
+    const complex<double> ainv = 1.0 / cm
+                               + ( LDR_B1 + LDR_B2 * dielec ) * sqr(kd)
+                               - 2.0 / 3.0 * I * kd * sqr(kd);
+    const vector< complex<double> > alpha_inv(n, ainv);
+    const double loss = -imag(ainv) - 2.0 / 3.0 * kd * sqr(kd);
+
+    const complex<double> m = sqrt(dielec);
+    int status = abs(m) * kd > DDA_MAXKD || abs(m - 1.0) > DDA_MAXINDEX ? 1 : 0;
+
+    double cext = 0.0, cabs = 0.0;
+    vector< complex<double> > field(3 * n);
+    for (int inc = 0; inc < DDA_INCIDENCES; ++inc) {
+
+        /* Along one axis, polarized along the next */
+        const int axis = inc;
+        const int pol = ( axis + 1 ) % 3;
+        fill(field.begin(), field.end(), 0.0);
+        for (int s = 0; s < n; ++s) {
+            int xyz[3];
+            lattice_.position(s, xyz);
+            field[3*s+pol] = exp(I * ( kd * xyz[axis] ));
+        }
+
+        vector< complex<double> >& p = dipoles_[inc];
+        if (p.size() != field.size()) {
+            p.resize(field.size());
+            for (size_t i = 0; i < p.size(); ++i)
+                p[i] = field[i] / ainv;
+        }
+        if (dipole_solve(lattice_, alpha_inv, &field[0], &p[0]) < 0)
+            status = 1;
+
+        /* Extinction from the forward amplitude, absorption from the
+           work done on each dipole */
+        for (int i = 0; i < 3 * n; ++i) {
+            cext += 4.0 * pi * kd * imag(conj(field[i]) * p[i]);
+            cabs += 4.0 * pi * kd * loss * norm(p[i]);
+        }
+
+    }
+
+    /* Average, and relative to the sphere of the same volume */
+    const double area = DDA_INCIDENCES * pi * sqr(volume_radius() / spacing_);
+    *extinct = cext / area;
+    *absorb  = cabs / area;
+    *scat    = *extinct - *absorb;
+
+    return status;
+
+}
@@ -0,0 +1,222 @@
+/* A mixed radix fast Fourier transform, recursively decimating in time
+ * (Cooley & Tukey) with butterflies for radices 2 to 5 and a general
+ * butterfly for any other factor.  It follows the layout of KISS FFT
+ * by Mark Borgerding.  The three dimensional transform is done one axis
+ * at a time, and skips the lines that are known to be zero. */
+
+#include "npspec/private/fft.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+const double pi = 4.0 * atan(1.0);
+
+FFT::FFT(const int n) : n_(n), factors_() {
+
+    /* The factors, in pairs of the radix and the length remaining */
+    int m = n, p = 4;
+    while (m > 1) {
+        while (m % p != 0) {
+            switch (p) {
+            case 4:  p = 2; break;
+            case 2:  p = 3; break;
+            default: p += 2; break;
+            }
+            if (p * p > m)
+                p = m;
+        }
+        m /= p;
+        factors_.push_back(p);
+        factors_.push_back(m);
+    }
+
+    for (int d = 0; d < 2; ++d) {
+        twiddles_[d].resize(n);
+        const double sign = d == 0 ? -1.0 : 1.0;
+        for (int i = 0; i < n; ++i)
+            twiddles_[d][i] = polar(1.0, sign * 2.0 * pi * i / n);
+    }
+
+}
+
+void FFT::transform(const complex<double> *in, const int stride,
+                    complex<double> *out, const bool inverse) const {
+    if (n_ == 1)
+        out[0] = in[0];
+    else
+        work(out, in, 1, stride, &factors_[0], inverse);
+}
+
+void FFT::work(complex<double> *out, const complex<double> *in,
+               const int fstride, const int in_stride, const int *factors,
+               const bool inverse) const {
+
+    const int p = factors[0], m = factors[1];
+    const complex<double> *tw = &twiddles_[inverse ? 1 : 0][0];
+
+    /* Transform each of the p interleaved sequences of length m */
+    if (m == 1) {
+        for (int q = 0; q < p; ++q)
+            out[q] = in[q * fstride * in_stride];
+    } else {
+        for (int q = 0; q < p; ++q)
+            work(out + q * m, in + q * fstride * in_stride, fstride * p,
+                 in_stride, factors + 2, inverse);
+    }
+
+    /* Combine them */
+    switch (p) {
+
+    case 2:
+        for (int k = 0; k < m; ++k) {
+            const complex<double> t = mul(out[k+m], tw[k*fstride]);
+            out[k+m] = out[k] - t;
+            out[k]  += t;
+        }
+        break;
+
+    case 3: {
+        const double s = imag(tw[fstride*m]);
+        for (int k = 0; k < m; ++k) {
+            const complex<double> s1 = mul(out[k+m],   tw[k*fstride]);
+            const complex<double> s2 = mul(out[k+2*m], tw[2*k*fstride]);
+            const complex<double> s3 = s1 + s2;
+            const complex<double> s0 = ( s1 - s2 ) * s;
+            const complex<double> h = out[k] - 0.5 * s3;
+            out[k]    += s3;
+            out[k+m]   = complex<double>(real(h) - imag(s0), imag(h) + real(s0));
+            out[k+2*m] = complex<double>(real(h) + imag(s0), imag(h) - real(s0));
+        }
+        break;
+    }
+
+    case 4:
+        for (int k = 0; k < m; ++k) {
+            const complex<double> s0 = mul(out[k+m],   tw[k*fstride]);
+            const complex<double> s1 = mul(out[k+2*m], tw[2*k*fstride]);
+            const complex<double> s2 = mul(out[k+3*m], tw[3*k*fstride]);
+            const complex<double> s5 = out[k] - s1;
+            const complex<double> s3 = s0 + s2;
+            const complex<double> s4 = s0 - s2;
+            out[k]     += s1;
+            out[k+2*m]  = out[k] - s3;
+            out[k]     += s3;
+            /* s4 turned by -i going forward, or +i for the inverse */
+            const complex<double> s4i = inverse
+                                      ? complex<double>(-imag(s4), real(s4))
+                                      : complex<double>(imag(s4), -real(s4));
+            out[k+m]   = s5 + s4i;
+            out[k+3*m] = s5 - s4i;
+        }
+        break;
+
+    case 5: {
+        const complex<double> ya = tw[fstride*m], yb = tw[2*fstride*m];
+        for (int k = 0; k < m; ++k) {
+            const complex<double> s0 = out[k];
+            const complex<double> s1 = mul(out[k+m],   tw[k*fstride]);
+            const complex<double> s2 = mul(out[k+2*m], tw[2*k*fstride]);
+            const complex<double> s3 = mul(out[k+3*m], tw[3*k*fstride]);
+            const complex<double> s4 = mul(out[k+4*m], tw[4*k*fstride]);
+            const complex<double> s7 = s1 + s4, s10 = s1 - s4;
+            const complex<double> s8 = s2 + s3, s9  = s2 - s3;
+            out[k] = s0 + s7 + s8;
+            const complex<double> s5 = s0 + s7 * real(ya) + s8 * real(yb);
+            const complex<double> s6(imag(s10) * imag(ya) + imag(s9) * imag(yb),
+                                     -real(s10) * imag(ya) - real(s9) * imag(yb));
+            out[k+m]   = s5 - s6;
+            out[k+4*m] = s5 + s6;
+            const complex<double> s11 = s0 + s7 * real(yb) + s8 * real(ya);
+            const complex<double> s12(imag(s9) * imag(ya) - imag(s10) * imag(yb),
+                                      real(s10) * imag(yb) - real(s9) * imag(ya));
+            out[k+2*m] = s11 + s12;
+            out[k+3*m] = s11 - s12;
+        }
+        break;
+    }
+
+    default: {
+        vector< complex<double> > scratch(p);
+        for (int k = 0; k < m; ++k) {
+            for (int q = 0; q < p; ++q)
+                scratch[q] = out[k + q*m];
+            for (int q = 0; q < p; ++q) {
+                const int j = k + q*m;
+                complex<double> sum = scratch[0];
+                int t = 0;
+                for (int r = 1; r < p; ++r) {
+                    t += fstride * j;
+                    if (t >= n_) t %= n_;
+                    sum += mul(scratch[r], tw[t]);
+                }
+                out[j] = sum;
+            }
+        }
+        break;
+    }
+
+    }
+
+}
+
+int fft_size(const int n) {
+    for (int m = max(n, 1); ; ++m) {
+        int r = m;
+        while (r % 2 == 0) r /= 2;
+        while (r % 3 == 0) r /= 3;
+        while (r % 5 == 0) r /= 5;
+        if (r == 1)
+            return m;
+    }
+}
+
+FFT3::FFT3(const int dims[3])
+    : fft_{ FFT(dims[0]), FFT(dims[1]), FFT(dims[2]) },
+      line_(*max_element(dims, dims + 3))
+{
+    copy(dims, dims + 3, dims_);
+}
+
+/* Transform every line along an axis.  Only the first nlines of the
+   other two axes (in order) are transformed. */
+void FFT3::lines(complex<double> grid[], const int axis, const int nlines[2],
+                 const bool inverse) const {
+
+    const int stride[3] = { 1, dims_[0], dims_[0] * dims_[1] };
+    const int a = axis == 0 ? 1 : 0;
+    const int b = axis == 2 ? 1 : 2;
+    const int n = dims_[axis];
+
+    for (int j = 0; j < nlines[1]; ++j) {
+        for (int i = 0; i < nlines[0]; ++i) {
+            complex<double> *start = grid + i * stride[a] + j * stride[b];
+            fft_[axis].transform(start, stride[axis], &line_[0], inverse);
+            for (int k = 0; k < n; ++k)
+                start[k * stride[axis]] = line_[k];
+        }
+    }
+
+}
+
+void FFT3::forward(complex<double> grid[]) const {
+    forward(grid, dims_);
+}
+
+void FFT3::forward(complex<double> grid[], const int box[3]) const {
+    const int x[2] = { box[1], box[2] };
+    const int y[2] = { dims_[0], box[2] };
+    const int z[2] = { dims_[0], dims_[1] };
+    lines(grid, 0, x, false);
+    lines(grid, 1, y, false);
+    lines(grid, 2, z, false);
+}
+
+void FFT3::inverse(complex<double> grid[], const int box[3]) const {
+    const int x[2] = { box[1], box[2] };
+    const int y[2] = { dims_[0], box[2] };
+    const int z[2] = { dims_[0], dims_[1] };
+    lines(grid, 2, z, true);
+    lines(grid, 1, y, true);
+    lines(grid, 0, x, true);
+}
@@ -0,0 +1,217 @@
+/* The optional instrumentation layer.  Each thread records into its own
+ * counters, which are kept in a registry so that they can be summed.
+ * When a thread exits its counters are folded into a running total so
+ * that nothing it recorded is lost. */
+
+#include "npspec/instrument.h"
+#include "npspec/private/instrument.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#ifdef NPSPEC_INSTRUMENT
+#include <mutex>
+#include <vector>
+#endif
+
+using namespace std;
+using namespace NPSpec;
+
+/* Names used for the phases in the JSON output */
+static const char *phase_names[NumPhases] = { "total", "dielectric", "mie",
+                                              "quasi", "color", "tmatrix",
+                                              "dda", "cluster" };
+
+#ifdef NPSPEC_INSTRUMENT
+
+namespace NPSpec {
+namespace Instrument {
+
+thread_local ThreadCounters *current = NULL;
+
+/* Every live thread's counters, and the sum of those that have exited */
+static mutex registry_lock;
+static vector<ThreadCounters*> registry;
+static InstrumentCounters retired;
+static long long nthreads = 0;
+
+static void zero(ThreadCounters& c) {
+    for (int i = 0; i < NumCounters; ++i)
+        c.counts[i].store(0, memory_order_relaxed);
+    for (int i = 0; i < NumOrderBins; ++i) {
+        c.num[i].store(0, memory_order_relaxed);
+        c.num1[i].store(0, memory_order_relaxed);
+    }
+    for (int i = 0; i < NumPhases; ++i)
+        c.seconds[i].store(0.0, memory_order_relaxed);
+}
+
+/* Add one thread's counters into the public struct */
+static void accumulate(const ThreadCounters& c, InstrumentCounters *out) {
+    out->npspec_calls          += c.counts[NPSpecCalls].load(memory_order_relaxed);
+    out->mie_calls             += c.counts[MieCalls].load(memory_order_relaxed);
+    out->quasi_calls           += c.counts[QuasiCalls].load(memory_order_relaxed);
+    out->wavelengths_evaluated += c.counts[WavelengthsEvaluated].load(memory_order_relaxed);
+    out->wavelengths_skipped   += c.counts[WavelengthsSkipped].load(memory_order_relaxed);
+    out->size_corrections      += c.counts[SizeCorrections].load(memory_order_relaxed);
+    out->size_warnings         += c.counts[SizeWarnings].load(memory_order_relaxed);
+    out->color_calls           += c.counts[ColorCalls].load(memory_order_relaxed);
+    out->tmatrix_calls         += c.counts[TMatrixCalls].load(memory_order_relaxed);
+    out->tmatrix_cache_hits    += c.counts[TMatrixCacheHits].load(memory_order_relaxed);
+    out->dipole_solves         += c.counts[DipoleSolves].load(memory_order_relaxed);
+    out->dipole_iterations     += c.counts[DipoleIterations].load(memory_order_relaxed);
+    for (int i = 0; i < NumOrderBins; ++i) {
+        out->num_histogram[i]  += c.num[i].load(memory_order_relaxed);
+        out->num1_histogram[i] += c.num1[i].load(memory_order_relaxed);
+    }
+    for (int i = 0; i < NumPhases; ++i)
+        out->seconds[i] += c.seconds[i].load(memory_order_relaxed);
+}
+
+/* Owns a thread's counters for the lifetime of the thread */
+class Registration {
+public:
+    Registration() : counters() {
+        zero(counters);
+        lock_guard<mutex> guard(registry_lock);
+        registry.push_back(&counters);
+        ++nthreads;
+        current = &counters;
+    }
+    ~Registration() {
+        lock_guard<mutex> guard(registry_lock);
+        accumulate(counters, &retired);
+        registry.erase(find(registry.begin(), registry.end(), &counters));
+        current = NULL;
+    }
+    ThreadCounters counters;
+};
+
+ThreadCounters& attach() {
+    static thread_local Registration registration;
+    return registration.counters;
+}
+
+} // namespace Instrument
+} // namespace NPSpec
+
+bool npspec_instrument_enabled(void) {
+    return true;
+}
+
+void npspec_counters_thread(InstrumentCounters *counters) {
+    memset(counters, 0, sizeof(InstrumentCounters));
+    Instrument::accumulate(Instrument::local(), counters);
+}
+
+void npspec_counters_total(InstrumentCounters *counters) {
+    lock_guard<mutex> guard(Instrument::registry_lock);
+    *counters = Instrument::retired;
+    for (size_t i = 0; i < Instrument::registry.size(); ++i)
+        Instrument::accumulate(*Instrument::registry[i], counters);
+}
+
+void npspec_counters_reset(void) {
+    lock_guard<mutex> guard(Instrument::registry_lock);
+    memset(&Instrument::retired, 0, sizeof(InstrumentCounters));
+    for (size_t i = 0; i < Instrument::registry.size(); ++i)
+        Instrument::zero(*Instrument::registry[i]);
+    Instrument::nthreads = static_cast<long long>(Instrument::registry.size());
+}
+
+/* The number of threads that have recorded since the last reset */
+static long long threads_seen() {
+    lock_guard<mutex> guard(Instrument::registry_lock);
+    return Instrument::nthreads;
+}
+
+#else
+
+/* Instrumentation is compiled out; report zeros */
+
+bool npspec_instrument_enabled(void) {
+    return false;
+}
+
+void npspec_counters_thread(InstrumentCounters *counters) {
+    memset(counters, 0, sizeof(InstrumentCounters));
+}
+
+void npspec_counters_total(InstrumentCounters *counters) {
+    memset(counters, 0, sizeof(InstrumentCounters));
+}
+
+void npspec_counters_reset(void) {
+}
+
+static long long threads_seen() {
+    return 0;
+}
+
+#endif /* NPSPEC_INSTRUMENT */
+
+/* Format a histogram as a JSON array */
+static void json_histogram(ostringstream& out, const long long hist[]) {
+    out << "[";
+    for (int i = 0; i < NumOrderBins; ++i)
+        out << ( i > 0 ? ", " : "" ) << hist[i];
+    out << "]";
+}
+
+static string counters_json() {
+
+    InstrumentCounters c;
+    npspec_counters_total(&c);
+
+    ostringstream out;
+    out.precision(9);
+    out << "{\n"
+        << "  \"enabled\": " << ( npspec_instrument_enabled() ? "true" : "false" ) << ",\n"
+        << "  \"threads\": " << threads_seen() << ",\n"
+        << "  \"npspec_calls\": " << c.npspec_calls << ",\n"
+        << "  \"mie_calls\": " << c.mie_calls << ",\n"
+        << "  \"quasi_calls\": " << c.quasi_calls << ",\n"
+        << "  \"wavelengths_evaluated\": " << c.wavelengths_evaluated << ",\n"
+        << "  \"wavelengths_skipped\": " << c.wavelengths_skipped << ",\n"
+        << "  \"size_corrections\": " << c.size_corrections << ",\n"
+        << "  \"size_warnings\": " << c.size_warnings << ",\n"
+        << "  \"color_calls\": " << c.color_calls << ",\n"
+        << "  \"tmatrix_calls\": " << c.tmatrix_calls << ",\n"
+        << "  \"tmatrix_cache_hits\": " << c.tmatrix_cache_hits << ",\n"
+        << "  \"dipole_solves\": " << c.dipole_solves << ",\n"
+        << "  \"dipole_iterations\": " << c.dipole_iterations << ",\n"
+        << "  \"order_bin_width\": " << static_cast<int>(OrderBinWidth) << ",\n"
+        << "  \"num_histogram\": ";
+    json_histogram(out, c.num_histogram);
+    out << ",\n  \"num1_histogram\": ";
+    json_histogram(out, c.num1_histogram);
+    out << ",\n  \"seconds\": {";
+    for (int i = 0; i < NumPhases; ++i)
+        out << ( i > 0 ? ", " : " " ) << "\"" << phase_names[i] << "\": "
+            << c.seconds[i];
+    out << " }\n}\n";
+
+    return out.str();
+
+}
+
+int npspec_counters_json(char *buffer, const int len) {
+    const string json = counters_json();
+    if (buffer != NULL && len > 0) {
+        const size_t n = min(json.size(), static_cast<size_t>(len - 1));
+        memcpy(buffer, json.c_str(), n);
+        buffer[n] = '\0';
+    }
+    return static_cast<int>(json.size());
+}
+
+int npspec_counters_dump(const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL)
+        return -1;
+    const string json = counters_json();
+    const bool ok = fwrite(json.c_str(), 1, json.size(), fp) == json.size();
+    return fclose(fp) == 0 && ok ? 0 : -1;
+}
@@ -11,55 +11,723 @@
 
 #include "npspec/constants.h"
 #include "npspec/private/solvers.hpp"
+#include "npspec/private/mie.hpp"
+#include "npspec/private/instrument.hpp"
+#include <algorithm>
 #include <cmath>
 #include <complex>
+#include <vector>
 
 using namespace std;
 using namespace NPSpec;
 
-const int MAXNUM        = 100;
 const complex<double> I = complex<double>(0.0, 1.0);
 
 /* A square function */
 inline double sqr(double x) { return x*x; }
+inline complex<double> sqr(const complex<double>& z) { return z*z; }
 
-/**************************************
- * Declarations of supporting functions
- **************************************/
+/****************************************************************
+ * QQ1 specialised on which efficiencies are wanted (a combination
+ * of MieOutputs).  Sums that are not needed are skipped entirely.
+ * Radiation pressure is derived from extinction, so it needs the
+ * extinction sum too.  The sign (-1)^n of the backscattering is
+ * tracked by flipping it rather than by calling pow.
+ ****************************************************************/
+template <int OUT>
+static void qq1_outputs (const double a, const int num1, double *extinct,
+                         double *scat, double *backscat, double *rad_pressure,
+                         const complex<double> ra[], const complex<double> rb[])
+{
 
-int nm(const double x);
+    const bool lext = ( OUT & ( MieExtinction | MieRadiationPressure ) ) != 0;
+    const bool lsca = ( OUT & MieScattering ) != 0;
+    const bool lbak = ( OUT & MieBackscattering ) != 0;
+    const bool lpre = ( OUT & MieRadiationPressure ) != 0;
 
-void aa1 (const complex<double> rx, const int num, complex<double> ru[]);
+    double b = 2.0 * sqr(a);
+    double c = 0.0;
+    double d = 0.0;
+    complex<double> s = complex<double>(0.0, 0.0);
+    complex<double> r = complex<double>(0.0, 0.0);
+    double sign = 1.0;
+    int n = 1;
 
-void aax (const double a, const int num, double ru[]);
+    for (int i = 0; i < num1-1; ++i) {
+        double i1 = static_cast<double>(i + 1);
+        n += 2;
+        double nd = static_cast<double>(n);
+        if (lbak) {
+            sign = -sign;
+            r += ( i1 + 0.5 ) * sign * ( ra[i] - rb[i] );
+        }
+        if (lpre) {
+            s += i1 * ( i1 + 2.0 ) / ( i1 + 1.0 ) * ( ra[i] * conj(ra[i+1])
+               + rb[i] * conj(rb[i+1]) ) + nd / i1 / ( i1 + 1.0 )
+               * ( ra[i] * conj(rb[i]) );
+        }
+        if (lext)
+            c += nd * ( real(ra[i]) + real(rb[i]) );
+        if (lsca)
+            d += nd * ( real(ra[i] * conj(ra[i])) + real(rb[i] * conj(rb[i])) );
+    }
 
-int abn1 (const int nlayers,
-          const complex<double> refrac_indx[],
-          const int num,
-          complex<double> rrbb[][MAXNUM],
-          complex<double> rrd1[][MAXNUM],
-          complex<double> rrd2[][MAXNUM],
-          complex<double> srbb[][MAXNUM],
-          complex<double> srd1[][MAXNUM],
-          complex<double> srd2[][MAXNUM],
-          complex<double> rd11[],
-          complex<double> rd3x[],
-          complex<double> rcx[],
-          double d1x[],
-          complex<double> ra[],
-          complex<double> rb[]
-        );
+    *extinct = lext ? b * c : 0.0;
+    *scat = lsca ? b * d : 0.0;
+    *backscat = lbak ? 2.0 * b * real(r * conj(r)) : 0.0;
+    *rad_pressure = lpre ? *extinct - 2.0 * b * real(s) : 0.0;
 
-void bcd (const complex<double> rx, const int num,
-          complex<double> rd1[], complex<double> rd2[],
-          complex<double> rbb[]);
+}
 
-void cd3x (const double x, const int num, double d1x[],
-           complex<double> rd3x[], complex<double> rcx[]);
+/* Choose the QQ1 kernel for the requested outputs.  Combinations
+ * without their own kernel calculate everything. */
+static void qq1_select (const int outputs, const double a, const int num1,
+                        double *extinct, double *scat, double *backscat,
+                        double *rad_pressure,
+                        const complex<double> ra[], const complex<double> rb[])
+{
+    switch (outputs) {
+        case MieExtinction:
+            qq1_outputs<MieExtinction>(a, num1, extinct, scat, backscat,
+                                       rad_pressure, ra, rb);
+            break;
+        case MieScattering:
+            qq1_outputs<MieScattering>(a, num1, extinct, scat, backscat,
+                                       rad_pressure, ra, rb);
+            break;
+        case MieExtinction | MieScattering:
+            qq1_outputs<MieExtinction | MieScattering>(a, num1, extinct, scat,
+                                                       backscat, rad_pressure,
+                                                       ra, rb);
+            break;
+        default:
+            qq1_outputs<MieAll>(a, num1, extinct, scat, backscat,
+                                rad_pressure, ra, rb);
+            break;
+    }
+}
 
-void qq1 (const double a, const int num1, double *extinct, double *scat,
-          double *backscat, double *rad_pressure,
-          complex<double> ra[], complex<double> rb[]);
+/****************************************************************
+ * Truncation of the series to a relative tolerance.  Past the
+ * turning point n > x the terms of the series fall faster than
+ * geometrically, so everything from order n on is bounded by
+ * t(n) / (1 - r), where t(n) is the term and r its ratio to the
+ * one before.  The series stops once this is within the tolerance
+ * of the sum so far, for the terms (2n+1)(|a|+|b|) that bound the
+ * extinction and (2n+1)(|a|^2+|b|^2) for the scattering.  The
+ * last term is never summed by qq1, so the bound includes it.  A
+ * tolerance of zero keeps the original test on |a(n)| + |b(n)|.
+ ****************************************************************/
+
+class SeriesTruncation {
+public:
+    SeriesTruncation(const double size_param, const double tolerance)
+        : x(size_param), tol(tolerance), sext(0.0), ssca(0.0),
+          text(0.0), tsca(0.0) {}
+    /* Is the series converged after the term of index i? */
+    bool done(const int i, const complex<double> a, const complex<double> b) {
+        if (tol <= 0.0)
+            return abs(a) + abs(b) < 1E-40;
+        double n2 = 2.0 * i + 3.0;
+        double te = n2 * ( abs(a) + abs(b) );
+        double ts = n2 * ( norm(a) + norm(b) );
+        double re = te / text, rs = ts / tsca;
+        sext += n2 * real(a + b);
+        ssca += ts;
+        text = te;
+        tsca = ts;
+        if (te == 0.0)
+            return true;
+        return i + 1 > x && re < 1.0 && rs < 1.0
+            && te <= tol * ( 1.0 - re ) * sext
+            && ts <= tol * ( 1.0 - rs ) * ssca;
+    }
+private:
+    const double x, tol;
+    double sext, ssca;  /* Sums of the series so far */
+    double text, tsca;  /* The last terms */
+};
+
+/* The number of terms of the series.  The terms past the turning
+   point fall as exp(-1.886 d^(3/2)) at order n = x + d x^(1/3), which
+   gives the order where they reach the tolerance; a few more are
+   allowed so that SeriesTruncation can find where to stop. */
+static int series_terms (const double x, const double tolerance) {
+    if (tolerance <= 0.0)
+        return nm(x);
+    double d = pow(log(1.0 / tolerance) / 1.886, 2.0 / 3.0);
+    return min(nm(x), static_cast<int>(x + d * cbrt(x) + 4.0));
+}
+
+/* Absorption, albedo and asymmetry from the efficiencies.  Each is only
+ * calculated if everything it depends on was, otherwise it is zero. */
+static void derived_outputs (const int outputs, const double extinct,
+                             const double scat, const double rad_pressure,
+                             double *absorb, double *albedo, double *asymmetry)
+{
+    const bool both = ( outputs & MieExtinction ) && ( outputs & MieScattering );
+    *absorb = both ? extinct - scat : 0.0;
+    *albedo = both ? scat / extinct : 0.0;
+    *asymmetry = both && ( outputs & MieRadiationPressure )
+               ? ( extinct - rad_pressure ) / scat : 0.0;
+}
+
+/*****************************************************************
+ * Kernels specialised on the number of layers.  Almost every call
+ * has 1, 2 or 3 layers, so for these the layer loops have fixed
+ * bounds and can be unrolled, the ratios of each shell are stored
+ * contiguously per order, and the running ratios of the previous
+ * layer are kept in locals rather than arrays.  The
+ * arithmetic is identical to the generic path.
+ *****************************************************************/
+
+/* The ratios of one shell (layer j > 0) at one order, at m_j * x_j-1
+ * (rd1, rd3) and at m_j * x_j (sd1, sd3), and their ratio rq (see
+ * shell_ratios) */
+struct Shell {
+    Shell() : rd1(), rd3(), sd1(), sd3(), rq() {}
+    complex<double> rd1, rd3;
+    complex<double> sd1, sd3;
+    complex<double> rq;
+};
+
+/* Carry psi'/psi of the sphere inside a shell out to the shell's outer
+ * radius (Yang, Appl. Opt. 42, 1710, 2003).  g1 and g2 match it to the
+ * shell at the inner radius with psi'/psi and zeta'/zeta there.  When
+ * the shell is thick and absorbing rq vanishes and the result goes
+ * smoothly to psi'/psi of the shell itself, where the form with
+ * psi/chi lost every digit to cancellation. */
+static inline complex<double> shell_ratio (const complex<double> g1,
+                                           const complex<double> g2,
+                                           const complex<double> rq,
+                                           const complex<double> sd1,
+                                           const complex<double> sd3)
+{
+    complex<double> den = g2 - rq * g1;
+    if (abs(den) == 0.0)
+        den = 1E-30;
+    return ( g2 * sd1 - rq * g1 * sd3 ) / den;
+}
+
+/* Carry the ratios of the sphere inside a shell out through it for
+ * every order.  m0 is the index inside the shell and m1 its own. */
+static void fold_shell (const complex<double> m0,
+                        const complex<double> m1,
+                        const int num,
+                        const complex<double> rd1[],
+                        const complex<double> rd3[],
+                        const complex<double> sd1[],
+                        const complex<double> sd3[],
+                        const complex<double> rq[],
+                        complex<double> sha[],
+                        complex<double> shb[]
+                      )
+{
+    for (int i = 0; i < num; ++i) {
+        sha[i] = shell_ratio(m1 * sha[i] - m0 * rd1[i],
+                             m1 * sha[i] - m0 * rd3[i],
+                             rq[i], sd1[i], sd3[i]);
+        shb[i] = shell_ratio(m0 * shb[i] - m1 * rd1[i],
+                             m0 * shb[i] - m1 * rd3[i],
+                             rq[i], sd1[i], sd3[i]);
+    }
+}
+
+/* a(n), b(n) from the ratios of the whole sphere, whose outer layer
+ * has the index m */
+static int outer_coefficients (const complex<double> m,
+                               const double size_param,
+                               const int num,
+                               const complex<double> sha[],
+                               const complex<double> shb[],
+                               const complex<double> rd3x[],
+                               const complex<double> rcx[],
+                               const double d1x[],
+                               complex<double> ra[],
+                               complex<double> rb[],
+                               const double tolerance
+                             )
+{
+    SeriesTruncation truncation(size_param, tolerance);
+    int num1 = 0;
+    for (int i = 0; i < num; ++i) {
+
+        ra[i] = rcx[i] * ( sha[i] - m *  d1x[i] ) / ( sha[i] - m * rd3x[i] );
+        rb[i] = rcx[i] * ( m * shb[i] -  d1x[i] ) / ( m * shb[i] - rd3x[i] );
+
+        ++num1;
+        if (truncation.done(i, ra[i], rb[i])) break;
+
+    }
+    return num1;
+}
+
+/* Number of shells stored per order (at least 1 to keep arrays valid) */
+template <int NL>
+struct Shells { static const int n = NL > 1 ? NL - 1 : 1; };
+
+/* ABn1 for exactly NL layers.  shell[i*Shells<NL>::n + j-1] holds the
+ * ratios of layer j at order i. */
+template <int NL>
+static int abn1_layers (const complex<double> refrac_indx[],
+                        const int num,
+                        const Shell shell[],
+                        const complex<double> rd11[],
+                        const complex<double> rd3x[],
+                        const complex<double> rcx[],
+                        const double d1x[],
+                        complex<double> ra[],
+                        complex<double> rb[],
+                        SeriesTruncation& truncation
+                      )
+{
+
+    const int ns = Shells<NL>::n;
+    int num1 = 0;
+    for (int i = 0; i < num; ++i) {
+
+        complex<double> sha = rd11[i];
+        complex<double> shb = rd11[i];
+
+        for (int j = 1; j < NL; ++j) {
+
+            const Shell& sh = shell[i * ns + j - 1];
+            const complex<double> m0 = refrac_indx[j-1];
+            const complex<double> m1 = refrac_indx[j];
+
+            sha = shell_ratio(m1 * sha - m0 * sh.rd1, m1 * sha - m0 * sh.rd3,
+                              sh.rq, sh.sd1, sh.sd3);
+            shb = shell_ratio(m0 * shb - m1 * sh.rd1, m0 * shb - m1 * sh.rd3,
+                              sh.rq, sh.sd1, sh.sd3);
+
+        }
+
+        /* calculations of a(n), b(n) */
+        const complex<double> m = refrac_indx[NL-1];
+        ra[i] = rcx[i] * ( sha - m *  d1x[i] ) / ( sha - m * rd3x[i] );
+        rb[i] = rcx[i] * ( m * shb -  d1x[i] ) / ( m * shb - rd3x[i] );
+
+        ++num1;
+        if (truncation.done(i, ra[i], rb[i])) break;
+
+    }
+
+    return num1;
+
+}
+
+/* The Mie coefficients for exactly NL layers */
+template <int NL>
+static void coefficients_layers (const complex<double> refrac_indx[],
+                                 const double rel_rad[],
+                                 const double size_param,
+                                 complex<double> ra[],
+                                 complex<double> rb[],
+                                 int *nterms,
+                                 const double tolerance
+                               )
+{
+
+    double xx[NL];
+    double ax = 1.0 / size_param;
+    xx[0] = size_param * rel_rad[0];
+    xx[NL-1] = size_param;
+    for (int i = 1; i < NL - 1; ++i) {
+        double sum = 0.0;
+        for (int j = 0; j < i + 1; ++j) { sum += rel_rad[j]; }
+        xx[i] = size_param * sum;
+    }
+
+    /* d1(x), rd3(x), rc(x) */
+    int num = series_terms(size_param, tolerance);
+
+    SeriesArray<double> d1x(num);
+    aax(ax, num, d1x);
+    SeriesArray< complex<double> > rd3x(num), rcx(num);
+    cd3x(size_param, num, d1x, rd3x, rcx);
+
+    /* rd11(m_1*x_1) */
+    SeriesArray< complex<double> > rd11(num);
+    aa1(refrac_indx[0]*xx[0], num, rd11);
+
+    /* The ratios of each shell, interleaved by order */
+    const int ns = Shells<NL>::n;
+    SeriesArray<Shell, MAXNUM * Shells<NL>::n> shell(num * ns);
+    for (int j = 1; j < NL; ++j) {
+
+        SeriesArray< complex<double> > rd1(num), rd3(num);
+        SeriesArray< complex<double> > sd1(num), sd3(num), rq(num);
+
+        /* rd1, rd3 at m_j*x_j-1, sd1, sd3 at m_j*x_j, and rq */
+        shell_ratios(refrac_indx[j]*xx[j-1], refrac_indx[j]*xx[j], num,
+                     rd1, rd3, sd1, sd3, rq);
+        for (int i = 0; i < num; ++i) {
+            Shell& sh = shell[i * ns + j - 1];
+            sh.rd1 = rd1[i];
+            sh.rd3 = rd3[i];
+            sh.sd1 = sd1[i];
+            sh.sd3 = sd3[i];
+            sh.rq  = rq[i];
+        }
+
+    }
+
+    SeriesTruncation truncation(size_param, tolerance);
+    *nterms = abn1_layers<NL>(refrac_indx, num, shell,
+                              rd11, rd3x, rcx, d1x, ra, rb, truncation);
+    NPSPEC_ORDER(num, *nterms);
+
+}
+
+/**************************************************************
+ * Mie coefficients of a particle much smaller than the wavelength,
+ *   from their expansions in the size parameter x (Bohren &
+ *   Huffman, Eq. 5.6).  For a homogeneous sphere a(1), b(1) and
+ *   a(2) are kept to their leading correction in x^2; for a
+ *   layered sphere only the dipole a(1) is kept, using the
+ *   quasistatic polarizability of the concentric layers.  Each
+ *   term t is written as -i t / (1 - i t), which adds the
+ *   radiative reaction and keeps |a|^2 <= Re(a) for a lossless
+ *   particle.
+ **************************************************************/
+
+static inline complex<double> radiative(const complex<double> t) {
+    return -I * t / ( 1.0 - I * t );
+}
+
+/* The dielectric of the homogeneous sphere with the same quasistatic
+   polarizability as the layers, folded from the inside out.  As in the
+   full solver the outermost radius is always 1. */
+static complex<double> effective_dielectric (const int nlayers,
+                                             const complex<double> refrac_indx[],
+                                             const double rel_rad[]
+                                           )
+{
+    complex<double> eps = sqr(refrac_indx[0]);
+    double r = rel_rad[0];
+    for (int i = 1; i < nlayers; ++i) {
+        double rout = i == nlayers - 1 ? 1.0 : r + rel_rad[i];
+        double f = r * r * r / ( rout * rout * rout );
+        complex<double> e = sqr(refrac_indx[i]);
+        eps = e * ( eps + 2.0 * e + 2.0 * f * ( eps - e ) )
+                / ( eps + 2.0 * e - f * ( eps - e ) );
+        r = rout;
+    }
+    return eps;
+}
+
+void mie_rayleigh (const int nlayers,                   /* Number of layers */
+                   const complex<double> refrac_indx[], /* Refractive index of layers */
+                   const double rel_rad[],              /* Relative radii of layers */
+                   const double size_param,             /* Size parameter */
+                   complex<double> ra[],                /* a(n) */
+                   complex<double> rb[],                /* b(n) */
+                   int *nterms                          /* Number of a(n), b(n) */
+                 )
+{
+
+    double x2 = sqr(size_param);
+    double x3 = x2 * size_param;
+    double x5 = x3 * x2;
+
+    for (int i = 0; i < 3; ++i)
+        ra[i] = rb[i] = complex<double>(0.0, 0.0);
+
+    if (nlayers == 1) {
+        complex<double> m2 = sqr(refrac_indx[0]);
+        complex<double> g = ( m2 - 1.0 ) / ( m2 + 2.0 );
+        ra[0] = radiative(2.0 / 3.0 * x3 * g
+                          * ( 1.0 + 0.6 * x2 * ( m2 - 2.0 ) / ( m2 + 2.0 ) ));
+        rb[0] = radiative(x5 / 45.0 * ( m2 - 1.0 ));
+        ra[1] = radiative(x5 / 15.0 * ( m2 - 1.0 ) / ( 2.0 * m2 + 3.0 ));
+        *nterms = 3;
+    } else {
+        complex<double> eps = effective_dielectric(nlayers, refrac_indx,
+                                                   rel_rad);
+        ra[0] = radiative(2.0 / 3.0 * x3 * ( eps - 1.0 ) / ( eps + 2.0 ));
+        *nterms = 2;
+    }
+
+}
+
+/* The series in place of the full solver when it is accurate to the
+   tolerance (see SMALLX_TOLERANCE).  Returns false if the particle is
+   too large. */
+static bool small_coefficients (const int nlayers,
+                                const complex<double> refrac_indx[],
+                                const double rel_rad[],
+                                const double size_param,
+                                const double tolerance,
+                                complex<double> ra[],
+                                complex<double> rb[],
+                                int *nterms
+                              )
+{
+
+    /* Materials without data at this wavelength have a zero (or NaN)
+       index; leave those to the full solver as before */
+    double mmax = 0.0;
+    for (int i = 0; i < nlayers; ++i) {
+        double m = abs(refrac_indx[i]);
+        if (!( m > 0.0 ))
+            return false;
+        mmax = max(mmax, m);
+    }
+    if (SMALLX_BOUND * sqr(sqr(mmax * size_param)) > tolerance)
+        return false;
+
+    if (nlayers == 1) {
+        complex<double> eps = sqr(refrac_indx[0]);
+        double c = 0.6 * sqr(size_param) * abs(eps - 2.0) / abs(eps + 2.0);
+        if (SMALLX_BOUND * sqr(c) > tolerance)
+            return false;
+        mie_rayleigh(nlayers, refrac_indx, rel_rad, size_param, ra, rb, nterms);
+        return true;
+    }
+
+    /* The series of a layered sphere is only the dipole, so instead the
+       first orders are found exactly, if the rest are negligible */
+    const int num = SMALLX_ORDERS;
+    double d1x[SMALLX_ORDERS];
+    aax(1.0 / size_param, num, d1x);
+    complex<double> rd3x[SMALLX_ORDERS], rcx[SMALLX_ORDERS];
+    cd3x(size_param, num, d1x, rd3x, rcx);
+    complex<double> rd11[SMALLX_ORDERS];
+    aa1(refrac_indx[0]*size_param*rel_rad[0], num, rd11);
+    *nterms = abn1(nlayers, refrac_indx, rel_rad, size_param, num,
+                   rd11, rd3x, rcx, d1x, ra, rb, tolerance);
+    return *nterms < num;
+
+}
+
+/**************************************************************
+ * Efficiencies of the electrostatic dipole alone, with neither
+ *   retardation nor radiative reaction.  This is the
+ *   quasistatic approximation used for ellipsoids, applied to
+ *   the layered sphere.
+ **************************************************************/
+
+void mie_quasistatic (const int nlayers,                   /* Number of layers */
+                      const complex<double> refrac_indx[], /* Refractive index of layers */
+                      const double rel_rad[],              /* Relative radii of layers */
+                      const double size_param,             /* Size parameter */
+                      const int outputs,                   /* MieOutputs to calculate */
+                      double *extinct,                     /* Extinction */
+                      double *scat,                        /* Scattering */
+                      double *absorb,                      /* Absorption */
+                      double *backscat,                    /* Backscattering */
+                      double *rad_pressure,                /* Radiation pressure */
+                      double *albedo,                      /* Albedo */
+                      double *asymmetry                    /* Asymmetry */
+                    )
+{
+
+    complex<double> eps = effective_dielectric(nlayers, refrac_indx, rel_rad);
+    complex<double> g = ( eps - 1.0 ) / ( eps + 2.0 );
+    double sca = 8.0 / 3.0 * sqr(sqr(size_param)) * norm(g);
+    double ext = 4.0 * size_param * imag(g) + sca;
+
+    /* The dipole scatters symmetrically */
+    *extinct = outputs & ( MieExtinction | MieRadiationPressure ) ? ext : 0.0;
+    *scat = outputs & MieScattering ? sca : 0.0;
+    *backscat = outputs & MieBackscattering ? 1.5 * sca : 0.0;
+    *rad_pressure = outputs & MieRadiationPressure ? ext : 0.0;
+    derived_outputs(outputs, *extinct, *scat, *rad_pressure,
+                    absorb, albedo, asymmetry);
+
+}
+
+/**************************************************************
+ * The cheapest model of a sphere whose relative error in the
+ *   extinction and scattering is estimated to be within the
+ *   tolerance.  The error of the quasistatic dipole is taken
+ *   as twice its difference from the series, and that of the
+ *   series as the square of this, as each adds the next order
+ *   in x^2.  Neither may be less than the size of the leading
+ *   x^2 correction to the dipole, c, which grows near a
+ *   resonance, nor than (m x)^2 / 2 and (m x)^4 / 2 for the
+ *   higher multipoles.  The layered series only adds the
+ *   radiative reaction, so its error is c or (m x)^2 / 2.
+ *   These bounds were checked against the full solver for
+ *   metals, semiconductors and dielectrics up to m x = 3.
+ **************************************************************/
+
+SolverModel mie_model (const int nlayers,                   /* Number of layers */
+                       const complex<double> refrac_indx[], /* Refractive index of layers */
+                       const double rel_rad[],              /* Relative radii of layers */
+                       const double size_param,             /* Size parameter */
+                       const double tolerance               /* Relative accuracy wanted */
+                     )
+{
+
+    if (mie_asymptotic(size_param))
+        return ModelGeometric;
+
+    /* Without data for a layer only the full solver says so (with NaN) */
+    double mmax = 0.0;
+    for (int i = 0; i < nlayers; ++i) {
+        double m = abs(refrac_indx[i]);
+        if (!( m > 0.0 ))
+            return ModelMie;
+        mmax = max(mmax, m);
+    }
+    if (tolerance <= 0.0)
+        return ModelMie;
+
+    /* The effective dielectric hides the resonances of the shells, so
+       the bounds are widened for a layered sphere */
+    double k = nlayers == 1 ? 1.0 : 4.0;
+    double mx2 = k * sqr(mmax * size_param);
+
+    /* Too large for either, so don't bother with the finer estimates */
+    if (0.5 * ( nlayers == 1 ? sqr(mx2) : mx2 ) > tolerance)
+        return ModelMie;
+
+    double qext, qsca, rext, rsca, dum;
+    mie_quasistatic(nlayers, refrac_indx, rel_rad, size_param,
+                    MieExtinction | MieScattering,
+                    &qext, &qsca, &dum, &dum, &dum, &dum, &dum);
+    complex<double> ra[3], rb[3];
+    int nterms;
+    mie_rayleigh(nlayers, refrac_indx, rel_rad, size_param, ra, rb, &nterms);
+    mie_efficiencies(MieExtinction | MieScattering, size_param, nterms,
+                     ra, rb, &rext, &rsca, &dum, &dum, &dum, &dum, &dum);
+    double diff = max(abs(qext - rext) / rext, abs(qsca - rsca) / rsca);
+
+    complex<double> eps = effective_dielectric(nlayers, refrac_indx, rel_rad);
+    double c = k * 0.6 * sqr(size_param) * abs(eps - 2.0) / abs(eps + 2.0);
+
+    double quasi_error = max(max(2.0 * diff, 2.0 * c), 0.5 * mx2);
+    if (quasi_error <= tolerance)
+        return ModelQuasistatic;
+
+    double series_error = nlayers == 1
+                        ? max(max(4.0 * sqr(diff), 2.5 * sqr(c)), 0.5 * sqr(mx2))
+                        : max(2.0 * c, 0.5 * mx2);
+    if (series_error <= tolerance)
+        return ModelRayleigh;
+
+    return ModelMie;
+
+}
+
+/**************************************************************
+ * Is this sphere large enough for geometric optics?  Up to
+ *   GEOMETRIC_MINSIZE the series is summed, to at most MAXTERMS
+ *   terms, since below it geometric optics was not found within
+ *   5% of the series.  The recurrences inside the sphere are
+ *   seeded by continued fractions at the top order, so only the
+ *   size parameter sets the number of terms, whatever the index.
+ **************************************************************/
+
+bool mie_asymptotic (const double size_param)
+{
+    return size_param > GEOMETRIC_MINSIZE;
+}
+
+/**************************************************************
+ * Efficiencies of a sphere much larger than the wavelength from
+ *   geometric optics with a diffraction correction.
+ *   Extinction is 2 plus the edge term of the diffracted wave
+ *   (Nussenzveig & Wiscombe, Phys. Rev. Lett. 45, 1490, 1980).
+ *   Each ray entering the sphere at incidence angle theta is
+ *   partly reflected (Fresnel reflectance R), and the rest is
+ *   attenuated by T = exp(-alpha*d) across the chord d, summed
+ *   over every internal reflection.  These are averaged over the
+ *   cross section with weight cos(theta).  Reflected rays leave at
+ *   pi - 2*theta, transmitted rays at 2*(theta - theta_t), and the
+ *   diffracted wave straight ahead, which gives the radiation
+ *   pressure.  The backscattering is the normal reflectance.
+ *   A layered sphere reflects with the index of its outer layer and
+ *   absorbs with the volume average of the imaginary indices.
+ *   1 is returned outside the bounds where this was found within
+ *   5% of the series (see GEOMETRIC_MINSIZE).
+ **************************************************************/
+
+int mie_geometric (const int nlayers,                   /* Number of layers */
+                   const complex<double> refrac_indx[], /* Refractive index of layers */
+                   const double rel_rad[],              /* Relative radii of layers */
+                   const double size_param,             /* Size parameter */
+                   const int outputs,                   /* MieOutputs to calculate */
+                   double *extinct,                     /* Extinction */
+                   double *scat,                        /* Scattering */
+                   double *absorb,                      /* Absorption */
+                   double *backscat,                    /* Backscattering */
+                   double *rad_pressure,                /* Radiation pressure */
+                   double *albedo,                      /* Albedo */
+                   double *asymmetry                    /* Asymmetry */
+                  )
+{
+
+    NPSPEC_TIME(PhaseMie);
+
+    /* Surface index and volume averaged absorption index */
+    const complex<double> m = refrac_indx[nlayers-1];
+    double kappa = 0.0, r0 = 0.0;
+    for (int i = 0; i < nlayers; ++i) {
+        double r1 = i == nlayers - 1 ? 1.0 : r0 + rel_rad[i];
+        kappa += imag(refrac_indx[i]) * ( r1 * r1 * r1 - r0 * r0 * r0 );
+        r0 = r1;
+    }
+
+    /* Integrate over u = cos(theta) by Simpson's rule */
+    const int NSTEP = 64;
+    double qabs = 0.0, qref = 0.0, qtra = 0.0, fref = 0.0, ftra = 0.0;
+    for (int k = 0; k <= NSTEP; ++k) {
+        double u = static_cast<double>(k) / NSTEP;
+        double w = ( k == 0 || k == NSTEP ) ? 1.0 : ( k % 2 == 1 ? 4.0 : 2.0 );
+        w *= 2.0 * u / ( 3.0 * NSTEP );
+        double s2 = 1.0 - u * u;
+
+        /* Fresnel reflectance of unpolarized light */
+        complex<double> ct = sqrt(1.0 - s2 / ( m * m ));
+        double rs = norm(( u - m * ct ) / ( u + m * ct ));
+        double rp = norm(( m * u - ct ) / ( m * u + ct ));
+        double R = 0.5 * ( rs + rp );
+
+        /* Refraction angle of the ray inside.  Beyond the critical
+           angle of a sphere with n < 1 the ray is totally reflected. */
+        double cost = max(0.0, min(real(ct), 1.0));
+        double T = exp(-4.0 * kappa * size_param * cost);
+
+        /* At grazing incidence everything is reflected */
+        double a = 0.0, t = 0.0;
+        if (R < 1.0) {
+            a = ( 1.0 - R ) * ( 1.0 - T ) / ( 1.0 - R * T );
+            t = ( 1.0 - R ) * ( 1.0 - R ) * T / ( 1.0 - R * T );
+        }
+        double theta = acos(u);
+        double thetat = acos(cost);
+        qabs += w * a;
+        qref += w * R;
+        qtra += w * t;
+        fref += w * R * -cos(2.0 * theta);
+        /* Rays leaving directly, after one internal reflection (the
+           rainbow), and after more, which are taken to be isotropic */
+        double t1 = ( 1.0 - R ) * ( 1.0 - R ) * T;
+        double t2 = t1 * R * T;
+        ftra += w * ( t1 * cos(2.0 * ( theta - thetat ))
+                    - t2 * cos(2.0 * theta - 4.0 * thetat) );
+    }
+
+    double ext = 2.0 + 1.99239 * pow(size_param, -2.0 / 3.0);
+    double sca = ext - qabs;
+    /* Everything that is not reflected or transmitted is diffracted */
+    double gsca = ( sca - qref - qtra ) + fref + ftra;
+
+    *extinct = outputs & ( MieExtinction | MieRadiationPressure ) ? ext : 0.0;
+    *scat = outputs & MieScattering ? sca : 0.0;
+    *backscat = outputs & MieBackscattering
+              ? norm(( m - 1.0 ) / ( m + 1.0 )) : 0.0;
+    *rad_pressure = outputs & MieRadiationPressure ? ext - gsca : 0.0;
+    derived_outputs(outputs, *extinct, *scat, *rad_pressure,
+                    absorb, albedo, asymmetry);
+
+    /* Warn where it was not found to be accurate */
+    return size_param < GEOMETRIC_MINSIZE
+        || 2.0 * size_param * abs(m - 1.0) < GEOMETRIC_MINPHASE ? 1 : 0;
+
+}
 
 /****************************
  * The main Mie theory solver 
@@ -75,87 +743,500 @@ int mie (const int nlayers,                   /* Number of layers */
          double *backscat,                    /* Backscattering */
          double *rad_pressure,                /* Radiation pressure */
          double *albedo,                      /* Albedo */
-         double *asymmetry                    /* Asymmetry */
+         double *asymmetry,                   /* Asymmetry */
+         const int outputs                    /* MieOutputs to calculate */
         )
 {
 
-    /* Return code... normally 0, but 1 if outside of reasonable range */
-    int retcode = 0;
+    /* Too many terms for the series */
+    if (mie_asymptotic(size_param))
+        return mie_geometric(nlayers, refrac_indx, rel_rad, size_param,
+                             outputs, extinct, scat, absorb, backscat,
+                             rad_pressure, albedo, asymmetry);
 
-    double xx[MAXLAYERS];
-    double ax = 1.0 / size_param;
-    xx[0] = size_param * rel_rad[0];
-    xx[nlayers-1] = size_param;
-    for (int i = 1; i < nlayers - 1; ++i) {
-        double sum = 0.0;
-        for (int j = 0; j < i + 1; ++j) { sum += rel_rad[j]; }
-        xx[i] = size_param * sum;
+    SeriesArray< complex<double> > ra(nm(size_param)), rb(nm(size_param));
+    int nterms;
+    mie_coefficients(nlayers, refrac_indx, rel_rad, size_param,
+                     ra, rb, &nterms);
+    mie_efficiencies(outputs, size_param, nterms, ra, rb, extinct, scat,
+                     absorb, backscat, rad_pressure, albedo, asymmetry);
+    return 0;
+
+}
+
+/*******************************************************
+ * The Mie coefficients a(n), b(n) of a layered sphere.
+ *******************************************************/
+
+void mie_coefficients (const int nlayers,                   /* Number of layers */
+                       const complex<double> refrac_indx[], /* Refractive index of layers */
+                       const double rel_rad[],              /* Relative radii of layers */
+                       const double size_param,             /* Size parameter */
+                       complex<double> ra[],                /* a(n) */
+                       complex<double> rb[],                /* b(n) */
+                       int *nterms,                         /* Number of a(n), b(n) */
+                       const double tolerance               /* Relative truncation error */
+                     )
+{
+
+    NPSPEC_COUNT(MieCalls);
+    NPSPEC_TIME(PhaseMie);
+
+    /* The series would not fit; there are no coefficients */
+    if (mie_asymptotic(size_param)) {
+        *nterms = 0;
+        return;
     }
 
+    /* Particles much smaller than the wavelength need few or no
+       recurrences, if that is as accurate as asked for */
+    const double small_tolerance = tolerance > 0.0
+                                 ? min(tolerance, SMALLX_TOLERANCE)
+                                 : SMALLX_TOLERANCE;
+    if (small_coefficients(nlayers, refrac_indx, rel_rad, size_param,
+                           small_tolerance, ra, rb, nterms))
+        return;
+
+    /* Use a specialised kernel for the common numbers of layers */
+    switch (nlayers) {
+        case 1:
+            coefficients_layers<1>(refrac_indx, rel_rad, size_param,
+                                   ra, rb, nterms, tolerance);
+            return;
+        case 2:
+            coefficients_layers<2>(refrac_indx, rel_rad, size_param,
+                                   ra, rb, nterms, tolerance);
+            return;
+        case 3:
+            coefficients_layers<3>(refrac_indx, rel_rad, size_param,
+                                   ra, rb, nterms, tolerance);
+            return;
+    }
+
+    /* Otherwise, the generic path for any number of layers */
+    double ax = 1.0 / size_param;
+
     /* d1(x), rd3(x), rc(x) */
-    int num = nm(size_param);
+    int num = series_terms(size_param, tolerance);
 
-    double d1x[MAXNUM];
+    SeriesArray<double> d1x(num);
     aax(ax, num, d1x);
-    complex<double> rd3x[MAXNUM], rcx[MAXNUM];
+    SeriesArray< complex<double> > rd3x(num), rcx(num);
     cd3x(size_param, num, d1x, rd3x, rcx);
 
-    double ari = abs(refrac_indx[0]);
-    for (int i = 1; i < nlayers; ++i) {
-        double tmp = abs(refrac_indx[i]);
-        if (tmp > ari) ari = tmp;
+    /* rd11(m_1*x_1) */
+    SeriesArray< complex<double> > rd11(num);
+    aa1(refrac_indx[0]*size_param*rel_rad[0], num, rd11);
+
+    *nterms = abn1(nlayers, refrac_indx, rel_rad, size_param, num,
+                   rd11, rd3x, rcx, d1x, ra, rb, tolerance);
+    NPSPEC_ORDER(num, *nterms);
+
+}
+
+/**************************************************************
+ * A sphere whose refractive index varies continuously with the
+ *   radius.  The profile is divided into shells, each taking the
+ *   mean index over it by Simpson's rule, and the shells across
+ *   which the index changes most are halved until the extinction
+ *   and scattering change by less than the tolerance from one
+ *   division to the next.  Halving a shell reuses the samples at
+ *   its ends and middle.  The ratios of a shell depend only on its
+ *   own index and radii, so they are also kept between divisions
+ *   and only those of new shells are calculated; just the pass
+ *   carrying them out from the core is repeated.
+ **************************************************************/
+
+/* One shell of the profile, the index sampled at its inner radius,
+   middle and outer radius, and once calculated its ratios: rd1, rd3,
+   sd1, sd3 and rq one after the other, or rd11 for the core */
+struct ProfileShell {
+    ProfileShell() : r0(), r1(), p0(), pm(), p1(), m(), ratios() {}
+    double r0, r1;
+    complex<double> p0, pm, p1;
+    complex<double> m;
+    vector< complex<double> > ratios;
+};
+
+static void set_shell (ProfileShell& sh, const double r0, const double r1,
+                       const complex<double> p0, const complex<double> pm,
+                       const complex<double> p1)
+{
+    sh.r0 = r0;
+    sh.r1 = r1;
+    sh.p0 = p0;
+    sh.pm = pm;
+    sh.p1 = p1;
+    sh.m  = ( p0 + 4.0 * pm + p1 ) / 6.0;
+}
+
+/* The Mie coefficients of the shells as they stand */
+static int profile_coefficients (vector<ProfileShell>& shells,
+                                 const double size_param,
+                                 const int num,
+                                 const complex<double> rd3x[],
+                                 const complex<double> rcx[],
+                                 const double d1x[],
+                                 complex<double> ra[],
+                                 complex<double> rb[]
+                               )
+{
+
+    ProfileShell& core = shells[0];
+    if (core.ratios.empty()) {
+        core.ratios.resize(num);
+        aa1(core.m * size_param * core.r1, num, &core.ratios[0]);
+    }
+    SeriesArray< complex<double> > sha(num), shb(num);
+    for (int i = 0; i < num; ++i)
+        sha[i] = shb[i] = core.ratios[i];
+
+    for (size_t j = 1; j < shells.size(); ++j) {
+        ProfileShell& sh = shells[j];
+        if (sh.ratios.empty()) {
+            sh.ratios.resize(5 * num);
+            complex<double> *r = &sh.ratios[0];
+            shell_ratios(sh.m * size_param * sh.r0, sh.m * size_param * sh.r1,
+                         num, r, r + num, r + 2*num, r + 3*num, r + 4*num);
+        }
+        const complex<double> *r = &sh.ratios[0];
+        fold_shell(shells[j-1].m, sh.m, num, r, r + num, r + 2*num,
+                   r + 3*num, r + 4*num, sha, shb);
     }
-    int num2 = nm(ari*size_param);
 
-    /* rd11(m_1*x_1) */
-    if (imag(refrac_indx[0]) * xx[0] > 20.0) {
-        /* k*x > 20 AIMAG(refrac_indx(1)) * xx(1) */
-        retcode = 1;
-    }
-    complex<double> rd11[MAXNUM];
-    aa1(refrac_indx[0]*xx[0], num2, rd11);
-
-    complex<double> rbb[MAXNUM], rd1[MAXNUM], rd2[MAXNUM];
-    complex<double> rrbb[MAXLAYERS][MAXNUM], rrd1[MAXLAYERS][MAXNUM];
-    complex<double> rrd2[MAXLAYERS][MAXNUM], srbb[MAXLAYERS][MAXNUM];
-    complex<double> srd1[MAXLAYERS][MAXNUM], srd2[MAXLAYERS][MAXNUM];
-    for (int i = 1; i < nlayers; i++) {
-
-        /* rd1(m_i*x_i-1), rd2(m_i*x_i-1), rbb(m_i*x_i-1), rcc(m_i*x_i-1) */
-        if (imag(refrac_indx[i]) * xx[i-1] > 20.0) {
-            /* k*x > 20 AIMAG(refrac_indx(i))*xx(i-1) */
-            retcode = 1;
+    return outer_coefficients(shells.back().m, size_param, num, sha, shb,
+                              rd3x, rcx, d1x, ra, rb, 0.0);
+
+}
+
+/* The shells of a profile too large for the series, by geometric
+   optics */
+static int profile_geometric (const vector<ProfileShell>& shells,
+                              const double size_param,
+                              const int outputs,
+                              double *extinct, double *scat, double *absorb,
+                              double *backscat, double *rad_pressure,
+                              double *albedo, double *asymmetry
+                            )
+{
+
+    const int n = static_cast<int>(shells.size());
+    vector< complex<double> > refrac_indx(n);
+    vector<double> rel_rad(n);
+    for (int j = 0; j < n; ++j) {
+        refrac_indx[j] = shells[j].m;
+        rel_rad[j] = shells[j].r1 - shells[j].r0;
+    }
+    return mie_geometric(n, &refrac_indx[0], &rel_rad[0], size_param, outputs,
+                         extinct, scat, absorb, backscat, rad_pressure,
+                         albedo, asymmetry);
+
+}
+
+int mie_profile (const IndexProfile profile,          /* Index at a relative radius */
+                 void *data,                          /* Passed on to profile */
+                 const double size_param,             /* Size parameter */
+                 const double tolerance,              /* Relative change to stop at */
+                 const int outputs,                   /* MieOutputs to calculate */
+                 double *extinct,                     /* Extinction */
+                 double *scat,                        /* Scattering */
+                 double *absorb,                      /* Absorption */
+                 double *backscat,                    /* Backscattering */
+                 double *rad_pressure,                /* Radiation pressure */
+                 double *albedo,                      /* Albedo */
+                 double *asymmetry,                   /* Asymmetry */
+                 int *nshells                         /* Number of shells used */
+               )
+{
+
+    NPSPEC_COUNT(MieCalls);
+    NPSPEC_TIME(PhaseMie);
+
+    /* Start from equal shells */
+    vector<ProfileShell> shells(PROFILE_SHELLS);
+    complex<double> p0 = profile(0.0, data);
+    for (int j = 0; j < PROFILE_SHELLS; ++j) {
+        double r0 = static_cast<double>(j) / PROFILE_SHELLS;
+        double r1 = static_cast<double>(j + 1) / PROFILE_SHELLS;
+        complex<double> p1 = profile(r1, data);
+        set_shell(shells[j], r0, r1, p0, profile(0.5 * ( r0 + r1 ), data), p1);
+        p0 = p1;
+    }
+    *nshells = PROFILE_SHELLS;
+
+    /* Too many terms for the series, however finely divided */
+    if (mie_asymptotic(size_param))
+        return profile_geometric(shells, size_param, outputs, extinct, scat,
+                                 absorb, backscat, rad_pressure, albedo,
+                                 asymmetry);
+
+    /* d1(x), rd3(x), rc(x) are the same for every division */
+    int num = nm(size_param);
+    SeriesArray<double> d1x(num);
+    aax(1.0 / size_param, num, d1x);
+    SeriesArray< complex<double> > rd3x(num), rcx(num);
+    cd3x(size_param, num, d1x, rd3x, rcx);
+
+    SeriesArray< complex<double> > ra(num), rb(num);
+    int nterms = profile_coefficients(shells, size_param, num,
+                                      rd3x, rcx, d1x, ra, rb);
+    double ext, sca, bak, pre;
+    qq1_select(MieExtinction | MieScattering, 1.0 / size_param, nterms,
+               &ext, &sca, &bak, &pre, ra, rb);
+
+    /* The change from one division to the next can be small by chance
+       when the errors on either side of it cancel, so two in a row
+       must be within a quarter of the tolerance.  Over smooth, graded
+       and stepped profiles this left errors of at most 0.7 of it. */
+    int retcode = 0;
+    bool settled = false;
+    for (;;) {
+
+        /* The error of each shell, from the square of the change of
+           the index across it times its width.  A sphere of one index
+           is already exact. */
+        const int n = static_cast<int>(shells.size());
+        vector<double> change(n, 0.0);
+        double cmax = 0.0;
+        for (int j = 0; j < n; ++j) {
+            const ProfileShell& sh = shells[j];
+            double dm = max(abs(sh.pm - sh.p0), abs(sh.p1 - sh.pm));
+            change[j] = sqr(dm) * ( sh.r1 - sh.r0 );
+            cmax = max(cmax, change[j]);
         }
-        bcd(refrac_indx[i]*xx[i-1], num2, rd1, rd2, rbb);
-        for (int j = 0; j < num2; ++j) {
-            rrbb[i][j] = rbb[j];
-            rrd1[i][j] = rd1[j];
-            rrd2[i][j] = rd2[j];
+        if (cmax == 0.0)
+            break;
+
+        /* Halve the shells with at least half the largest error */
+        int nsplit = 0;
+        for (int j = 0; j < n; ++j)
+            if (change[j] >= 0.5 * cmax) ++nsplit;
+        if (n + nsplit > PROFILE_MAXSHELLS) {
+            if (tolerance > 0.0)
+                retcode = 1;
+            break;
         }
-
-        /* rd1(m_i*x_i), rd2(m_i*x_i), rbb(m_i*x_i), rcc(m_i*x_i) */
-        if (imag(refrac_indx[i]) * xx[i] > 20.0) {
-            /* k*x > 20 AIMAG(refrac_indx(i))*xx(i) */
-            retcode = 1;
+        vector<ProfileShell> refined(n + nsplit);
+        for (int j = 0, k = 0; j < n; ++j) {
+            const ProfileShell& sh = shells[j];
+            if (change[j] < 0.5 * cmax) {
+                set_shell(refined[k], sh.r0, sh.r1, sh.p0, sh.pm, sh.p1);
+                refined[k++].ratios.swap(shells[j].ratios);
+                continue;
+            }
+            double rm = 0.5 * ( sh.r0 + sh.r1 );
+            set_shell(refined[k++], sh.r0, rm, sh.p0,
+                      profile(0.5 * ( sh.r0 + rm ), data), sh.pm);
+            set_shell(refined[k++], rm, sh.r1, sh.pm,
+                      profile(0.5 * ( rm + sh.r1 ), data), sh.p1);
         }
-        bcd(refrac_indx[i]*xx[i], num2, rd1, rd2, rbb);
-        for (int j = 0; j < num2; ++j) {
-            srbb[i][j] = rbb[j];
-            srd1[i][j] = rd1[j];
-            srd2[i][j] = rd2[j];
+        shells.swap(refined);
+        *nshells = static_cast<int>(shells.size());
+
+        nterms = profile_coefficients(shells, size_param, num,
+                                      rd3x, rcx, d1x, ra, rb);
+        double ext1, sca1;
+        qq1_select(MieExtinction | MieScattering, 1.0 / size_param, nterms,
+                   &ext1, &sca1, &bak, &pre, ra, rb);
+        bool close = abs(ext1 - ext) <= 0.25 * tolerance * abs(ext1)
+                  && abs(sca1 - sca) <= 0.25 * tolerance * abs(sca1);
+        ext = ext1;
+        sca = sca1;
+        if (close && settled)
+            break;
+        settled = close;
+
+    }
+
+    NPSPEC_ORDER(num, nterms);
+    mie_efficiencies(outputs, size_param, nterms, ra, rb, extinct, scat,
+                     absorb, backscat, rad_pressure, albedo, asymmetry);
+    return retcode;
+
+}
+
+/**************************************************************
+ * The efficiency factors from the Mie coefficients.  Only the
+ * MieOutputs asked for are calculated.
+ **************************************************************/
+
+void mie_efficiencies (const int outputs,              /* MieOutputs to calculate */
+                       const double size_param,        /* Size parameter */
+                       const int nterms,               /* Number of a(n), b(n) */
+                       const complex<double> ra[],     /* a(n) */
+                       const complex<double> rb[],     /* b(n) */
+                       double *extinct,                /* Extinction */
+                       double *scat,                   /* Scattering */
+                       double *absorb,                 /* Absorption */
+                       double *backscat,               /* Backscattering */
+                       double *rad_pressure,           /* Radiation pressure */
+                       double *albedo,                 /* Albedo */
+                       double *asymmetry               /* Asymmetry */
+                     )
+{
+
+    NPSPEC_TIME(PhaseMie);
+
+    double ax = 1.0 / size_param;
+    qq1_select(outputs, ax, nterms, extinct, scat, backscat, rad_pressure,
+               ra, rb);
+    derived_outputs(outputs, *extinct, *scat, *rad_pressure,
+                    absorb, albedo, asymmetry);
+
+}
+
+/**************************************************************
+ * The contribution of each electric (a(n)) and magnetic (b(n))
+ * multipole to the extinction and scattering efficiencies.  These
+ * are the terms of the QQ1 series, so summed over every order they
+ * give the totals.  Outputs may be NULL if not wanted.
+ **************************************************************/
+
+void mie_multipoles (const double size_param,        /* Size parameter */
+                     const int nterms,               /* Number of a(n), b(n) */
+                     const complex<double> ra[],     /* a(n) */
+                     const complex<double> rb[],     /* b(n) */
+                     const int norders,              /* Number of orders */
+                     double ext_electric[],          /* Extinction of a(n) */
+                     double ext_magnetic[],          /* Extinction of b(n) */
+                     double sca_electric[],          /* Scattering of a(n) */
+                     double sca_magnetic[]           /* Scattering of b(n) */
+                   )
+{
+
+    double b = 2.0 * sqr(1.0 / size_param);
+
+    for (int i = 0; i < norders; ++i) {
+        double ee = 0.0, em = 0.0, se = 0.0, sm = 0.0;
+        /* Same truncation as QQ1 */
+        if (i < nterms - 1) {
+            double nd = static_cast<double>(2 * i + 3);
+            ee = b * nd * real(ra[i]);
+            em = b * nd * real(rb[i]);
+            se = b * nd * norm(ra[i]);
+            sm = b * nd * norm(rb[i]);
         }
+        if (ext_electric) ext_electric[i] = ee;
+        if (ext_magnetic) ext_magnetic[i] = em;
+        if (sca_electric) sca_electric[i] = se;
+        if (sca_magnetic) sca_magnetic[i] = sm;
     }
 
-    complex<double> ra[MAXNUM], rb[MAXNUM];
-    int num1 = abn1(nlayers, refrac_indx, num, rrbb, rrd1, rrd2,
-                    srbb, srd1, srd2, rd11, rd3x, rcx, d1x, ra, rb);
-    qq1(ax, num1, extinct, scat, backscat, rad_pressure, ra, rb);
+}
 
-    *absorb = *extinct - *scat;
-    *albedo = *scat / *extinct;
-    *asymmetry = ( *extinct - *rad_pressure ) / *scat;
+/**************************************************************
+ * The near-field intensity enhancement |E|^2/|E0|^2 averaged over
+ * the outer surface of the sphere (Messinger et al., Phys. Rev. B
+ * 24, 649, 1981).  The spherical Bessel functions j(n) are found
+ * by upward recurrence of the downward continued-fraction ratios
+ * j(n)/j(n-1), and y(n) by upward recurrence, which are both
+ * stable.  The ratios are scaled by the larger of j(0) and j(1).  The outer radius is at the size parameter.
+ **************************************************************/
+
+double mie_nearfield (const double size_param,     /* Size parameter */
+                      const int nterms,            /* Number of a(n), b(n) */
+                      const complex<double> ra[],  /* a(n) */
+                      const complex<double> rb[]   /* b(n) */
+                    )
+{
 
-    return retcode;
+    const double x = size_param;
+    const int nmax = nterms + 1;
+
+    /* Ratios j(n)/j(n-1), started well past the last order */
+    vector<double> jn(nmax + 1), yn(nmax + 1);
+    double ratio = 0.0;
+    for (int n = nmax + 16 + static_cast<int>(x); n > nmax; --n)
+        ratio = x / ( 2 * n + 1 - x * ratio );
+    for (int n = nmax; n > 0; --n) {
+        ratio = x / ( 2 * n + 1 - x * ratio );
+        jn[n] = ratio;
+    }
+    /* Scaled from whichever of j(0) and j(1) is larger, since either
+       vanishes at some x (j(0) at x = n pi) and is then only rounding */
+    const double j0 = sin(x) / x;
+    const double j1 = j0 / x - cos(x) / x;
+    if (fabs(j0) >= fabs(j1)) {
+        jn[0] = j0;
+        jn[1] *= j0;
+    } else {
+        jn[0] = j1 / jn[1];
+        jn[1] = j1;
+    }
+    for (int n = 2; n <= nmax; ++n)
+        jn[n] *= jn[n-1];
+
+    yn[0] = -cos(x) / x;
+    if (nmax > 0)
+        yn[1] = yn[0] / x - sin(x) / x;
+    for (int n = 1; n < nmax; ++n)
+        yn[n+1] = ( 2 * n + 1 ) / x * yn[n] - yn[n-1];
+
+    /* Sum over orders; the incident field is j(n), the scattered h(n) */
+    double sum = 0.0;
+    for (int i = 0; i < nterms; ++i) {
+        int n = i + 1;
+        complex<double> hm(jn[n-1], yn[n-1]);
+        complex<double> h0(jn[n], yn[n]);
+        complex<double> hp(jn[n+1], yn[n+1]);
+        sum += ( 2 * n + 1 ) * norm(jn[n] - rb[i] * h0)
+             + ( n + 1 ) * norm(jn[n-1] - ra[i] * hm)
+             + n * norm(jn[n+1] - ra[i] * hp);
+    }
+
+    return 0.5 * sum;
+
+}
+
+/***********************************************************************
+ * The scattering amplitudes S1 and S2 from the Mie coefficients for a
+ *   whole grid of angles at once (Bohren & Huffman, Eq. 4.74).
+ *   The angular functions pi(n) and tau(n) are found by upward
+ *   recurrence, with the order in the outer loop and the angles in
+ *   the inner loop so that the inner loops run over contiguous arrays.
+ *   mu - cosines of the scattering angles
+ ***********************************************************************/
+
+void mie_angular (const int nterms,             /* Number of a(n), b(n) */
+                  const complex<double> ra[],   /* a(n) */
+                  const complex<double> rb[],   /* b(n) */
+                  const int nangles,            /* Number of angles */
+                  const double mu[],            /* Cosine of each angle */
+                  complex<double> s1[],         /* S1 at each angle */
+                  complex<double> s2[]          /* S2 at each angle */
+                )
+{
+
+    NPSPEC_TIME(PhaseMie);
+
+    /* pi(n-1), pi(n) and the real and imaginary parts of the sums */
+    vector<double> pi0(nangles, 0.0), pi1(nangles, 1.0);
+    vector<double> s1r(nangles, 0.0), s1i(nangles, 0.0);
+    vector<double> s2r(nangles, 0.0), s2i(nangles, 0.0);
+
+    for (int i = 0; i < nterms; ++i) {
+        double n = static_cast<double>(i + 1);
+        double c = ( 2.0 * n + 1.0 ) / ( n * ( n + 1.0 ) );
+        double ar = c * real(ra[i]), ai = c * imag(ra[i]);
+        double br = c * real(rb[i]), bi = c * imag(rb[i]);
+        double p1 = ( 2.0 * n + 1.0 ) / n;
+        double p0 = ( n + 1.0 ) / n;
+        for (int k = 0; k < nangles; ++k) {
+            double pi = pi1[k];
+            double tau = n * mu[k] * pi - ( n + 1.0 ) * pi0[k];
+            s1r[k] += ar * pi + br * tau;
+            s1i[k] += ai * pi + bi * tau;
+            s2r[k] += ar * tau + br * pi;
+            s2i[k] += ai * tau + bi * pi;
+            pi1[k] = p1 * mu[k] * pi - p0 * pi0[k];
+            pi0[k] = pi;
+        }
+    }
+
+    for (int k = 0; k < nangles; ++k) {
+        s1[k] = complex<double>(s1r[k], s1i[k]);
+        s2[k] = complex<double>(s2r[k], s2i[k]);
+    }
 
 }
 
@@ -182,12 +1263,51 @@ int nm(const double x) {
 
 }
 
+/****************************************************************
+ * The logarithmic derivative D(N) = psi'(N)/psi(N) at the top
+ *   order of the downward recurrences, from its continued
+ *   fraction (Lentz, Appl. Opt. 15, 668, 1976),
+ *   D(N) = -N/z + J(N-1/2)/J(N+1/2), where the ratio is
+ *   a(1) + 1/(a(2) + 1/(a(3) + ...)) with
+ *   a(k) = (-1)^(k+1) (2N+2k-1)/z.  This is evaluated with the
+ *   modified Lentz method of Thompson & Barnett (J. Comput. Phys.
+ *   64, 490, 1986), so the recurrence can start at the order
+ *   needed instead of relying on a crude start being forgotten.
+ ****************************************************************/
+
+template <typename T>
+static T lentz (const int n, const T z) {
+
+    const double tiny = 1E-300;
+    const T s = 1.0 / z;
+    T f = double( 2 * n + 1 ) * s;
+    T c = f;
+    T d = 0.0;
+    double sign = -1.0;
+    for (int k = 2; k < 100000; ++k) {
+        T a = sign * double( 2 * ( n + k ) - 1 ) * s;
+        sign = -sign;
+        d = a + d;
+        if (d == T(0.0)) d = tiny;
+        c = a + 1.0 / c;
+        if (c == T(0.0)) c = tiny;
+        d = 1.0 / d;
+        T delta = c * d;
+        f *= delta;
+        /* Written so that a NaN from missing data also stops it */
+        if (!( abs(delta - 1.0) >= 1E-16 )) break;
+    }
+    return f - double(n) * s;
+
+}
+
 /****************************************************************
  * AA1-subroutine for calculations of the ratio of the derivative
  *   to the function for Bessel functions of half order with
  *   the complex argument: J'(N)/J(N).
  *   The calculations are given by the recursive expression
- *   ``from top to bottom'' beginning from N=NUM.
+ *   ``from top to bottom'' beginning from N=NUM, where the
+ *   value is found from its continued fraction.
  *   RU-array of results.
  *   A=1/X (X=2*PI*A(particle radius)/LAMBDA - size parameter).
  *   RI - complex refractive index.
@@ -197,7 +1317,7 @@ void aa1 (const complex<double> rx, const int num, complex<double> ru[]) {
 
     complex<double> s = 1.0 / rx;
     int num1 = num - 1;
-    ru[num1] = double( num + 1 ) * s;
+    ru[num1] = lentz(num, rx);
     
     for (int j = 0; j < num1; ++j) {
         int i = num - ( j + 1 );
@@ -213,7 +1333,8 @@ void aa1 (const complex<double> rx, const int num, complex<double> ru[]) {
  *   to the function for Bessel functions of half order with
  *   the real argument: J'(N)/J(N).
  *   The calculations are given by the recursive expression
- *   ``from top to bottom'' beginning from N=NUM.
+ *   ``from top to bottom'' beginning from N=NUM, where the
+ *   value is found from its continued fraction.
  *   RU-array of results.
  *   A=1/X (X=2*PI*A(particle radius)/LAMBDA - size parameter).
  * March 1999, AI SPbU
@@ -221,7 +1342,7 @@ void aa1 (const complex<double> rx, const int num, complex<double> ru[]) {
 void aax (const double a, const int num, double ru[]) {
 
     int num1 = num - 1;
-    ru[num1] = double( num + 1 ) * a;
+    ru[num1] = lentz(num, 1.0 / a);
 
     for (int j = 0; j < num1; ++j) {
         int i = num - ( j + 1 );
@@ -238,108 +1359,81 @@ void aax (const double a, const int num, double ru[]) {
  *   nlayers - number of layers
  *   refrac_indx(i) - complex refractive indices for innermost layer (1),
  *   layer2, ... (i = 1, nlayers)
+ *   rel_rad(i) - relative thickness of each layer
+ *   RD11 - psi'/psi of the core.
+ *   The layers are passed through one at a time, carrying psi'/psi
+ *   of everything inside out to each radius for every order at once,
+ *   so only the ratios of the current shell are held and the memory
+ *   does not grow with the number of layers.
  *   The coefficients are calculated up to the number NUM1.LE.NUM,
- *   for which |A(N)**2+B(N)**2|.LE.10**(-40)
+ *   for which |A(N)**2+B(N)**2|.LE.10**(-40), or if a tolerance
+ *   is given, where the series has converged to it
+ *   (see SeriesTruncation)
  *   RA-array of coefficients A(N), RB-array of coefficients B(N)
  * March 1999, AI SPbU
  ************************************************************************/
 int abn1 (const int nlayers,
           const complex<double> refrac_indx[],
+          const double rel_rad[],
+          const double size_param,
           const int num,
-          complex<double> rrbb[][MAXNUM],
-          complex<double> rrd1[][MAXNUM],
-          complex<double> rrd2[][MAXNUM],
-          complex<double> srbb[][MAXNUM],
-          complex<double> srd1[][MAXNUM],
-          complex<double> srd2[][MAXNUM],
           complex<double> rd11[],
           complex<double> rd3x[],
           complex<double> rcx[],
           double d1x[],
           complex<double> ra[],
-          complex<double> rb[]
+          complex<double> rb[],
+          const double tolerance
         )
 {
 
-    complex<double> sa[MAXLAYERS];
-    complex<double> sha[MAXLAYERS];
-    complex<double> sb[MAXLAYERS];
-    complex<double> shb[MAXLAYERS];
+    /* psi'/psi of the sphere inside each radius for the a(n) and b(n)
+       boundary conditions, which begin equal at the core */
+    SeriesArray< complex<double> > sha(num), shb(num);
+    for (int i = 0; i < num; ++i)
+        sha[i] = shb[i] = rd11[i];
 
-    int num1 = 0;
-    for (int i = 0; i < num; ++i) {
+    double sum = rel_rad[0];
+    double x0 = size_param * sum;
+    for (int j = 1; j < nlayers; ++j) {
 
-        sa[0]  = complex<double>(0.0, 0.0);
-        sb[0]  = complex<double>(0.0, 0.0);
-        sha[0] = rd11[i];
-        shb[0] = rd11[i];
+        sum += rel_rad[j];
+        double x1 = j < nlayers - 1 ? size_param * sum : size_param;
 
-        for (int j = 1; j < nlayers; ++j) {
+        const complex<double> m0 = refrac_indx[j-1];
+        const complex<double> m1 = refrac_indx[j];
+        SeriesArray< complex<double> > rd1(num), rd3(num);
+        SeriesArray< complex<double> > sd1(num), sd3(num), rq(num);
+        shell_ratios(m1 * x0, m1 * x1, num, rd1, rd3, sd1, sd3, rq);
+        fold_shell(m0, m1, num, rd1, rd3, sd1, sd3, rq, sha, shb);
 
-            if (abs(refrac_indx[j]*sha[j-1]-refrac_indx[j-1]*rrd2[j][i]) == 0.0) {
-                sa[j] = rrbb[j][i] * ( refrac_indx[j] * sha[j-1] - refrac_indx[j-1] * rrd1[j][i] )
-                      / ( refrac_indx[j] * sha[j-1] - refrac_indx[j-1] * rrd2[j][i] + 1E-30 );
-            } else {
-                sa[j] = rrbb[j][i] * ( refrac_indx[j] * sha[j-1] - refrac_indx[j-1] * rrd1[j][i] )
-                      / ( refrac_indx[j] * sha[j-1] - refrac_indx[j-1] * rrd2[j][i] );
-            }
-
-            if (abs(refrac_indx[j]*shb[j-1]-refrac_indx[j-1]*rrd2[j][i]) == 0.0) {
-                sb[j] = rrbb[j][i] * ( refrac_indx[j-1] * shb[j-1] - refrac_indx[j] * rrd1[j][i] )
-                      / ( refrac_indx[j-1] * shb[j-1] - refrac_indx[j] * rrd2[j][i] + 1E-30 );
-            } else {
-                sb[j] = rrbb[j][i] * ( refrac_indx[j-1] * shb[j-1] - refrac_indx[j] * rrd1[j][i] )
-                      / ( refrac_indx[j-1] * shb[j-1] - refrac_indx[j] * rrd2[j][i] );
-            }
-
-            if (abs(srbb[j][i] - sa[j]) == 0.0) {
-                sha[j] = srbb[j][i] * srd1[j][i] / ( srbb[j][i] - sa[j] )
-                       - sa[j] * srd2[j][i] / ( srbb[j][i] - sa[j] + 1E-30 );
-            } else {
-                sha[j] = srbb[j][i] * srd1[j][i] / ( srbb[j][i] - sa[j] )
-                       - sa[j] * srd2[j][i] / ( srbb[j][i] - sa[j] );
-            }
-
-            if (abs(srbb[j][i] - sb[j]) == 0.0) {
-                shb[j] = srbb[j][i] * srd1[j][i] / ( srbb[j][i] - sb[j])
-                       - sb[j] * srd2[j][i] / ( srbb[j][i] - sb[j] + 1E-30 );
-            } else {
-                shb[j] = srbb[j][i] * srd1[j][i] / ( srbb[j][i] - sb[j] )
-                       - sb[j] * srd2[j][i] / ( srbb[j][i] - sb[j] );
-            }
-
-        }
-
-        /* calculations of a(n), b(n) */
-        ra[i] = rcx[i] * ( sha[nlayers-1] - refrac_indx[nlayers-1] *  d1x[i] ) /
-                         ( sha[nlayers-1] - refrac_indx[nlayers-1] * rd3x[i] );
-
-        rb[i] = rcx[i] * ( refrac_indx[nlayers-1] * shb[nlayers-1] -  d1x[i] ) /
-                         ( refrac_indx[nlayers-1] * shb[nlayers-1] - rd3x[i] );
-
-        ++num1;
-        if (abs(ra[i]) + abs(rb[i]) < 1E-40) break;
+        x0 = x1;
 
     }
 
-    return num1;
+    /* calculations of a(n), b(n) */
+    return outer_coefficients(refrac_indx[nlayers-1], size_param, num,
+                              sha, shb, rd3x, rcx, d1x, ra, rb, tolerance);
 
 }
 
 /********************************************************************
  * BCD-subroutine for calculations of the ratios of the derivative
  *    to the function for Riccati-Bessel functions of half order with
- *    the complex argument: psi'(N)/psi(N) and khi'(N)/khi(N)
- *    and the ratios of functions: psi(N)/khi(N).
+ *    the complex argument: psi'(N)/psi(N) and zeta'(N)/zeta(N)
+ *    and the ratio of functions: psi(N)/zeta(N).
  *    The calculations are given by the recursive expression
  *    ``from bottom to top'' beginning from N=0.
- *    rd1, rd2, rbb, rcc-arrays of results.
+ *    rd1, rd3, rcc-arrays of results.
  *    rx - (refr. index) * (size parameter)
+ *    psi(N)/zeta(N) grows as exp(2y), which overflows and swamps
+ *    the layer recursion once y is large, so rcc holds it scaled
+ *    by exp(2i rx), which has a modulus of at most 1.
  * March 1999, AI SPbU
  ********************************************************************/
 void bcd (const complex<double> rx, const int num,
-          complex<double> rd1[], complex<double> rd2[],
-          complex<double> rbb[])
+          complex<double> rd1[], complex<double> rd3[],
+          complex<double> rcc[])
 {
 
     aa1(rx, num, rd1);
@@ -351,26 +1445,45 @@ void bcd (const complex<double> rx, const int num,
     /* n = 0 */
     complex<double> rd30 = I;
     complex<double> rxy = ( cos(2.0 * x) + I * sin(2.0 * x)) * exp(-2.0 * y);
-    complex<double> rc0 = -( 1.0 - rxy ) / ( 2.0 * rxy );
-    complex<double> rb0 = I * ( 1.0 - rxy ) / ( 1.0 + rxy );
+    complex<double> rc0 = -( 1.0 - rxy ) / 2.0;
     /* n = 1 */
-    complex<double> rd3[MAXNUM];
-    complex<double> rcc[MAXNUM];
     rd3[0] = -rx1 + 1.0 / ( rx1 - rd30 );
     rcc[0] = rc0 * ( rx1 + rd3[0] ) / ( rx1 + rd1[0] );
-    rd2[0] = ( rcc[0] * rd1[0] - rd3[0] ) / ( rcc[0] - 1.0 );
-    rbb[0] = rb0 * ( rx1 + rd2[0] ) / ( rx1 + rd1[0] );
 
     for (int i = 1; i < num; ++i) {
         complex<double> r1 = double( i + 1 ) * rx1;
         rd3[i] = -r1 + 1.0 / ( r1 - rd3[i-1] );
         rcc[i] = rcc[i-1] * ( r1 + rd3[i] ) / ( r1 + rd1[i] );
-        rd2[i] = ( rcc[i] * rd1[i] - rd3[i] ) / ( rcc[i] - 1.0 );
-        rbb[i] = rbb[i-1] * ( r1 + rd2[i] ) / ( r1 + rd1[i] );
     }
 
 }
 
+/********************************************************************
+ * The ratios of a shell bounded by rx1 = m_j x_j-1 and
+ *    rx2 = m_j x_j: psi'/psi and zeta'/zeta at each (rd1, rd3 and
+ *    sd1, sd3), and rq = [psi(rx1)/zeta(rx1)] / [psi(rx2)/zeta(rx2)]
+ *    (Yang, Appl. Opt. 42, 1710, 2003).  The scaling of BCD is
+ *    undone as the single factor exp(2i(rx2-rx1)), which is at most
+ *    1 for an absorbing shell, so rq stays finite however thick
+ *    the shell is.
+ ********************************************************************/
+void shell_ratios (const complex<double> rx1, const complex<double> rx2,
+                   const int num,
+                   complex<double> rd1[], complex<double> rd3[],
+                   complex<double> sd1[], complex<double> sd3[],
+                   complex<double> rq[])
+{
+
+    SeriesArray< complex<double> > rcc1(num), rcc2(num);
+    bcd(rx1, num, rd1, rd3, rcc1);
+    bcd(rx2, num, sd1, sd3, rcc2);
+
+    complex<double> ph = exp(2.0 * I * ( rx2 - rx1 ));
+    for (int i = 0; i < num; ++i)
+        rq[i] = ph * rcc1[i] / rcc2[i];
+
+}
+
 /********************************************************************
  * CD3X-subroutine for calculations of the ratio of the derivative
  *    to the function for Riccati-Bessel functions of half order with
@@ -391,7 +1504,17 @@ void cd3x (const double x, const int num, double d1x[],
     complex<double> rxy = complex<double>(cos(2.0 * x), sin(2.0 * x));
     complex<double> rc0 = - ( 1.0 - rxy ) / ( 2.0 * rxy );
     rd3x[0] = -ax + 1.0 / ( ax - rd30 );
-    rcx[0]  = rc0 * ( ax + rd3x[0] ) / ( ax + d1x[0] );
+
+    /* ax + d1x[0] is psi0/psi1, which vanishes with sin(x) at x = n pi
+       and is then all rounding error, so beyond x = 1 psi1/xi1 is found
+       directly.  Below it psi1 = sin(x)/x - cos(x) would cancel. */
+    if (x > 1.0) {
+        double psi1 = sin(x) * ax - cos(x);
+        double chi1 = cos(x) * ax + sin(x);
+        rcx[0] = psi1 / complex<double>(psi1, -chi1);
+    } else {
+        rcx[0] = rc0 * ( ax + rd3x[0] ) / ( ax + d1x[0] );
+    }
 
     for (int i = 1; i < num; ++i) {
         double a1 = double( i + 1 ) * ax;
@@ -411,29 +1534,5 @@ void qq1 (const double a, const int num1, double *extinct, double *scat,
           double *backscat, double *rad_pressure,
           complex<double> ra[], complex<double> rb[])
 {
-
-    double b = 2.0 * sqr(a);
-    double c = 0.0;
-    double d = 0.0;
-    complex<double> s = complex<double>(0.0, 0.0);
-    complex<double> r = complex<double>(0.0, 0.0);
-    int n = 1;
-
-    for (int i = 0; i < num1-1; ++i) {
-        double i1 = static_cast<double>(i + 1);
-        n += 2;
-        double nd = static_cast<double>(n);
-        r += ( i1 + 0.5 ) * pow(-1.0, i1) * ( ra[i] - rb[i] );
-        s += i1 * ( i1 + 2.0 ) / ( i1 + 1.0 ) * ( ra[i] * conj(ra[i+1])
-           + rb[i] * conj(rb[i+1]) ) + nd / i1 / ( i1 + 1.0 )
-           * ( ra[i] * conj(rb[i]) );
-        c += nd * ( real(ra[i]) + real(rb[i]) );
-        d += nd * ( real(ra[i] * conj(ra[i])) + real(rb[i] * conj(rb[i])) );
-    }
-
-    *extinct = b * c;
-    *scat = b * d;
-    *backscat = 2.0 * b * real(r * conj(r));
-    *rad_pressure = *extinct - 2.0 * b * real(s);
-
+    qq1_outputs<MieAll>(a, num1, extinct, scat, backscat, rad_pressure, ra, rb);
 }
@@ -5,6 +5,32 @@
 
 using namespace NPSpec;
 
+/* Only spheres and ellipsoids are solved by a method that gives the
+   backscattering, radiation pressure, albedo and asymmetry */
+static bool extraShape(NanoparticleShape npshape) {
+    return npshape == Sphere || npshape == Ellipsoid;
+}
+
+static bool extraProperty(SpectraProperty prop) {
+    return prop != Extinction && prop != Absorbance && prop != Scattering;
+}
+
+/* Fill in a spectrum solved every step wavelengths at each increment
+   between, holding the last wavelength solved to the end */
+static void interpolateSpectrum(double spec[NLAMBDA], int step, int increment) {
+    for (int i = 0; i < NLAMBDA; i += increment) {
+        const int j = i - i % step;
+        if (i == j)
+            continue;
+        if (j + step >= NLAMBDA) {
+            spec[i] = spec[j];
+        } else {
+            const double t = (double) (i - j) / step;
+            spec[i] = (1.0 - t) * spec[j] + t * spec[j+step];
+        }
+    }
+}
+
 Nanoparticle::Nanoparticle() :
     nLayers(1),
     sType(Efficiency),
@@ -15,6 +41,7 @@ Nanoparticle::Nanoparticle() :
     pathLength(1.0),
     concentration(1.0e-6),
     mediumRefractiveIndex(1.0),
+    extraProperties(false),
     materials(),
     materialIndex(),
     radius(),
@@ -26,6 +53,11 @@ Nanoparticle::Nanoparticle() :
     extinction(),
     scattering(),
     absorbance(),
+    backscattering(),
+    radiationPressure(),
+    albedo(),
+    asymmetry(),
+    extraCalculated(false),
     red(0.0),
     blue(0.0),
     green(0.0),
@@ -58,20 +90,85 @@ int Nanoparticle::calculateSpectrum()
 {
     /* Calculate the spectrum based on the Nanoparticle parameters */
 
-    // Call the solver
-    ErrorCode result = npspec(nLayers,
-                              radius,
-                              relativeRadius,
-                              materialIndex,
-                              mediumRefractiveIndex,
-                              sizeCorrect,
-                              increment,
-                              pathLength,
-                              concentration,
-                              sType,
-                              extinction,
-                              scattering,
-                              absorbance);
+    // Call the solver, only calculating the extra properties if needed.
+    // Spheroids are solved by the T-matrix method, and cubes, rods and
+    // prisms by the discrete dipole approximation, which only give the
+    // extinction, scattering and absorption of a single layer.
+    const bool exact = extraShape(shape);
+    if (!exact && nLayers != 1)
+        throw std::out_of_range("Spheroids, cubes, rods and prisms must have one layer");
+    if (shape == Rod && radius[0] < radius[1])
+        throw std::domain_error("Rod length must not be less than its diameter");
+    extraCalculated = exact && ( extraProperties || extraProperty(sProp) );
+    ErrorCode result;
+    if (shape == Spheroid) {
+        result = npspec_tmatrix(radius,
+                                materialIndex[0],
+                                mediumRefractiveIndex,
+                                sizeCorrect,
+                                increment,
+                                pathLength,
+                                concentration,
+                                sType,
+                                extinction,
+                                scattering,
+                                absorbance);
+    } else if (!exact) {
+        // The DDA is slow, so is solved no finer than DDA_INCREMENT
+        // and interpolated from there
+        const int step = increment > 0 && increment < DDA_INCREMENT
+                       ? DDA_INCREMENT : increment;
+        result = npspec_dda(shape,
+                            radius,
+                            materialIndex[0],
+                            mediumRefractiveIndex,
+                            sizeCorrect,
+                            step,
+                            pathLength,
+                            concentration,
+                            sType,
+                            DDA_RESOLUTION,
+                            extinction,
+                            scattering,
+                            absorbance);
+        if (step != increment) {
+            interpolateSpectrum(extinction, step, increment);
+            interpolateSpectrum(scattering, step, increment);
+            interpolateSpectrum(absorbance, step, increment);
+        }
+    } else if (extraCalculated) {
+        result = npspec_properties(nLayers,
+                                   radius,
+                                   relativeRadius,
+                                   materialIndex,
+                                   mediumRefractiveIndex,
+                                   sizeCorrect,
+                                   increment,
+                                   pathLength,
+                                   concentration,
+                                   sType,
+                                   extinction,
+                                   scattering,
+                                   absorbance,
+                                   backscattering,
+                                   radiationPressure,
+                                   albedo,
+                                   asymmetry);
+    } else {
+        result = npspec(nLayers,
+                        radius,
+                        relativeRadius,
+                        materialIndex,
+                        mediumRefractiveIndex,
+                        sizeCorrect,
+                        increment,
+                        pathLength,
+                        concentration,
+                        sType,
+                        extinction,
+                        scattering,
+                        absorbance);
+    }
 
     // Recalculate the colors
     double spec[NLAMBDA];
@@ -102,6 +199,10 @@ int Nanoparticle::calculateSpectrum()
         throw std::domain_error("Concentration must be positive");
     case InvalidRefractiveIndex:
         throw std::domain_error("Refractive index must be positive");
+    case InvalidResolution:
+        throw std::invalid_argument("Resolution must be at least one dipole");
+    case InvalidPositions:
+        throw std::invalid_argument("Particles must not overlap");
     }
 }
 
@@ -111,20 +212,44 @@ int Nanoparticle::calculateSpectrum()
 
 void Nanoparticle::getSpectrum(double spec[NLAMBDA]) const {
     /* Return the spectrum that has been calculated */
-    switch(sProp) {
+    getPropertySpectrum(sProp, spec);
+}
+
+void Nanoparticle::getPropertySpectrum(SpectraProperty prop,
+                                       double spec[NLAMBDA]) const {
+    /* Return the spectrum of the given property */
+    const double *source = extinction;
+    bool extra = true;
+    switch(prop) {
     case Extinction:
-        for (int i = 0; i < NLAMBDA; ++i)
-            spec[i] = extinction[i];
+        source = extinction;
+        extra = false;
         break;
     case Absorbance:
-        for (int i = 0; i < NLAMBDA; ++i)
-            spec[i] = absorbance[i];
+        source = absorbance;
+        extra = false;
         break;
     case Scattering:
-        for (int i = 0; i < NLAMBDA; ++i)
-            spec[i] = scattering[i];
+        source = scattering;
+        extra = false;
+        break;
+    case Backscattering:
+        source = backscattering;
+        break;
+    case RadiationPressure:
+        source = radiationPressure;
+        break;
+    case Albedo:
+        source = albedo;
+        break;
+    case Asymmetry:
+        source = asymmetry;
         break;
     }
+    if (extra && !extraCalculated)
+        throw std::invalid_argument("Extra properties were not calculated");
+    for (int i = 0; i < NLAMBDA; ++i)
+        spec[i] = source[i];
 }
 
 void Nanoparticle::getRGB(double &r, double &g, double &b) const {
@@ -166,6 +291,11 @@ SpectraProperty Nanoparticle::getSpectraProperty() const {
     return sProp;
 }
 
+bool Nanoparticle::getExtraProperties() const {
+    /* Return whether the extra properties are always calculated */
+    return extraProperties;
+}
+
 double Nanoparticle::getSphereRadius() const {
     /* Get the current stored radius for the sphere shape */
     return sphereRadius;
@@ -256,6 +386,8 @@ void Nanoparticle::setNLayers(int nlay) {
 
 void Nanoparticle::setShape(NanoparticleShape npshape) {
     /* Change the nanopaticle's shape */
+    if (!extraShape(npshape) && extraProperty(sProp))
+        throw std::invalid_argument("Only the extinction, scattering and absorbance are calculated for this shape");
     shape = npshape;
     updateRadius(shape);
     updateRelativeRadius(shape);
@@ -268,9 +400,16 @@ void Nanoparticle::setSpectraType(SpectraType stype) {
 
 void Nanoparticle::setSpectraProperty(SpectraProperty spec) {
     /* Change the spectra type */
+    if (!extraShape(shape) && extraProperty(spec))
+        throw std::invalid_argument("Only the extinction, scattering and absorbance are calculated for this shape");
     sProp = spec;
 }
 
+void Nanoparticle::setExtraProperties(bool extra) {
+    /* Change whether the extra properties are always calculated */
+    extraProperties = extra;
+}
+
 void Nanoparticle::setSphereRadius(double rad) {
     /* Set the radius for a sphere */
     if (rad <= 0.0)
@@ -374,6 +513,10 @@ void Nanoparticle::updateRadius(NanoparticleShape npshape) {
         radius[1] = -1;
         break;
     case Ellipsoid:
+    case Spheroid:
+    case Cube:
+    case Rod:
+    case Prism:
         radius[0] = ellipsoidRadius[0];
         radius[1] = ellipsoidRadius[1];
         break;
@@ -390,6 +533,10 @@ void Nanoparticle::updateRelativeRadius(NanoparticleShape npshape) {
         }
         break;
     case Ellipsoid:
+    case Spheroid:
+    case Cube:
+    case Rod:
+    case Prism:
         for (int i = 0; i < nLayers; ++i) {
             relativeRadius[i][0] = ellipsoidRelativeRadius[i][0];
             relativeRadius[i][1] = ellipsoidRelativeRadius[i][0];
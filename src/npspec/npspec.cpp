@@ -24,10 +24,16 @@
 
 #include "npspec/npspec.h"
 #include "npspec/private/solvers.hpp"
+#include "npspec/private/cluster.hpp"
+#include "npspec/private/dda.hpp"
+#include "npspec/private/mie.hpp"
 #include "npspec/private/material_parameters.hpp"
+#include "npspec/private/instrument.hpp"
+#include <algorithm>
 #include <cmath>
 #include <complex>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 using namespace NPSpec;
@@ -46,22 +52,134 @@ inline complex<double> drude (double om, double plasmon, double gamma, double si
     return sqr(plasmon) / ( om * ( om + complex<double>(0.0, 1.0) * ( gamma + sizecorr ) ) );
 }
 
-ErrorCode npspec(const int nlayers,              /* Number of layers */
-                 const double rad[2],            /* Radius of object */
-                 const double rel_rad[][2],      /* Relative radii of layers */
-                 const int indx[],               /* Material index of layers */
-                 const double mrefrac,           /* Refractive index of medium */
-                 const bool size_correct,        /* Use size correction? */
-                 const int increment,            /* Increment of wavelengths */
-                 const double path_length,       /* Path length for absorbance */
-                 const double concentration,     /* The concentration of solution */
-                 const SpectraType spectra_type, /* What spectra to return */
-                 double extinct[],               /* Extinction */
-                 double scat[],                  /* Scattering */
-                 double absorb[]                 /* Absorption */
-               )
+/* Convert an efficiency to the requested spectra type */
+inline double to_spectra_type (double q, const SpectraType spectra_type,
+                               const double sphere_rad, const double path_length,
+                               const double concentration) {
+    if (spectra_type != Efficiency)
+        q *= pi * sqr(sphere_rad);
+    if (spectra_type == Molar || spectra_type == Absorption)
+        q *= 1E-14 * avogadro / ( 1000 * log(10) );
+    if (spectra_type == Absorption)
+        q *= path_length * concentration;
+    return q;
+}
+
+/* The dielectric of a material at the i-th wavelength, corrected for
+   the size of the particle if asked for */
+static complex<double> layer_dielectric (const int indx, const int i,
+                                         const bool size_correct,
+                                         const double sphere_rad) {
+
+    NPSPEC_TIME(PhaseDielectric);
+
+    /* Grab dielectric from experiment */
+    complex<double> dielec = experimental_dielectrics[indx][i];
+
+    /* Correct for size if the asked for */
+    if (size_correct) {
+
+        NPSPEC_COUNT(SizeCorrections);
+
+        /* Extract the drude parameters */
+        double pf = drude_parameters[indx][0];
+        double gm = drude_parameters[indx][1];
+        double sc = drude_parameters[indx][2];
+
+        /* Energy in electron volts (omega) */
+        double om = nm2ev(wavelengths[i]);
+
+        /* Use the drude model to size-correct experimental data */
+        dielec = dielec
+               - drude(om, pf, gm, 0.0)
+               + drude(om, pf, gm, mPerS2eV(sc, sphere_rad));
+
+    }
+
+    return dielec;
+
+}
+
+/* The spectra that are wanted and where to put them.  Any may be NULL,
+   in which case that spectrum is neither calculated nor stored.
+   The scattering amplitudes and Mie coefficients are only available
+   for spheres. */
+struct SpectraRequest {
+    SpectraRequest() : extinct(NULL), scat(NULL), absorb(NULL),
+                       backscat(NULL), rad_pressure(NULL), albedo(NULL),
+                       asymmetry(NULL), nangles(0), theta(NULL), s1(NULL),
+                       s2(NULL), maxterms(0), an(NULL), bn(NULL),
+                       nterms(NULL), norders(0), ext_electric(NULL),
+                       ext_magnetic(NULL), sca_electric(NULL),
+                       sca_magnetic(NULL), nearfield(NULL),
+                       automatic(false), tolerance(0.0), model(NULL),
+                       absorb_axes(NULL), scat_axes(NULL), polarization(0.0),
+                       absorb_pol(NULL), scat_pol(NULL) {}
+    double *extinct;
+    double *scat;
+    double *absorb;
+    double *backscat;
+    double *rad_pressure;
+    double *albedo;
+    double *asymmetry;
+    int nangles;           /* Number of scattering angles */
+    const double *theta;   /* Scattering angles in radians */
+    double *s1;            /* S1 for each wavelength and angle */
+    double *s2;            /* S2 for each wavelength and angle */
+    int maxterms;          /* Stride of an and bn */
+    double *an;            /* a(n) for each wavelength */
+    double *bn;            /* b(n) for each wavelength */
+    int *nterms;           /* Number of a(n), b(n) for each wavelength */
+    int norders;           /* Number of multipole orders */
+    double *ext_electric;  /* Extinction of each electric multipole */
+    double *ext_magnetic;  /* Extinction of each magnetic multipole */
+    double *sca_electric;  /* Scattering of each electric multipole */
+    double *sca_magnetic;  /* Scattering of each magnetic multipole */
+    double *nearfield;     /* Surface-averaged near-field enhancement */
+    bool automatic;        /* Pick the cheapest adequate model? */
+    double tolerance;      /* Relative accuracy wanted of that model */
+    int *model;            /* SolverModel used for each wavelength */
+    double *absorb_axes;   /* Absorption polarized along Z and XY */
+    double *scat_axes;     /* Scattering polarized along Z and XY */
+    double polarization;   /* Angle of the polarization from the Z axis */
+    double *absorb_pol;    /* Absorption at that polarization */
+    double *scat_pol;      /* Scattering at that polarization */
+};
+
+/* The relative radii of a sphere in the form used for any shape */
+class SphereRadii {
+public:
+    typedef double Pair[2];
+    SphereRadii(const int nlayers, const double rel_rad[])
+        : rrad_(2 * nlayers) {
+        for (int i = 0; i < nlayers; ++i)
+            rrad_[2*i] = rrad_[2*i+1] = rel_rad[i];
+    }
+    const Pair* get() const {
+        return reinterpret_cast<const Pair*>(&rrad_[0]);
+    }
+private:
+    vector<double> rrad_;
+};
+
+/* The driver behind npspec and npspec_properties */
+static ErrorCode solve_spectra(const int nlayers,              /* Number of layers */
+                               const double rad[2],            /* Radius of object */
+                               const double rel_rad[][2],      /* Relative radii of layers */
+                               const int indx[],               /* Material index of layers */
+                               const double mrefrac,           /* Refractive index of medium */
+                               const bool size_correct,        /* Use size correction? */
+                               const int increment,            /* Increment of wavelengths */
+                               const double path_length,       /* Path length for absorbance */
+                               const double concentration,     /* The concentration of solution */
+                               const SpectraType spectra_type, /* What spectra to return */
+                               const SpectraRequest& out       /* Where to put the spectra */
+                             )
 {
 
+    NPSPEC_COUNT(NPSpecCalls);
+    NPSPEC_TIME(PhaseTotal);
+
     /* If the second component is negative, it is a sphere
        and thus Mie theory is used.  Otherwise, quasistatic is used. */
     bool lmie = false;
@@ -69,7 +187,7 @@ ErrorCode npspec(const int nlayers,              /* Number of layers */
         lmie = true;
 
     /* Verify conditions are correct */
-    if (nlayers < 1 || nlayers > MAXLAYERS)
+    if (nlayers < 1)
         return InvalidNumberOfLayers;
     if (path_length <= 0.0)
         return InvalidPathLength;
@@ -114,98 +232,1032 @@ ErrorCode npspec(const int nlayers,              /* Number of layers */
     else
         sphere_rad = cbrt(rad[0] * rad[1] * rad[1]);
 
+    /* Only calculate the Mie efficiencies needed for the requested spectra.
+       Absorption and albedo need both extinction and scattering, and the
+       asymmetry parameter is found from the radiation pressure. */
+    int outputs = 0;
+    if (out.extinct || out.absorb || out.albedo || out.asymmetry
+        || out.absorb_axes || out.absorb_pol)
+        outputs |= MieExtinction;
+    if (out.scat || out.absorb || out.albedo || out.asymmetry
+        || out.absorb_axes || out.absorb_pol || out.scat_axes || out.scat_pol)
+        outputs |= MieScattering;
+    if (out.backscat)
+        outputs |= MieBackscattering;
+    if (out.rad_pressure || out.asymmetry)
+        outputs |= MieRadiationPressure;
+
+    const bool multipoles = lmie && out.norders > 0
+                         && ( out.ext_electric || out.ext_magnetic
+                           || out.sca_electric || out.sca_magnetic );
+
+    /* The angular functions only need the cosine of each angle */
+    const bool angular = lmie && out.nangles > 0 && ( out.s1 || out.s2 );
+    vector<double> mu;
+    vector< complex<double> > s1, s2;
+    if (angular) {
+        mu.resize(out.nangles);
+        for (int k = 0; k < out.nangles; ++k)
+            mu[k] = cos(out.theta[k]);
+        s1.resize(out.nangles);
+        s2.resize(out.nangles);
+    }
+
+    /* Dielectric function and refractive index of each layer, and
+       the relative radius of each layer of a sphere */
+    vector< complex<double> > dielec(nlayers), refrac_indx(nlayers);
+    vector<double> srrad;
+    if (lmie) {
+        srrad.resize(nlayers);
+        for (int k = 0; k < nlayers; ++k)
+            srrad[k] = rel_rad[k][0];
+    }
+
+    /* The quasistatic solution depends on the shape only through
+       geometrical factors, so it is found for every wavelength at once.
+       The real and imaginary parts of the dielectric are kept apart,
+       each holding every wavelength of the core, then of each shell. */
+    const bool axes = out.absorb_axes || out.scat_axes
+                   || out.absorb_pol || out.scat_pol;
+    int nquasi = 0;
+    vector<double> qdielec_re, qdielec_im, qsize, qext, qsca, qabs;
+    vector<double> qabs_axes, qsca_axes;
+    if (!lmie) {
+        for (int i = 0; i < NLAMBDA; i += increment)
+            ++nquasi;
+        qdielec_re.resize(nlayers * nquasi);
+        qdielec_im.resize(nlayers * nquasi);
+        qsize.resize(nquasi);
+        qext.resize(nquasi);
+        qsca.resize(nquasi);
+        qabs.resize(nquasi);
+        if (axes) {
+            qabs_axes.resize(2 * nquasi);
+            qsca_axes.resize(2 * nquasi);
+        }
+        for (int i = 0, n = 0; i < NLAMBDA; i += increment, ++n) {
+            qsize[n] = 2.0 * pi * sphere_rad * mrefrac / wavelengths[i];
+            for (int j = 0; j < nlayers; ++j) {
+                complex<double> d = layer_dielectric(indx[j], i, size_correct,
+                                                     sphere_rad);
+                qdielec_re[j * nquasi + n] = real(d);
+                qdielec_im[j * nquasi + n] = imag(d);
+            }
+        }
+        QuasiGeometry geometry;
+        quasi_geometry(nlayers, rel_rad, rad, geometry);
+        quasi_spectra(geometry, nquasi, &qdielec_re[0], &qdielec_im[0],
+                      sqr(mrefrac), &qsize[0], &qext[0], &qsca[0], &qabs[0],
+                      axes ? &qabs_axes[0] : NULL, axes ? &qsca_axes[0] : NULL);
+    }
+
     /***************************************************
      * Loop over each wavelength to calculate properties
      ***************************************************/
 
     ErrorCode returnvalue = NoError;
-    for (int i = 0; i < NLAMBDA; i += increment) {
+    for (int i = 0, n = 0; i < NLAMBDA; i += increment, ++n) {
 
         /* Determine size parameter */
         double size_param = 2.0 * pi * sphere_rad * mrefrac / wavelengths[i];
 
         /* Skip if size_param is too small */
-        if (size_param < 0.1E-6)
+        if (size_param < 0.1E-6) {
+            NPSPEC_COUNT(WavelengthsSkipped);
+            if (out.nterms)
+                out.nterms[i] = 0;
+            if (out.model)
+                out.model[i] = ModelSkipped;
             continue;
-        /* Watch out for too large with quasistatic */
+        }
+        /* Watch out for too large with quasistatic.  When the model is
+           picked automatically the tolerance is checked instead. */
         /* TODO: Optimize this values */
-        else if (!lmie && i == 0 && size_param > 0.6) /* Monitor 200 nm */
+        else if (!lmie && !out.automatic && i == 0 && size_param > 0.6) { /* Monitor 200 nm */
+            NPSPEC_COUNT(SizeWarnings);
             returnvalue = SizeWarning;
+        }
+        NPSPEC_COUNT(WavelengthsEvaluated);
 
         /*****************************************************************
          * Calculate dielectric constant & refractive index for each layer
          *****************************************************************/
 
-        /* Dielectric function and refractive index */
-        complex<double> dielec[MAXLAYERS], refrac_indx[MAXLAYERS];
 
         for (int j = 0; j < nlayers; ++j) {
 
-            /* Grab dielectric from experiment */
-            dielec[j] = experimental_dielectrics[indx[j]][i];
-
-            /* Correct for size if the asked for */
-            if (size_correct) {
+            /* The quasistatic dielectrics were already found */
+            if (!lmie) {
+                dielec[j] = complex<double>(qdielec_re[j * nquasi + n],
+                                            qdielec_im[j * nquasi + n]);
+                continue;
+            }
+            dielec[j] = layer_dielectric(indx[j], i, size_correct, sphere_rad);
 
-                /* Extract the drude parameters */
-                double pf = drude_parameters[indx[j]][0];
-                double gm = drude_parameters[indx[j]][1];
-                double sc = drude_parameters[indx[j]][2];
+            /* Turn dielectric into refractive index for Mie theory */
+            double tmp0 = abs(dielec[j]);
+            double tmp1 = sqrt(( tmp0 + real(dielec[j]) ) / 2.0);
+            double tmp2 = sqrt(( tmp0 - real(dielec[j]) ) / 2.0);
+            refrac_indx[j] = complex<double>(tmp1, tmp2);
 
-                /* Energy in electron volts (omega) */
-                double om = nm2ev(wavelengths[i]);
+            /* Relative to the medium, as the size parameter is, and as
+               for the T-matrix, DDA and cluster solvers */
+            refrac_indx[j] /= mrefrac;
 
-                /* Use the drude model to size-correct experimental data */
-                dielec[j] = dielec[j]
-                          - drude(om, pf, gm, 0.0)
-                          + drude(om, pf, gm, mPerS2eV(sc, sphere_rad));
+        }
 
+        /* Solve using the appropriate inputs and theory */
+        double ext, sca, abso, bak, pre, alb, asy;
+        if (lmie) {
+            /* The efficiencies and the scattering amplitudes all
+               come from the same Mie coefficients.  A sphere too large
+               for the series uses geometric optics, and has none,
+               as does the quasistatic dipole. */
+            SolverModel model = ModelMie;
+            if (out.automatic)
+                model = mie_model(nlayers, &refrac_indx[0], &srrad[0],
+                                  size_param, out.tolerance);
+            else if (mie_asymptotic(size_param))
+                model = ModelGeometric;
+            if (out.model)
+                out.model[i] = model;
+            SeriesArray< complex<double> > ra(nm(size_param)), rb(nm(size_param));
+            int nterms = 0;
+            if (model == ModelMie) {
+                /* An automatic model also cuts the series to the tolerance */
+                mie_coefficients(nlayers, &refrac_indx[0], &srrad[0],
+                                 size_param, ra, rb, &nterms,
+                                 out.automatic ? out.tolerance : 0.0);
+            } else if (model == ModelRayleigh) {
+                mie_rayleigh(nlayers, &refrac_indx[0], &srrad[0], size_param,
+                             ra, rb, &nterms);
+            }
+            if (outputs != 0) {
+                if (model == ModelGeometric) {
+                    /* Outside the bounds where it was checked it is
+                       still the best estimate available, so warn */
+                    if (mie_geometric(nlayers, &refrac_indx[0], &srrad[0],
+                                      size_param, outputs, &ext, &sca, &abso,
+                                      &bak, &pre, &alb, &asy) > 0) {
+                        NPSPEC_COUNT(SizeWarnings);
+                        returnvalue = SizeWarning;
+                    }
+                } else if (model == ModelQuasistatic)
+                    mie_quasistatic(nlayers, &refrac_indx[0], &srrad[0],
+                                    size_param, outputs, &ext, &sca, &abso, &bak, &pre,
+                                    &alb, &asy);
+                else
+                    mie_efficiencies(outputs, size_param, nterms, ra, rb,
+                                     &ext, &sca, &abso, &bak, &pre, &alb, &asy);
+            }
+            if (out.an || out.bn || out.nterms) {
+                /* Store as many terms as fit, zero padding the rest */
+                int nstore = min(nterms, out.maxterms);
+                if (out.nterms)
+                    out.nterms[i] = nstore;
+                int nfill = out.an || out.bn ? out.maxterms : 0;
+                for (int n = 0; n < nfill; ++n) {
+                    int m = 2 * ( i * out.maxterms + n );
+                    complex<double> a = n < nstore ? ra[n] : 0.0;
+                    complex<double> b = n < nstore ? rb[n] : 0.0;
+                    if (out.an) {
+                        out.an[m]     = real(a);
+                        out.an[m + 1] = imag(a);
+                    }
+                    if (out.bn) {
+                        out.bn[m]     = real(b);
+                        out.bn[m + 1] = imag(b);
+                    }
+                }
+            }
+            if (out.nearfield)
+                out.nearfield[i] = mie_nearfield(size_param, nterms, ra, rb);
+            if (multipoles) {
+                int m = i * out.norders;
+                double *mp[4] = { out.ext_electric, out.ext_magnetic,
+                                  out.sca_electric, out.sca_magnetic };
+                for (int k = 0; k < 4; ++k)
+                    if (mp[k]) mp[k] += m;
+                mie_multipoles(size_param, nterms, ra, rb, out.norders,
+                               mp[0], mp[1], mp[2], mp[3]);
+                for (int k = 0; k < 4; ++k) {
+                    if (!mp[k]) continue;
+                    for (int n = 0; n < out.norders; ++n)
+                        mp[k][n] = to_spectra_type(mp[k][n], spectra_type,
+                                                   sphere_rad, path_length,
+                                                   concentration);
+                }
+            }
+            if (angular) {
+                mie_angular(nterms, ra, rb, out.nangles, &mu[0],
+                            &s1[0], &s2[0]);
+                for (int k = 0; k < out.nangles; ++k) {
+                    int m = 2 * ( i * out.nangles + k );
+                    if (out.s1) {
+                        out.s1[m]     = real(s1[k]);
+                        out.s1[m + 1] = imag(s1[k]);
+                    }
+                    if (out.s2) {
+                        out.s2[m]     = real(s2[k]);
+                        out.s2[m + 1] = imag(s2[k]);
+                    }
+                }
             }
+        } else {
+            ext  = qext[n];
+            sca  = qsca[n];
+            abso = qabs[n];
+            /* Only the quasistatic model exists for an ellipsoid, so all
+               that can be done is to warn if it is not accurate enough */
+            if (out.automatic
+                && quasi_error(nlayers, &dielec[0], sqr(mrefrac),
+                               size_param) > out.tolerance) {
+                NPSPEC_COUNT(SizeWarnings);
+                returnvalue = SizeWarning;
+            }
+            if (out.model)
+                out.model[i] = ModelQuasistatic;
+            if (out.nterms)
+                out.nterms[i] = 0;
+            /* The quasistatic particle is a point dipole, which scatters
+               symmetrically with a backscattering of 3/2 the scattering */
+            bak = 1.5 * sca;
+            pre = ext;
+            alb = sca / ext;
+            asy = 0.0;
+        }
 
-            /* Turn dielectric into refractive index if Mie theory */
-            if (lmie) {
-                double tmp0 = abs(dielec[j]);
-                double tmp1 = sqrt(( tmp0 + real(dielec[j]) ) / 2.0);
-                double tmp2 = sqrt(( tmp0 - real(dielec[j]) ) / 2.0);
-                refrac_indx[j] = complex<double>(tmp1, tmp2);
+        /* Only fill the spectra that were asked for, changing the
+           spectra type accordingly.  Albedo and asymmetry are unitless. */
+        if (out.extinct)
+            out.extinct[i] = to_spectra_type(ext, spectra_type, sphere_rad,
+                                             path_length, concentration);
+        if (out.scat)
+            out.scat[i] = to_spectra_type(sca, spectra_type, sphere_rad,
+                                          path_length, concentration);
+        if (out.absorb)
+            out.absorb[i] = to_spectra_type(abso, spectra_type, sphere_rad,
+                                            path_length, concentration);
+        if (out.backscat)
+            out.backscat[i] = to_spectra_type(bak, spectra_type, sphere_rad,
+                                              path_length, concentration);
+        if (out.rad_pressure)
+            out.rad_pressure[i] = to_spectra_type(pre, spectra_type, sphere_rad,
+                                                  path_length, concentration);
+        if (out.albedo)
+            out.albedo[i] = alb;
+        if (out.asymmetry)
+            out.asymmetry[i] = asy;
+
+        /* Absorption and scattering for light polarized along each axis,
+           and for any polarization between them.  A sphere responds the
+           same way to every polarization. */
+        if (axes) {
+            double abs_z = abso, abs_xy = abso, sca_z = sca, sca_xy = sca;
+            if (!lmie) {
+                abs_z  = qabs_axes[2*n];
+                abs_xy = qabs_axes[2*n+1];
+                sca_z  = qsca_axes[2*n];
+                sca_xy = qsca_axes[2*n+1];
+            }
+            double cos2 = sqr(cos(out.polarization)), sin2 = 1.0 - cos2;
+            if (out.absorb_axes) {
+                out.absorb_axes[2*i]   = to_spectra_type(abs_z, spectra_type,
+                                                         sphere_rad, path_length,
+                                                         concentration);
+                out.absorb_axes[2*i+1] = to_spectra_type(abs_xy, spectra_type,
+                                                         sphere_rad, path_length,
+                                                         concentration);
             }
+            if (out.scat_axes) {
+                out.scat_axes[2*i]   = to_spectra_type(sca_z, spectra_type,
+                                                       sphere_rad, path_length,
+                                                       concentration);
+                out.scat_axes[2*i+1] = to_spectra_type(sca_xy, spectra_type,
+                                                       sphere_rad, path_length,
+                                                       concentration);
+            }
+            if (out.absorb_pol)
+                out.absorb_pol[i] = to_spectra_type(cos2 * abs_z + sin2 * abs_xy,
+                                                    spectra_type, sphere_rad,
+                                                    path_length, concentration);
+            if (out.scat_pol)
+                out.scat_pol[i] = to_spectra_type(cos2 * sca_z + sin2 * sca_xy,
+                                                  spectra_type, sphere_rad,
+                                                  path_length, concentration);
+        }
+
+    }
+
+    return returnvalue;
+
+}
+
+ErrorCode npspec(const int nlayers,              /* Number of layers */
+                 const double rad[2],            /* Radius of object */
+                 const double rel_rad[][2],      /* Relative radii of layers */
+                 const int indx[],               /* Material index of layers */
+                 const double mrefrac,           /* Refractive index of medium */
+                 const bool size_correct,        /* Use size correction? */
+                 const int increment,            /* Increment of wavelengths */
+                 const double path_length,       /* Path length for absorbance */
+                 const double concentration,     /* The concentration of solution */
+                 const SpectraType spectra_type, /* What spectra to return */
+                 double extinct[],               /* Extinction */
+                 double scat[],                  /* Scattering */
+                 double absorb[]                 /* Absorption */
+               )
+{
+    SpectraRequest out;
+    out.extinct = extinct;
+    out.scat    = scat;
+    out.absorb  = absorb;
+    return solve_spectra(nlayers, rad, rel_rad, indx, mrefrac, size_correct,
+                         increment, path_length, concentration, spectra_type,
+                         out);
+}
+
+ErrorCode npspec_properties(const int nlayers,              /* Number of layers */
+                            const double rad[2],            /* Radius of object */
+                            const double rel_rad[][2],      /* Relative radii of layers */
+                            const int indx[],               /* Material index of layers */
+                            const double mrefrac,           /* Refractive index of medium */
+                            const bool size_correct,        /* Use size correction? */
+                            const int increment,            /* Increment of wavelengths */
+                            const double path_length,       /* Path length for absorbance */
+                            const double concentration,     /* The concentration of solution */
+                            const SpectraType spectra_type, /* What spectra to return */
+                            double extinct[],               /* Extinction */
+                            double scat[],                  /* Scattering */
+                            double absorb[],                /* Absorption */
+                            double backscat[],              /* Backscattering */
+                            double rad_pressure[],          /* Radiation pressure */
+                            double albedo[],                /* Albedo */
+                            double asymmetry[]              /* Asymmetry parameter */
+                          )
+{
+    SpectraRequest out;
+    out.extinct      = extinct;
+    out.scat         = scat;
+    out.absorb       = absorb;
+    out.backscat     = backscat;
+    out.rad_pressure = rad_pressure;
+    out.albedo       = albedo;
+    out.asymmetry    = asymmetry;
+    return solve_spectra(nlayers, rad, rel_rad, indx, mrefrac, size_correct,
+                         increment, path_length, concentration, spectra_type,
+                         out);
+}
+
+ErrorCode npspec_polarized(const int nlayers,              /* Number of layers */
+                           const double rad[2],            /* Radius of object */
+                           const double rel_rad[][2],      /* Relative radii of layers */
+                           const int indx[],               /* Material index of layers */
+                           const double mrefrac,           /* Refractive index of medium */
+                           const bool size_correct,        /* Use size correction? */
+                           const int increment,            /* Increment of wavelengths */
+                           const double path_length,       /* Path length for absorbance */
+                           const double concentration,     /* The concentration of solution */
+                           const SpectraType spectra_type, /* What spectra to return */
+                           const double polarization,      /* Angle from the Z axis */
+                           double absorb_axes[],           /* Absorption along Z and XY */
+                           double scat_axes[],             /* Scattering along Z and XY */
+                           double absorb_pol[],            /* Absorption at the polarization */
+                           double scat_pol[]               /* Scattering at the polarization */
+                         )
+{
+    SpectraRequest out;
+    out.absorb_axes  = absorb_axes;
+    out.scat_axes    = scat_axes;
+    out.polarization = polarization;
+    out.absorb_pol   = absorb_pol;
+    out.scat_pol     = scat_pol;
+    return solve_spectra(nlayers, rad, rel_rad, indx, mrefrac, size_correct,
+                         increment, path_length, concentration, spectra_type,
+                         out);
+}
+
+ErrorCode npspec_auto(const int nlayers,              /* Number of layers */
+                      const double rad[2],            /* Radius of object */
+                      const double rel_rad[][2],      /* Relative radii of layers */
+                      const int indx[],               /* Material index of layers */
+                      const double mrefrac,           /* Refractive index of medium */
+                      const bool size_correct,        /* Use size correction? */
+                      const int increment,            /* Increment of wavelengths */
+                      const double path_length,       /* Path length for absorbance */
+                      const double concentration,     /* The concentration of solution */
+                      const SpectraType spectra_type, /* What spectra to return */
+                      const double tolerance,         /* Relative accuracy wanted */
+                      double extinct[],               /* Extinction */
+                      double scat[],                  /* Scattering */
+                      double absorb[],                /* Absorption */
+                      int model[],                    /* Model used at each wavelength */
+                      int nterms[]                    /* Number of Mie terms used */
+                    )
+{
+    SpectraRequest out;
+    out.extinct   = extinct;
+    out.scat      = scat;
+    out.absorb    = absorb;
+    out.automatic = true;
+    out.tolerance = tolerance;
+    out.model     = model;
+    out.maxterms  = MAXTERMS;
+    out.nterms    = nterms;
+    return solve_spectra(nlayers, rad, rel_rad, indx, mrefrac, size_correct,
+                         increment, path_length, concentration, spectra_type,
+                         out);
+}
+
+ErrorCode npspec_angular(const int nlayers,          /* Number of layers */
+                         const double radius,        /* Radius of sphere */
+                         const double rel_rad[],     /* Relative radii of layers */
+                         const int indx[],           /* Material index of layers */
+                         const double mrefrac,       /* Refractive index of medium */
+                         const bool size_correct,    /* Use size correction? */
+                         const int increment,        /* Increment of wavelengths */
+                         const int nangles,          /* Number of angles */
+                         const double theta[],       /* Scattering angles */
+                         double s1[],                /* S1 amplitude */
+                         double s2[]                 /* S2 amplitude */
+                       )
+{
+
+    if (nlayers < 1)
+        return InvalidNumberOfLayers;
+
+    /* Expand the radii into the form used for any shape */
+    double rad[2] = { radius, -1.0 };
+    SphereRadii rrad(nlayers, rel_rad);
+
+    SpectraRequest out;
+    out.nangles = nangles;
+    out.theta   = theta;
+    out.s1      = s1;
+    out.s2      = s2;
+    return solve_spectra(nlayers, rad, rrad.get(), indx, mrefrac, size_correct,
+                         increment, 1.0, 1.0, Efficiency, out);
+
+}
 
+ErrorCode npspec_nearfield(const int nlayers,              /* Number of layers */
+                           const double radius,            /* Radius of sphere */
+                           const double rel_rad[],         /* Relative radii of layers */
+                           const int indx[],               /* Material index of layers */
+                           const double mrefrac,           /* Refractive index of medium */
+                           const bool size_correct,        /* Use size correction? */
+                           const int increment,            /* Increment of wavelengths */
+                           const double path_length,       /* Path length for absorbance */
+                           const double concentration,     /* The concentration of solution */
+                           const SpectraType spectra_type, /* What spectra to return */
+                           double extinct[],               /* Extinction */
+                           double scat[],                  /* Scattering */
+                           double absorb[],                /* Absorption */
+                           double enhancement[]            /* Near-field enhancement */
+                         )
+{
+
+    if (nlayers < 1)
+        return InvalidNumberOfLayers;
+
+    /* Expand the radii into the form used for any shape */
+    double rad[2] = { radius, -1.0 };
+    SphereRadii rrad(nlayers, rel_rad);
+
+    SpectraRequest out;
+    out.extinct   = extinct;
+    out.scat      = scat;
+    out.absorb    = absorb;
+    out.nearfield = enhancement;
+    return solve_spectra(nlayers, rad, rrad.get(), indx, mrefrac, size_correct,
+                         increment, path_length, concentration, spectra_type,
+                         out);
+
+}
+
+ErrorCode npspec_multipoles(const int nlayers,              /* Number of layers */
+                            const double radius,            /* Radius of sphere */
+                            const double rel_rad[],         /* Relative radii of layers */
+                            const int indx[],               /* Material index of layers */
+                            const double mrefrac,           /* Refractive index of medium */
+                            const bool size_correct,        /* Use size correction? */
+                            const int increment,            /* Increment of wavelengths */
+                            const double path_length,       /* Path length for absorbance */
+                            const double concentration,     /* The concentration of solution */
+                            const SpectraType spectra_type, /* What spectra to return */
+                            double extinct[],               /* Total extinction */
+                            double scat[],                  /* Total scattering */
+                            const int norders,              /* Number of orders */
+                            double ext_electric[],          /* Extinction of a(n) */
+                            double ext_magnetic[],          /* Extinction of b(n) */
+                            double sca_electric[],          /* Scattering of a(n) */
+                            double sca_magnetic[]           /* Scattering of b(n) */
+                          )
+{
+
+    if (nlayers < 1)
+        return InvalidNumberOfLayers;
+
+    /* Expand the radii into the form used for any shape */
+    double rad[2] = { radius, -1.0 };
+    SphereRadii rrad(nlayers, rel_rad);
+
+    SpectraRequest out;
+    out.extinct      = extinct;
+    out.scat         = scat;
+    out.norders      = norders;
+    out.ext_electric = ext_electric;
+    out.ext_magnetic = ext_magnetic;
+    out.sca_electric = sca_electric;
+    out.sca_magnetic = sca_magnetic;
+    return solve_spectra(nlayers, rad, rrad.get(), indx, mrefrac, size_correct,
+                         increment, path_length, concentration, spectra_type,
+                         out);
+
+}
+
+ErrorCode npspec_coefficients(const int nlayers,          /* Number of layers */
+                              const double radius,        /* Radius of sphere */
+                              const double rel_rad[],     /* Relative radii of layers */
+                              const int indx[],           /* Material index of layers */
+                              const double mrefrac,       /* Refractive index of medium */
+                              const bool size_correct,    /* Use size correction? */
+                              const int increment,        /* Increment of wavelengths */
+                              const int maxterms,         /* Terms stored per wavelength */
+                              double an[],                /* a(n) */
+                              double bn[],                /* b(n) */
+                              int nterms[]                /* Number of terms */
+                            )
+{
+
+    if (nlayers < 1)
+        return InvalidNumberOfLayers;
+
+    /* Expand the radii into the form used for any shape */
+    double rad[2] = { radius, -1.0 };
+    SphereRadii rrad(nlayers, rel_rad);
+
+    SpectraRequest out;
+    out.maxterms = max(maxterms, 0);
+    out.an       = an;
+    out.bn       = bn;
+    out.nterms   = nterms;
+    return solve_spectra(nlayers, rad, rrad.get(), indx, mrefrac, size_correct,
+                         increment, 1.0, 1.0, Efficiency, out);
+
+}
+
+ErrorCode npspec_batch(const int nparticles,           /* Number of particles */
+                       const int nlayers,              /* Number of layers */
+                       const double rad[][2],          /* Radius of each object */
+                       const double rel_rad[][2],      /* Relative radii of layers */
+                       const int indx[],               /* Material index of layers */
+                       const double mrefrac,           /* Refractive index of medium */
+                       const bool size_correct,        /* Use size correction? */
+                       const int increment,            /* Increment of wavelengths */
+                       const double path_length,       /* Path length for absorbance */
+                       const double concentration,     /* The concentration of solution */
+                       const SpectraType spectra_type, /* What spectra to return */
+                       double extinct[],               /* Extinction */
+                       double scat[],                  /* Scattering */
+                       double absorb[],                /* Absorption */
+                       int retcodes[]                  /* Error code of each particle */
+                     )
+{
+
+    /* Each particle is an independent call to npspec.  The arrays are
+       already contiguous per particle, so we just offset into them. */
+    ErrorCode returnvalue = NoError;
+    for (int p = 0; p < nparticles; ++p) {
+        ErrorCode result = npspec(nlayers,
+                                  rad[p],
+                                  &rel_rad[p * nlayers],
+                                  &indx[p * nlayers],
+                                  mrefrac,
+                                  size_correct,
+                                  increment,
+                                  path_length,
+                                  concentration,
+                                  spectra_type,
+                                  extinct != NULL ? &extinct[p * NLAMBDA] : NULL,
+                                  scat    != NULL ? &scat[p * NLAMBDA]    : NULL,
+                                  absorb  != NULL ? &absorb[p * NLAMBDA]  : NULL);
+        if (retcodes != NULL)
+            retcodes[p] = static_cast<int>(result);
+        if (returnvalue == NoError)
+            returnvalue = result;
+    }
+
+    return returnvalue;
+
+}
+
+/* A RadialProfile at one wavelength, as the relative radius is used
+   by the Mie solver */
+struct ProfileAt {
+    RadialProfile profile;
+    void *data;
+    double radius;
+    double wavelength;
+    double mrefrac;
+};
+
+static complex<double> profile_at (const double r, void *data) {
+    const ProfileAt *p = static_cast<const ProfileAt*>(data);
+    double n = 0.0, k = 0.0;
+    p->profile(r * p->radius, p->wavelength, p->data, &n, &k);
+    return complex<double>(n, k) / p->mrefrac;
+}
+
+ErrorCode npspec_profile(const double radius,             /* Radius of sphere */
+                         const RadialProfile profile,     /* Index at each radius */
+                         void *data,                      /* Passed on to profile */
+                         const double mrefrac,            /* Refractive index of medium */
+                         const int increment,             /* Increment of wavelengths */
+                         const double path_length,        /* Path length for absorbance */
+                         const double concentration,      /* The concentration of solution */
+                         const SpectraType spectra_type,  /* What spectra to return */
+                         const double tolerance,          /* Relative accuracy wanted */
+                         double extinct[],                /* Extinction */
+                         double scat[],                   /* Scattering */
+                         double absorb[],                 /* Absorption */
+                         int nshells[]                    /* Number of shells used */
+                       )
+{
+
+    NPSPEC_COUNT(NPSpecCalls);
+    NPSPEC_TIME(PhaseTotal);
+
+    /* Verify conditions are correct */
+    if (profile == NULL)
+        return InvalidRefractiveIndex;
+    if (path_length <= 0.0)
+        return InvalidPathLength;
+    if (concentration <= 0.0)
+        return InvalidConcentration;
+    if (mrefrac <= 0.0)
+        return InvalidRefractiveIndex;
+    if (radius <= 0.0)
+        return InvalidRadius;
+
+    /* Make sure the increment is a factor of 800, and is positive */
+    if (increment < 0)
+        return InvalidIncrement;
+    else if (fmod(static_cast<double>(NLAMBDA),
+                  static_cast<double>(increment)) > 0.000001)
+        return InvalidIncrement;
+
+    int outputs = 0;
+    if (extinct || absorb)
+        outputs |= MieExtinction;
+    if (scat || absorb)
+        outputs |= MieScattering;
+
+    ProfileAt at;
+    at.profile = profile;
+    at.data    = data;
+    at.radius  = radius;
+    at.mrefrac = mrefrac;
+
+    ErrorCode returnvalue = NoError;
+    for (int i = 0; i < NLAMBDA; i += increment) {
+
+        /* Determine size parameter, and skip if it is too small */
+        double size_param = 2.0 * pi * radius * mrefrac / wavelengths[i];
+        if (size_param < 0.1E-6) {
+            NPSPEC_COUNT(WavelengthsSkipped);
+            if (nshells)
+                nshells[i] = 0;
+            continue;
         }
+        NPSPEC_COUNT(WavelengthsEvaluated);
 
-        /* Solve using the appropriate inputs and theory */
-        if (lmie) {
-            /* Relative radius for sphere */
-            double srrad[MAXLAYERS];
-            for (int k = 0; k < nlayers; ++k)
-                srrad[k] = rel_rad[k][0];
-            double backscat, rad_pressure, albedo, asymmetry;
-            int retval = mie(nlayers, refrac_indx, srrad, size_param,
-                             &extinct[i], &scat[i], &absorb[i],
-                             &backscat, &rad_pressure, &albedo, &asymmetry);
-            if (retval > 0) return SizeWarning;
-        } else {
-            int retval = quasi(nlayers, dielec, sqr(mrefrac), rel_rad,
-                               rad, size_param,
-                               &extinct[i], &scat[i], &absorb[i]);
-            if (retval > 0) return InvalidNumberOfLayers;
+        at.wavelength = wavelengths[i];
+        double ext, sca, abso, bak, pre, alb, asy;
+        int n;
+        if (mie_profile(profile_at, &at, size_param, tolerance, outputs,
+                        &ext, &sca, &abso, &bak, &pre, &alb, &asy, &n) > 0) {
+            NPSPEC_COUNT(SizeWarnings);
+            returnvalue = SizeWarning;
         }
-        /* Change the spectra type accordingly */
-        if (spectra_type != Efficiency) {
-            extinct[i] *= pi * sqr(sphere_rad);
-            scat[i]    *= pi * sqr(sphere_rad);
-            absorb[i]  *= pi * sqr(sphere_rad);
+        if (nshells)
+            nshells[i] = n;
+
+        if (extinct)
+            extinct[i] = to_spectra_type(ext, spectra_type, radius,
+                                         path_length, concentration);
+        if (scat)
+            scat[i] = to_spectra_type(sca, spectra_type, radius,
+                                      path_length, concentration);
+        if (absorb)
+            absorb[i] = to_spectra_type(abso, spectra_type, radius,
+                                        path_length, concentration);
+
+    }
+
+    return returnvalue;
+
+}
+
+ErrorCode npspec_tmatrix(const double rad[2],             /* Radius on Z and XY */
+                         const int indx,                  /* Material index */
+                         const double mrefrac,            /* Refractive index of medium */
+                         const bool size_correct,         /* Use size correction? */
+                         const int increment,             /* Increment of wavelengths */
+                         const double path_length,        /* Path length for absorbance */
+                         const double concentration,      /* The concentration of solution */
+                         const SpectraType spectra_type,  /* What spectra to return */
+                         double extinct[],                /* Extinction */
+                         double scat[],                   /* Scattering */
+                         double absorb[]                  /* Absorption */
+                       )
+{
+
+    NPSPEC_COUNT(NPSpecCalls);
+    NPSPEC_TIME(PhaseTotal);
+
+    /* Verify conditions are correct */
+    if (path_length <= 0.0)
+        return InvalidPathLength;
+    if (concentration <= 0.0)
+        return InvalidConcentration;
+    if (mrefrac <= 0.0)
+        return InvalidRefractiveIndex;
+    if (rad[0] <= 0.0 || rad[1] <= 0.0)
+        return InvalidRadius;
+
+    /* Make sure the increment is a factor of 800, and is positive */
+    if (increment < 0)
+        return InvalidIncrement;
+    else if (fmod(static_cast<double>(NLAMBDA),
+                  static_cast<double>(increment)) > 0.000001)
+        return InvalidIncrement;
+
+    /* Spectra are relative to the sphere of the same volume */
+    const double sphere_rad = cbrt(rad[0] * rad[1] * rad[1]);
+
+    ErrorCode returnvalue = NoError;
+    for (int i = 0; i < NLAMBDA; i += increment) {
+
+        /* Determine the size parameters, and skip if too small */
+        double k = 2.0 * pi * mrefrac / wavelengths[i];
+        double size_param[2] = { k * rad[0], k * rad[1] };
+        if (k * sphere_rad < 0.1E-6) {
+            NPSPEC_COUNT(WavelengthsSkipped);
+            continue;
         }
-        if (spectra_type == Molar || spectra_type == Absorption) {
-            extinct[i] *= 1E-14 * avogadro / ( 1000 * log(10) );
-            scat[i]    *= 1E-14 * avogadro / ( 1000 * log(10) );
-            absorb[i]  *= 1E-14 * avogadro / ( 1000 * log(10) );
+        NPSPEC_COUNT(WavelengthsEvaluated);
+
+        /* The refractive index relative to the medium */
+        complex<double> dielec = layer_dielectric(indx, i, size_correct,
+                                                  sphere_rad);
+        double tmp0 = abs(dielec);
+        complex<double> refrac_indx(sqrt(( tmp0 + real(dielec) ) / 2.0),
+                                    sqrt(( tmp0 - real(dielec) ) / 2.0));
+
+        double ext, sca, abso;
+        if (tmatrix(refrac_indx / mrefrac, size_param, &ext, &sca, &abso) > 0) {
+            NPSPEC_COUNT(SizeWarnings);
+            returnvalue = SizeWarning;
         }
-        if (spectra_type == Absorption) {
-            extinct[i] *= path_length * concentration;
-            scat[i]    *= path_length * concentration;
-            absorb[i]  *= path_length * concentration;
+
+        if (extinct)
+            extinct[i] = to_spectra_type(ext, spectra_type, sphere_rad,
+                                         path_length, concentration);
+        if (scat)
+            scat[i] = to_spectra_type(sca, spectra_type, sphere_rad,
+                                      path_length, concentration);
+        if (absorb)
+            absorb[i] = to_spectra_type(abso, spectra_type, sphere_rad,
+                                        path_length, concentration);
+
+    }
+
+    return returnvalue;
+
+}
+
+ErrorCode npspec_dda(const NanoparticleShape shape,     /* Shape of the particle */
+                     const double rad[2],               /* Radius on Z and XY */
+                     const int indx,                    /* Material index */
+                     const double mrefrac,              /* Refractive index of medium */
+                     const bool size_correct,           /* Use size correction? */
+                     const int increment,               /* Increment of wavelengths */
+                     const double path_length,          /* Path length for absorbance */
+                     const double concentration,        /* The concentration of solution */
+                     const SpectraType spectra_type,    /* What spectra to return */
+                     const int resolution,              /* Dipoles across the particle */
+                     double extinct[],                  /* Extinction */
+                     double scat[],                     /* Scattering */
+                     double absorb[]                    /* Absorption */
+                   )
+{
+
+    NPSPEC_COUNT(NPSpecCalls);
+    NPSPEC_TIME(PhaseTotal);
+
+    /* Verify conditions are correct */
+    if (path_length <= 0.0)
+        return InvalidPathLength;
+    if (concentration <= 0.0)
+        return InvalidConcentration;
+    if (mrefrac <= 0.0)
+        return InvalidRefractiveIndex;
+    if (rad[0] <= 0.0 || ( shape != Sphere && rad[1] <= 0.0 ))
+        return InvalidRadius;
+    if (shape == Rod && rad[0] < rad[1])
+        return InvalidRadius;
+    if (resolution < 1)
+        return InvalidResolution;
+
+    /* Make sure the increment is a factor of 800, and is positive */
+    if (increment < 0)
+        return InvalidIncrement;
+    else if (fmod(static_cast<double>(NLAMBDA),
+                  static_cast<double>(increment)) > 0.000001)
+        return InvalidIncrement;
+
+    /* Spectra are relative to the sphere of the same volume */
+    DDA dda(shape, rad, resolution);
+    const double sphere_rad = dda.volume_radius();
+
+    ErrorCode returnvalue = NoError;
+    for (int i = 0; i < NLAMBDA; i += increment) {
+
+        /* Determine the wavenumber, and skip if too small */
+        double k = 2.0 * pi * mrefrac / wavelengths[i];
+        if (k * sphere_rad < 0.1E-6) {
+            NPSPEC_COUNT(WavelengthsSkipped);
+            continue;
+        }
+        NPSPEC_COUNT(WavelengthsEvaluated);
+
+        /* The dielectric relative to the medium */
+        complex<double> dielec = layer_dielectric(indx, i, size_correct,
+                                                  sphere_rad);
+
+        double ext, sca, abso;
+        if (dda.solve(dielec / sqr(mrefrac), k, &ext, &sca, &abso) > 0) {
+            NPSPEC_COUNT(SizeWarnings);
+            returnvalue = SizeWarning;
+        }
+
+        if (extinct)
+            extinct[i] = to_spectra_type(ext, spectra_type, sphere_rad,
+                                         path_length, concentration);
+        if (scat)
+            scat[i] = to_spectra_type(sca, spectra_type, sphere_rad,
+                                      path_length, concentration);
+        if (absorb)
+            absorb[i] = to_spectra_type(abso, spectra_type, sphere_rad,
+                                        path_length, concentration);
+
+    }
+
+    return returnvalue;
+
+}
+
+ErrorCode npspec_cluster(const int nparticles,             /* Number of particles */
+                         const double positions[][3],      /* Center of each particle */
+                         const int nlayers,                /* Number of layers */
+                         const double radius,              /* Radius of each sphere */
+                         const double rel_rad[],           /* Relative radii of layers */
+                         const int indx[],                 /* Material index of layers */
+                         const double mrefrac,             /* Refractive index of medium */
+                         const bool size_correct,          /* Use size correction? */
+                         const int increment,              /* Increment of wavelengths */
+                         const double path_length,         /* Path length for absorbance */
+                         const double concentration,       /* The concentration of solution */
+                         const SpectraType spectra_type,   /* What spectra to return */
+                         double extinct[],                 /* Extinction */
+                         double scat[],                    /* Scattering */
+                         double absorb[]                   /* Absorption */
+                       )
+{
+
+    NPSPEC_COUNT(NPSpecCalls);
+    NPSPEC_TIME(PhaseTotal);
+
+    /* Verify conditions are correct */
+    if (nlayers < 1)
+        return InvalidNumberOfLayers;
+    if (path_length <= 0.0)
+        return InvalidPathLength;
+    if (concentration <= 0.0)
+        return InvalidConcentration;
+    if (mrefrac <= 0.0)
+        return InvalidRefractiveIndex;
+    if (radius <= 0.0)
+        return InvalidRadius;
+
+    /* Relative radii must sum to 1.0 */
+    double rradsum = 0.0;
+    for (int i = 0; i < nlayers; ++i) {
+        if (rel_rad[i] < 0.0)
+            return InvalidRelativeRadius;
+        rradsum += rel_rad[i];
+    }
+    if (abs(rradsum - 1.0) > 1e-6)
+        return InvalidRelativeRadius;
+
+    /* The spheres may touch but not overlap */
+    if (nparticles < 1 || cluster_overlaps(nparticles, positions, radius))
+        return InvalidPositions;
+
+    /* Make sure the increment is a factor of 800, and is positive */
+    if (increment < 0)
+        return InvalidIncrement;
+    else if (fmod(static_cast<double>(NLAMBDA),
+                  static_cast<double>(increment)) > 0.000001)
+        return InvalidIncrement;
+
+    /* Spectra are relative to the sphere of the same volume as the
+       whole cluster */
+    Cluster cluster(nparticles, positions);
+    const double sphere_rad = radius * cbrt(static_cast<double>(nparticles));
+    const double area = pi * sqr(sphere_rad);
+
+    vector< complex<double> > refrac_indx(nlayers);
+    double peak = 0.0, peak_higher = 0.0;
+    ErrorCode returnvalue = NoError;
+    for (int i = 0; i < NLAMBDA; i += increment) {
+
+        /* Determine the size parameter of each sphere, and skip if too
+           small */
+        double k = 2.0 * pi * mrefrac / wavelengths[i];
+        double size_param = k * radius;
+        if (size_param < 0.1E-6) {
+            NPSPEC_COUNT(WavelengthsSkipped);
+            continue;
+        }
+        NPSPEC_COUNT(WavelengthsEvaluated);
+
+        /* The refractive index of each layer relative to the medium */
+        for (int j = 0; j < nlayers; ++j) {
+            complex<double> dielec = layer_dielectric(indx[j], i, size_correct,
+                                                      radius);
+            double tmp0 = abs(dielec);
+            refrac_indx[j] = complex<double>(sqrt(( tmp0 + real(dielec) ) / 2.0),
+                                             sqrt(( tmp0 - real(dielec) ) / 2.0))
+                           / mrefrac;
+        }
+
+        /* The isolated sphere, and the part of it that is not its electric
+           dipole.  A sphere too large for the series has no coefficients,
+           so is left uncoupled. */
+        SeriesArray< complex<double> > ra(nm(size_param)), rb(nm(size_param));
+        int nterms = 0;
+        double qext, qsca, qabs, dext = 0.0, dsca = 0.0, unused;
+        mie_coefficients(nlayers, &refrac_indx[0], rel_rad, size_param,
+                         ra, rb, &nterms);
+        if (nterms > 0) {
+            mie_efficiencies(MieExtinction | MieScattering, size_param, nterms,
+                             ra, rb, &qext, &qsca, &qabs, &unused, &unused,
+                             &unused, &unused);
+            mie_multipoles(size_param, nterms, ra, rb, 1, &dext, NULL,
+                           &dsca, NULL);
+        } else {
+            mie_geometric(nlayers, &refrac_indx[0], rel_rad, size_param,
+                          MieExtinction | MieScattering, &qext, &qsca, &qabs,
+                          &unused, &unused, &unused, &unused);
+            ra[0] = 0.0;
+        }
+        const double hext = qext - dext, hsca = qsca - dsca;
+        peak = max(peak, qext);
+        peak_higher = max(peak_higher, fabs(hext));
+        if (nterms == 0) {
+            NPSPEC_COUNT(SizeWarnings);
+            returnvalue = SizeWarning;
         }
 
+        /* Couple the electric dipoles, and add back the rest */
+        double ext, sca, abso;
+        if (cluster.solve(ra[0], k, &ext, &sca, &abso) > 0) {
+            NPSPEC_COUNT(SizeWarnings);
+            returnvalue = SizeWarning;
+        }
+        const double each = nparticles * pi * sqr(radius);
+        ext  = ( ext + each * hext ) / area;
+        sca  = ( sca + each * hsca ) / area;
+        abso = ( abso + each * ( hext - hsca ) ) / area;
+
+        if (extinct)
+            extinct[i] = to_spectra_type(ext, spectra_type, sphere_rad,
+                                         path_length, concentration);
+        if (scat)
+            scat[i] = to_spectra_type(sca, spectra_type, sphere_rad,
+                                      path_length, concentration);
+        if (absorb)
+            absorb[i] = to_spectra_type(abso, spectra_type, sphere_rad,
+                                        path_length, concentration);
+
+    }
+
+    /* The uncoupled multipoles must be small beside the dipole */
+    if (peak_higher > CLUSTER_MAXHIGHER * peak) {
+        NPSPEC_COUNT(SizeWarnings);
+        returnvalue = SizeWarning;
     }
 
     return returnvalue;
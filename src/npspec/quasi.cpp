@@ -6,15 +6,25 @@
  * axes 2 and 2 move together.  This allows us to use analytical
  * formulas for the geometrical factors.
  *
+ * Any number of layers is found by replacing the core and each
+ * shell in turn by the homogeneous ellipsoid that polarizes the
+ * same way, which is exact for confocal layers.
+ *
  * Seth M. Morton
  *******************************************************************/
 
 #include "npspec/private/solvers.hpp"
+#include "npspec/private/instrument.hpp"
+#include <algorithm>
 #include <cmath>
 #include <complex>
+#include <vector>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
-const int    MAXLAYERS = 2;
-const double pi        = 4.0 * atan(1.0);
+const double pi = 4.0 * atan(1.0);
 
 /* Square qnd quad functions */
 inline double sqr(double x) { return x*x; }
@@ -22,136 +32,270 @@ inline double quad(double x) { return x*x*x*x; }
 
 using namespace std;
 
-int quasi (const int nlayers,              /* Number of layers */
-           const complex<double> dielec[], /* Dielectric for the layers */
-           const double mdie,              /* Dielectric of external medium */
-           const double rel_rad[][2],      /* Relative radii of the layers */
-           const double rad[2],            /* Radius of particle */
-           const double size_param,        /* Size parameter */
-           double *extinct,                /* Extinction */
-           double *scat,                   /* Scattering */
-           double *absorb)                 /* Absorption */
+/* The geometrical factors of an ellipsoid with the given radii */
+static void geometric_factors (const double radii[2], double gf[2])
 {
 
-    /*********************
-     * Perform some checks
-     *********************/
+    /* Determine if this is a prolate or oblate spheroid or a sphere */
+    if (fabs(radii[0] - radii[1]) < 1E-3) { /* Sphere */
 
-    /* Too many layers for quasistatic approximation */
-    if (nlayers > MAXLAYERS) return 1;
+        /* All values are 1/3 */
+        for (int i = 0; i < 2; ++i) { gf[i] = 1.0 / 3.0; }
 
-    /*******************************
-     *Calculate the relative volumes
-     *******************************/
+    } else if (radii[0] > radii[1]) { /* Prolate (cigar) */
 
-    double tmp[MAXLAYERS][3];
-    for (int i = 0; i < nlayers; ++i) {
-        for (int j = 0; j < 2; ++j) {
-            if (i == 0) {
-                tmp[i][j] = rel_rad[i][j];
-            } else {
-                tmp[i][j] = 0.0;
-            }
-        }
-    }
-    double rel_vol[MAXLAYERS];
-    rel_vol[0] = tmp[0][0] * tmp[0][1] * tmp[0][1];
-    for (int i = 1; i < nlayers; ++i) {
-        for (int j = 0; j < i+1; ++j) {
-            for (int k = 0; k < 3; ++k) {
-                tmp[i][k] += rel_rad[j][k];
-            }
-        }
-        rel_vol[i] = ( tmp[i][0]   * tmp[i][1]   * tmp[i][1] )
-                   - ( tmp[i-1][0] * tmp[i-1][1] * tmp[i-1][1] );
-    }
+        /* Determine long axis */
+        double e = 1.0 - ( radii[1] / radii[0] );
+        gf[0] = ( ( 1.0 - e ) / e )
+              * ( -1.0 + ( 1.0 / ( 2 * sqrt(e) ) )
+                 * log(( 1.0 + sqrt(e) ) / ( 1.0 - sqrt(e) ))
+                );
 
-    /***********************************************************
-     * Calculate the goemetrical factors for each axis and layer
-     ***********************************************************/
-   
-    double gf[2][MAXLAYERS];
-    for (int ilayer = 0; ilayer < nlayers; ++ilayer) {
+        /* Set short axes.  Total must be 1 */
+        gf[1] = ( 1.0 - gf[0] ) / 2.0;
 
-        /* Calculate the absolute radii */
-        double radii[2];
-        for (int i = 0; i < 2; ++i) { radii[i] = rel_rad[ilayer][i] * rad[i]; }
+    } else { /* Oblate (pancake) */
 
-        /* Determine if this is a prolate or oblate spheroid or a sphere */
-        if (fabs(radii[0] - radii[1]) < 1E-3) { /* Sphere */
+        /* Determine long axes */
+        double e = 1.0 - ( radii[0] / radii[1] );
+        double g = sqrt(( 1.0 - e ) / e);
+        gf[1] = ( g / ( 2.0 * e ) ) * ( ( pi / 2.0 ) - atan(g) )
+              - ( sqr(g) / 2.0 );
 
-            /* All values are 1/3 */
-            for (int i = 0; i < 2; ++i) { gf[i][ilayer] = 1.0 / 3.0; }
+        /* Set short axis.  Total must be 1 */
+        gf[0] = 1.0 - 2 * gf[1];
 
-        } else if (radii[0] > radii[1]) { /* Prolate (cigar) */
+    }
+
+}
 
-            /* Determine long axis */
-            double e = 1.0 - ( radii[1] / radii[0] );
-            gf[0][ilayer] = ( ( 1.0 - e ) / e )
-                          * ( -1.0 + ( 1.0 / ( 2 * sqrt(e) ) )
-                             * log(( 1.0 + sqrt(e) ) / ( 1.0 - sqrt(e) ))
-                            );
+void quasi_geometry (const int nlayers,         /* Number of layers */
+                     const double rel_rad[][2], /* Relative radii of the layers */
+                     const double rad[2],       /* Radius of particle */
+                     QuasiGeometry& geometry)   /* The geometry */
+{
 
-            /* Set short axes.  Total must be 1 */
-            gf[1][ilayer] = ( 1.0 - gf[0][ilayer] ) / 2.0;
+    geometry.nlayers = nlayers;
+    geometry.vol.resize(nlayers);
+    for (int i = 0; i < 2; ++i)
+        geometry.gf[i].resize(nlayers);
 
-        } else { /* Oblate (pancake) */
+    /* The radii of the outside of each layer, its volume relative
+       to the whole particle, and its geometrical factors */
+    double outer[2] = { 0.0, 0.0 };
+    for (int ilayer = 0; ilayer < nlayers; ++ilayer) {
+        for (int i = 0; i < 2; ++i)
+            outer[i] += rel_rad[ilayer][i];
+        geometry.vol[ilayer] = outer[0] * outer[1] * outer[1];
 
-            /* Determine long axes */
-            double e = 1.0 - ( radii[0] / radii[1] );
-            double g = sqrt(( 1.0 - e ) / e);
-            gf[1][ilayer] = ( g / ( 2.0 * e ) ) * ( ( pi / 2.0 ) - atan(g) )
-                          - ( sqr(g) / 2.0 );
+        double radii[2], gf[2];
+        for (int i = 0; i < 2; ++i) { radii[i] = outer[i] * rad[i]; }
+        geometric_factors(radii, gf);
+        for (int i = 0; i < 2; ++i) { geometry.gf[i][ilayer] = gf[i]; }
+    }
 
-            /* Set short axis.  Total must be 1 */
-            gf[0][ilayer] = 1.0 - 2 * gf[1][ilayer];
+}
 
-        }
+/* The kernels below work on the real and imaginary parts of every
+ * wavelength as separate arrays, so that with AVX four wavelengths are
+ * done at once.  The remainder, or everything without AVX, is done
+ * one wavelength at a time with the same arithmetic. */
 
+/* Replace the effective dielectric x of what is inside a shell with
+   that of the shell and its contents:
+       x = s + f s (x - s) / (s + g (x - s)) */
+static void apply_shell (const int n, const double f, const double g,
+                         const double sr[], const double si[],
+                         double xr[], double xi[])
+{
+    int k = 0;
+#ifdef __AVX__
+    const __m256d vf = _mm256_set1_pd(f);
+    const __m256d vg = _mm256_set1_pd(g);
+    for (; k + 4 <= n; k += 4) {
+        __m256d ar = _mm256_loadu_pd(&sr[k]);
+        __m256d ai = _mm256_loadu_pd(&si[k]);
+        __m256d dr = _mm256_sub_pd(_mm256_loadu_pd(&xr[k]), ar);
+        __m256d di = _mm256_sub_pd(_mm256_loadu_pd(&xi[k]), ai);
+        /* Numerator f s d */
+        __m256d nr = _mm256_mul_pd(vf, _mm256_sub_pd(_mm256_mul_pd(ar, dr),
+                                                     _mm256_mul_pd(ai, di)));
+        __m256d ni = _mm256_mul_pd(vf, _mm256_add_pd(_mm256_mul_pd(ar, di),
+                                                     _mm256_mul_pd(ai, dr)));
+        /* Denominator s + g d */
+        __m256d cr = _mm256_add_pd(ar, _mm256_mul_pd(vg, dr));
+        __m256d ci = _mm256_add_pd(ai, _mm256_mul_pd(vg, di));
+        __m256d inv = _mm256_div_pd(_mm256_set1_pd(1.0),
+                                    _mm256_add_pd(_mm256_mul_pd(cr, cr),
+                                                  _mm256_mul_pd(ci, ci)));
+        __m256d qr = _mm256_add_pd(_mm256_mul_pd(nr, cr), _mm256_mul_pd(ni, ci));
+        __m256d qi = _mm256_sub_pd(_mm256_mul_pd(ni, cr), _mm256_mul_pd(nr, ci));
+        _mm256_storeu_pd(&xr[k], _mm256_add_pd(ar, _mm256_mul_pd(qr, inv)));
+        _mm256_storeu_pd(&xi[k], _mm256_add_pd(ai, _mm256_mul_pd(qi, inv)));
+    }
+#endif
+    for (; k < n; ++k) {
+        double dr = xr[k] - sr[k], di = xi[k] - si[k];
+        double nr = f * ( sr[k] * dr - si[k] * di );
+        double ni = f * ( sr[k] * di + si[k] * dr );
+        double cr = sr[k] + g * dr, ci = si[k] + g * di;
+        double inv = 1.0 / ( cr * cr + ci * ci );
+        xr[k] = sr[k] + ( nr * cr + ni * ci ) * inv;
+        xi[k] = si[k] + ( ni * cr - nr * ci ) * inv;
     }
+}
 
-   /*********************************
-    * Determine the system dielectric
-    *********************************/
+/* Add the polarizability along an axis of an ellipsoid with the
+   effective dielectric x:
+       p = p + (x - m) / (3 m + 3 g (x - m)) */
+static void add_polarizability (const int n, const double m, const double g,
+                                const double xr[], const double xi[],
+                                double p_re[], double p_im[])
+{
+    int k = 0;
+#ifdef __AVX__
+    const __m256d vm = _mm256_set1_pd(m);
+    const __m256d v3m = _mm256_set1_pd(3.0 * m);
+    const __m256d v3g = _mm256_set1_pd(3.0 * g);
+    for (; k + 4 <= n; k += 4) {
+        __m256d nr = _mm256_sub_pd(_mm256_loadu_pd(&xr[k]), vm);
+        __m256d ni = _mm256_loadu_pd(&xi[k]);
+        __m256d cr = _mm256_add_pd(v3m, _mm256_mul_pd(v3g, nr));
+        __m256d ci = _mm256_mul_pd(v3g, ni);
+        __m256d inv = _mm256_div_pd(_mm256_set1_pd(1.0),
+                                    _mm256_add_pd(_mm256_mul_pd(cr, cr),
+                                                  _mm256_mul_pd(ci, ci)));
+        __m256d qr = _mm256_add_pd(_mm256_mul_pd(nr, cr), _mm256_mul_pd(ni, ci));
+        __m256d qi = _mm256_sub_pd(_mm256_mul_pd(ni, cr), _mm256_mul_pd(nr, ci));
+        _mm256_storeu_pd(&p_re[k], _mm256_add_pd(_mm256_loadu_pd(&p_re[k]),
+                                               _mm256_mul_pd(qr, inv)));
+        _mm256_storeu_pd(&p_im[k], _mm256_add_pd(_mm256_loadu_pd(&p_im[k]),
+                                               _mm256_mul_pd(qi, inv)));
+    }
+#endif
+    for (; k < n; ++k) {
+        double nr = xr[k] - m, ni = xi[k];
+        double cr = 3.0 * m + 3.0 * g * nr, ci = 3.0 * g * ni;
+        double inv = 1.0 / ( cr * cr + ci * ci );
+        p_re[k] += ( nr * cr + ni * ci ) * inv;
+        p_im[k] += ( ni * cr - nr * ci ) * inv;
+    }
+}
 
-    complex<double> die[2];
-    /* One layer */
-    if (nlayers == 1) {
-        for (int i = 0; i < 2; ++i) {
-            die[i] = ( dielec[0] - mdie ) 
-                   / ( 3.0 * ( mdie + gf[i][0] * ( dielec[0] - mdie ) ) );
-        }
-    /* Two layers */
-    } else if (nlayers == 2) {
-        /* Numerator and denominator */
-        complex<double> num[2], den[2];//, b = dielec[0] - dielec[1];
-        for (int i = 0; i < 2; ++i) {
-            /* Numerator */
-            num[i] = ( dielec[0] - dielec[1] ) 
-                   * ( gf[i][0] - rel_vol[0] * gf[i][1] );
-            num[i] = ( dielec[1] - mdie ) * ( dielec[1] + num[i] );
-            num[i] += rel_vol[0] * dielec[1] * ( dielec[0] - dielec[1] );
-            /* Denominator */
-            den[i] = ( dielec[0] - dielec[1] ) 
-                   * ( gf[i][0] - rel_vol[0] * gf[i][1] );
-            den[i] = ( dielec[1] + den[i] ) 
-                   * ( mdie + ( dielec[1] - mdie ) * gf[i][1] );
-            den[i] += rel_vol[0] * gf[i][1] * dielec[1] 
-                    * ( dielec[0] - dielec[1] );
-            /* The whole thing */
-            die[i] = num[i] / ( 3.0 * den[i] );
+void quasi_spectra (const QuasiGeometry& geometry, /* Geometry of the particle */
+                    const int nlambda,             /* Number of wavelengths */
+                    const double dielec_re[],      /* Dielectric for the layers, */
+                    const double dielec_im[],      /*   real and imaginary parts */
+                    const double mdie,             /* Dielectric of external medium */
+                    const double size_param[],     /* Size parameters */
+                    double extinct[],              /* Extinction */
+                    double scat[],                 /* Scattering */
+                    double absorb[],               /* Absorption */
+                    double absorb_axes[],          /* Absorption along Z and XY */
+                    double scat_axes[])            /* Scattering along Z and XY */
+{
+
+    NPSPEC_COUNT_N(QuasiCalls, nlambda);
+    NPSPEC_TIME(PhaseQuasi);
+
+    const int nlayers = geometry.nlayers;
+
+    /*********************************
+     * Determine the system dielectric
+     *********************************/
+
+    /* The core and the shell around it polarize as a homogeneous
+       ellipsoid the size of the shell with an effective dielectric,
+       which in turn is the core of the next shell.  Each layer is
+       applied to every wavelength at once. */
+    vector<double> die_re[2], die_im[2];
+    vector<double> eff_re(nlambda), eff_im(nlambda);
+    for (int i = 0; i < 2; ++i) {
+
+        const vector<double>& gf = geometry.gf[i];
+        copy(dielec_re, dielec_re + nlambda, eff_re.begin());
+        copy(dielec_im, dielec_im + nlambda, eff_im.begin());
+
+        for (int ilayer = 1; ilayer < nlayers; ++ilayer) {
+            /* Fraction of the volume inside this shell */
+            double f = geometry.vol[ilayer] > 0.0
+                     ? geometry.vol[ilayer-1] / geometry.vol[ilayer] : 0.0;
+            apply_shell(nlambda, f, gf[ilayer-1] - f * gf[ilayer],
+                        &dielec_re[ilayer * nlambda],
+                        &dielec_im[ilayer * nlambda],
+                        &eff_re[0], &eff_im[0]);
         }
+
+        die_re[i].assign(nlambda, 0.0);
+        die_im[i].assign(nlambda, 0.0);
+        add_polarizability(nlambda, mdie, gf[nlayers-1],
+                           &eff_re[0], &eff_im[0], &die_re[i][0], &die_im[i][0]);
+
     }
 
     /**************************
      * Calculate the properties
      **************************/
 
-    *absorb  = 4.0 * size_param * imag(die[0] + die[1] + die[1]) / 3.0;
-    *scat    = abs(( die[0] + die[1] + die[1] ) / 3.0);
-    *scat    = ( 8.0 / 3.0 ) * quad(size_param) * sqr(*scat);
-    *extinct = *absorb + *scat;
+    /* Averaged over orientation, where both short axes are the same */
+    for (int k = 0; k < nlambda; ++k) {
+        double dr = die_re[0][k] + 2.0 * die_re[1][k];
+        double di = die_im[0][k] + 2.0 * die_im[1][k];
+        absorb[k]  = 4.0 * size_param[k] * di / 3.0;
+        scat[k]    = ( sqr(dr) + sqr(di) ) / 9.0;
+        scat[k]    = ( 8.0 / 3.0 ) * quad(size_param[k]) * scat[k];
+        extinct[k] = absorb[k] + scat[k];
+    }
+
+    /* Light polarized along each axis */
+    for (int i = 0; i < 2; ++i) {
+        for (int k = 0; k < nlambda; ++k) {
+            if (absorb_axes != NULL)
+                absorb_axes[2*k+i] = 4.0 * size_param[k] * die_im[i][k];
+            if (scat_axes != NULL)
+                scat_axes[2*k+i] = ( 8.0 / 3.0 ) * quad(size_param[k])
+                                 * ( sqr(die_re[i][k]) + sqr(die_im[i][k]) );
+        }
+    }
+
+}
+
+int quasi (const int nlayers,              /* Number of layers */
+           const complex<double> dielec[], /* Dielectric for the layers */
+           const double mdie,              /* Dielectric of external medium */
+           const double rel_rad[][2],      /* Relative radii of the layers */
+           const double rad[2],            /* Radius of particle */
+           const double size_param,        /* Size parameter */
+           double *extinct,                /* Extinction */
+           double *scat,                   /* Scattering */
+           double *absorb)                 /* Absorption */
+{
+
+    /* A single wavelength, so each layer is one value */
+    vector<double> dielec_re(nlayers), dielec_im(nlayers);
+    for (int i = 0; i < nlayers; ++i) {
+        dielec_re[i] = real(dielec[i]);
+        dielec_im[i] = imag(dielec[i]);
+    }
+    QuasiGeometry geometry;
+    quasi_geometry(nlayers, rel_rad, rad, geometry);
+    quasi_spectra(geometry, 1, &dielec_re[0], &dielec_im[0], mdie,
+                  &size_param, extinct, scat, absorb, NULL, NULL);
 
     return 0;
 
 }
+
+/* An estimate of the relative error of the quasistatic approximation:
+   the leading correction in the size parameter, (m x)^2 / 2, for the
+   layer with the largest relative refractive index m */
+double quasi_error (const int nlayers,              /* Number of layers */
+                    const complex<double> dielec[], /* Dielectric for the layers */
+                    const double mdie,              /* Dielectric of external medium */
+                    const double size_param)        /* Size parameter */
+{
+    double emax = 1.0;
+    for (int i = 0; i < nlayers; ++i)
+        if (abs(dielec[i]) / mdie > emax) emax = abs(dielec[i]) / mdie;
+    return 0.5 * sqr(size_param) * emax;
+}
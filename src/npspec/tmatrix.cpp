@@ -0,0 +1,485 @@
+/*******************************************************************
+ * **********   tmatrix - Spheroids: 1 layer
+ *                        Theory:   exact (extended boundary condition)
+ *                        Results:  orientation averaged efficiency factors
+ * The T-matrix of a homogeneous spheroid is found from the surface
+ * integrals of the extended boundary condition method (Waterman),
+ * as set out by Mishchenko, Travis & Lacis, "Scattering, Absorption,
+ * and Emission of Light by Small Particles" (2002), chapter 5.
+ * Because the particle is axially symmetric the T-matrix splits into
+ * one block for each azimuthal order m, and the orientation averaged
+ * extinction and scattering follow from the trace of each block and
+ * the sum of the squares of its elements.
+ *
+ * The T-matrices are kept in a cache, keyed by the size parameters
+ * and the relative refractive index, so that a spectrum that is asked
+ * for again does not solve them again.  Those least recently used are
+ * dropped once the cache reaches TMATRIX_CACHE_BYTES.  The cache holds
+ * them by shared pointer, so a thread only takes the lock to find one,
+ * not to copy it, and one dropped while in use lives until it is done.
+ *******************************************************************/
+
+#include "npspec/npspec.h"
+#include "npspec/private/solvers.hpp"
+#include "npspec/private/instrument.hpp"
+#include <cmath>
+#include <complex>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+const double pi = 4.0 * atan(1.0);
+const complex<double> I(0.0, 1.0);
+
+inline double sqr(double x) { return x*x; }
+
+/* The number of terms for a size parameter (Wiscombe) */
+inline int tmatrix_terms(const double x) {
+    return static_cast<int>(x + 4.05 * cbrt(x) + 2.0);
+}
+
+/* The block of the T-matrix for one azimuthal order m.  It holds
+   the orders n = max(1, m), ..., nmax for both the M and N waves,
+   so is 2 (nmax - nmin + 1) square. */
+struct TMatrixBlock {
+    TMatrixBlock() : size(0), t() {}
+    int size;
+    vector< complex<double> > t;
+};
+
+/* The T-matrix of a spheroid, and whether it converged */
+struct TMatrix {
+    TMatrix() : nmax(0), converged(false), blocks() {}
+    int nmax;
+    bool converged;
+    vector<TMatrixBlock> blocks;
+    size_t bytes() const {
+        size_t n = sizeof(TMatrix);
+        for (size_t m = 0; m < blocks.size(); ++m)
+            n += sizeof(TMatrixBlock)
+               + blocks[m].t.size() * sizeof(complex<double>);
+        return n;
+    }
+};
+
+/*************************
+ * Special functions
+ *************************/
+
+/* Gauss-Legendre nodes and weights on [-1, 1] */
+static void gauss_legendre (const int n, double x[], double w[])
+{
+    for (int i = 0; i < ( n + 1 ) / 2; ++i) {
+        double z = cos(pi * ( i + 0.75 ) / ( n + 0.5 )), dp = 0.0;
+        for (int iter = 0; iter < 100; ++iter) {
+            double p0 = 1.0, p1 = 0.0;
+            for (int k = 0; k < n; ++k) {
+                double p2 = p1;
+                p1 = p0;
+                p0 = ( ( 2 * k + 1 ) * z * p1 - k * p2 ) / ( k + 1 );
+            }
+            dp = n * ( z * p0 - p1 ) / ( z * z - 1.0 );
+            double dz = p0 / dp;
+            z -= dz;
+            if (fabs(dz) < 1e-15)
+                break;
+        }
+        x[i] = -z;
+        x[n-1-i] = z;
+        w[i] = w[n-1-i] = 2.0 / ( ( 1.0 - z * z ) * dp * dp );
+    }
+}
+
+/* Spherical Bessel functions j(n) for n = 0, ..., nmax.  The ratios
+   j(n) / j(n-1) are found downwards, which is stable for any z, and
+   scaled by the larger of j(0) and j(1). */
+static void bessel_j (const int nmax, const complex<double> z,
+                      complex<double> j[])
+{
+    int nstart = nmax + 16 + static_cast<int>(abs(z));
+    vector< complex<double> > ratio(nmax + 1);
+    complex<double> r = 0.0;
+    for (int n = nstart; n >= 1; --n) {
+        r = z / ( 2.0 * n + 1.0 - z * r );
+        if (n <= nmax)
+            ratio[n] = r;
+    }
+    /* Scaled from whichever of j(0) and j(1) is larger, since either
+       vanishes at some z (j(0) at z = n pi) and is then only rounding */
+    const complex<double> j0 = sin(z) / z;
+    const complex<double> j1 = j0 / z - cos(z) / z;
+    j[0] = nmax < 1 || abs(j0) >= abs(j1) ? j0 : j1 / ratio[1];
+    for (int n = 1; n <= nmax; ++n)
+        j[n] = ratio[n] * j[n-1];
+}
+
+/* Spherical Bessel functions y(n) for n = 0, ..., nmax, found upwards */
+static void bessel_y (const int nmax, const double z, double y[])
+{
+    y[0] = -cos(z) / z;
+    if (nmax > 0)
+        y[1] = -cos(z) / ( z * z ) - sin(z) / z;
+    for (int n = 1; n < nmax; ++n)
+        y[n+1] = ( 2.0 * n + 1.0 ) / z * y[n] - y[n-1];
+}
+
+/* The Wigner functions d(n, 0, m) of theta, and their derivatives,
+   for n = 0, ..., nmax.  Those below n = m are zero. */
+static void wigner_d (const int nmax, const int m, const double x,
+                      const double s, double d[], double dd[])
+{
+    vector<double> dn(nmax + 2, 0.0);
+    double a = 1.0;
+    for (int k = 1; k <= m; ++k)
+        a *= sqrt(( 2.0 * k - 1.0 ) / ( 2.0 * k )) * s;
+    dn[m] = a;
+    for (int n = m; n <= nmax; ++n) {
+        double prev = n > m ? dn[n-1] : 0.0;
+        dn[n+1] = ( ( 2 * n + 1 ) * x * dn[n]
+                  - sqrt(static_cast<double>(n * n - m * m)) * prev )
+                / sqrt(static_cast<double>(( n + 1 ) * ( n + 1 ) - m * m));
+    }
+    for (int n = 0; n <= nmax; ++n) {
+        d[n] = dn[n];
+        dd[n] = 0.0;
+        if (n < m || n == 0)
+            continue;
+        double prev = n > m ? dn[n-1] : 0.0;
+        dd[n] = ( n * sqrt(static_cast<double>(( n + 1 ) * ( n + 1 ) - m * m)) * dn[n+1]
+                - ( n + 1 ) * sqrt(static_cast<double>(n * n - m * m)) * prev )
+              / ( ( 2 * n + 1 ) * s );
+    }
+}
+
+/*************************
+ * Linear algebra
+ *************************/
+
+/* Solve for T in T Q = -R, where all are n by n and row major.
+   Q is overwritten by its LU factors, and R by T. */
+static void solve_right (const int n, vector< complex<double> >& q,
+                         vector< complex<double> >& r)
+{
+    /* Factor the transpose of Q, so the rows of T are its solutions */
+    vector<int> piv(n);
+    vector< complex<double> > a(n * n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            a[i*n+j] = q[j*n+i];
+    for (int k = 0; k < n; ++k) {
+        int p = k;
+        for (int i = k + 1; i < n; ++i)
+            if (abs(a[i*n+k]) > abs(a[p*n+k])) p = i;
+        piv[k] = p;
+        if (p != k)
+            for (int j = 0; j < n; ++j)
+                swap(a[k*n+j], a[p*n+j]);
+        for (int i = k + 1; i < n; ++i) {
+            complex<double> f = a[i*n+k] / a[k*n+k];
+            a[i*n+k] = f;
+            for (int j = k + 1; j < n; ++j)
+                a[i*n+j] -= f * a[k*n+j];
+        }
+    }
+    vector< complex<double> > b(n);
+    for (int row = 0; row < n; ++row) {
+        for (int i = 0; i < n; ++i)
+            b[i] = -r[row*n+i];
+        for (int k = 0; k < n; ++k)
+            swap(b[k], b[piv[k]]);
+        for (int i = 1; i < n; ++i)
+            for (int k = 0; k < i; ++k)
+                b[i] -= a[i*n+k] * b[k];
+        for (int i = n - 1; i >= 0; --i) {
+            for (int k = i + 1; k < n; ++k)
+                b[i] -= a[i*n+k] * b[k];
+            b[i] /= a[i*n+i];
+        }
+        for (int i = 0; i < n; ++i)
+            r[row*n+i] = b[i];
+    }
+    q.swap(a);
+}
+
+/*************************
+ * The T-matrix
+ *************************/
+
+/* The vector spherical wave functions at one point of the surface,
+   without the factor exp(i m phi), as r, theta and phi components */
+struct Waves {
+    complex<double> m[3];
+    complex<double> n[3];
+};
+
+/* The waves of order n for azimuthal order mu, from the spherical
+   Bessel functions z of kr and the Wigner functions of theta */
+static void waves (const int n, const int mu, const complex<double> kr,
+                   const complex<double> z[], const double d[],
+                   const double dd[], const double s, Waves& w)
+{
+    double gamma = sqrt(( 2.0 * n + 1.0 ) / ( 4.0 * pi * n * ( n + 1.0 ) ));
+    complex<double> pim = I * static_cast<double>(mu) * d[n] / s;
+    complex<double> zeta = z[n-1] - static_cast<double>(n) * z[n] / kr;
+    w.m[0] = 0.0;
+    w.m[1] = gamma * z[n] * pim;
+    w.m[2] = -gamma * z[n] * dd[n];
+    w.n[0] = gamma * n * ( n + 1.0 ) * z[n] / kr * d[n];
+    w.n[1] = gamma * zeta * dd[n];
+    w.n[2] = gamma * zeta * pim;
+}
+
+/* n . (a x b) dS / (sin theta dtheta dphi) on the surface r(theta) */
+inline complex<double> surface (const complex<double> a[3],
+                                const complex<double> b[3],
+                                const double r, const double dr) {
+    return r * r * ( a[1] * b[2] - a[2] * b[1] )
+         - r * dr * ( a[2] * b[0] - a[0] * b[2] );
+}
+
+/* The T-matrix of a spheroid with size parameters xz and xxy along
+   its axes and relative refractive index m, up to order nmax */
+static void solve_tmatrix (const complex<double> m, const double xz,
+                           const double xxy, const int nmax, TMatrix& tm)
+{
+
+    /* The surface, sampled at Gauss points in cos(theta) */
+    const int ng = 4 * nmax + 16;
+    vector<double> x(ng), w(ng), r(ng), dr(ng);
+    gauss_legendre(ng, &x[0], &w[0]);
+    for (int g = 0; g < ng; ++g) {
+        double s2 = 1.0 - x[g] * x[g];
+        r[g]  = 1.0 / sqrt(x[g] * x[g] / sqr(xz) + s2 / sqr(xxy));
+        dr[g] = -r[g] * r[g] * r[g] * sqrt(s2) * x[g]
+              * ( 1.0 / sqr(xxy) - 1.0 / sqr(xz) );
+    }
+
+    /* The Bessel functions at each point, outside and inside */
+    vector< complex<double> > jout(ng * ( nmax + 1 )), hout(ng * ( nmax + 1 ));
+    vector< complex<double> > jin(ng * ( nmax + 1 ));
+    vector<double> y(nmax + 1);
+    for (int g = 0; g < ng; ++g) {
+        complex<double> *jo = &jout[g*(nmax+1)];
+        bessel_j(nmax, r[g], jo);
+        bessel_y(nmax, r[g], &y[0]);
+        for (int n = 0; n <= nmax; ++n)
+            hout[g*(nmax+1)+n] = jo[n] + I * y[n];
+        bessel_j(nmax, m * r[g], &jin[g*(nmax+1)]);
+    }
+
+    tm.nmax = nmax;
+    tm.blocks.resize(nmax + 1);
+    vector<double> d(nmax + 1), dd(nmax + 1);
+    for (int am = 0; am <= nmax; ++am) {
+
+        const int nmin = max(1, am);
+        const int l = nmax - nmin + 1;
+        const int size = 2 * l;
+
+        /* The surface integrals J(ab) for the waves a inside, of order
+           n' and azimuthal order m, and b outside, of order n and
+           azimuthal order -m.  The integral over phi is 2 pi. */
+        vector< complex<double> > j[2][2], rj[2][2];
+        for (int a = 0; a < 2; ++a)
+            for (int b = 0; b < 2; ++b) {
+                j[a][b].assign(l * l, 0.0);
+                rj[a][b].assign(l * l, 0.0);
+            }
+        vector<Waves> in(l), out(l), rout(l);
+        for (int g = 0; g < ng; ++g) {
+            double s = sqrt(1.0 - x[g] * x[g]);
+            wigner_d(nmax, am, x[g], s, &d[0], &dd[0]);
+            /* (-1)^m d(n, 0, -m) is d(n, 0, m) */
+            for (int k = 0; k < l; ++k) {
+                int n = nmin + k;
+                waves(n, am, m * r[g], &jin[g*(nmax+1)], &d[0], &dd[0], s, in[k]);
+                waves(n, -am, r[g], &hout[g*(nmax+1)], &d[0], &dd[0], s, out[k]);
+                waves(n, -am, r[g], &jout[g*(nmax+1)], &d[0], &dd[0], s, rout[k]);
+            }
+            double wg = 2.0 * pi * w[g];
+            for (int k = 0; k < l; ++k) {           /* n, outside */
+                for (int kp = 0; kp < l; ++kp) {    /* n', inside */
+                    const complex<double> *a[2] = { in[kp].m, in[kp].n };
+                    const complex<double> *b[2] = { out[k].m, out[k].n };
+                    const complex<double> *rb[2] = { rout[k].m, rout[k].n };
+                    for (int ia = 0; ia < 2; ++ia)
+                        for (int ib = 0; ib < 2; ++ib) {
+                            j[ia][ib][k*l+kp]  += wg * surface(a[ia], b[ib], r[g], dr[g]);
+                            rj[ia][ib][k*l+kp] += wg * surface(a[ia], rb[ib], r[g], dr[g]);
+                        }
+                }
+            }
+        }
+
+        /* Q and RgQ from the integrals, then T = -RgQ Q^-1 */
+        vector< complex<double> > q(size * size), rq(size * size);
+        for (int k = 0; k < l; ++k) {
+            for (int kp = 0; kp < l; ++kp) {
+                int e11 = k * size + kp,       e12 = k * size + l + kp;
+                int e21 = ( l + k ) * size + kp, e22 = ( l + k ) * size + l + kp;
+                int e = k * l + kp;
+                q[e11]  = -I * m * j[1][0][e]  - I * j[0][1][e];
+                q[e12]  = -I * m * j[0][0][e]  - I * j[1][1][e];
+                q[e21]  = -I * m * j[1][1][e]  - I * j[0][0][e];
+                q[e22]  = -I * m * j[0][1][e]  - I * j[1][0][e];
+                rq[e11] = -I * m * rj[1][0][e] - I * rj[0][1][e];
+                rq[e12] = -I * m * rj[0][0][e] - I * rj[1][1][e];
+                rq[e21] = -I * m * rj[1][1][e] - I * rj[0][0][e];
+                rq[e22] = -I * m * rj[0][1][e] - I * rj[1][0][e];
+            }
+        }
+        solve_right(size, q, rq);
+        tm.blocks[am].size = size;
+        tm.blocks[am].t.swap(rq);
+
+    }
+
+}
+
+/* The orientation averaged efficiencies from the trace of each block
+   and the sum of the squares of its elements.  Each block with m > 0
+   also stands for that of -m. */
+static void tmatrix_efficiencies (const TMatrix& tm, const double xv,
+                                  double *extinct, double *scat)
+{
+    double ext = 0.0, sca = 0.0;
+    for (int am = 0; am <= tm.nmax; ++am) {
+        const TMatrixBlock& b = tm.blocks[am];
+        double weight = am == 0 ? 1.0 : 2.0;
+        double tr = 0.0, sq = 0.0;
+        for (int i = 0; i < b.size; ++i)
+            tr += real(b.t[i*b.size+i]);
+        for (size_t i = 0; i < b.t.size(); ++i)
+            sq += norm(b.t[i]);
+        ext += weight * tr;
+        sca += weight * sq;
+    }
+    *extinct = -2.0 * ext / sqr(xv);
+    *scat    =  2.0 * sca / sqr(xv);
+}
+
+/*************************
+ * The cache
+ *************************/
+
+struct TMatrixKey {
+    double xz, xxy, mr, mi;
+    bool operator< (const TMatrixKey& o) const {
+        if (xz != o.xz) return xz < o.xz;
+        if (xxy != o.xxy) return xxy < o.xxy;
+        if (mr != o.mr) return mr < o.mr;
+        return mi < o.mi;
+    }
+};
+
+/* The most recently used T-matrices, shared by every thread */
+class TMatrixCache {
+public:
+    typedef shared_ptr<const TMatrix> Pointer;
+    typedef pair<TMatrixKey, Pointer> Entry;
+    TMatrixCache() : lock(), entries(), index(), bytes(0) {}
+    /* A cached T-matrix, marking it as just used, or NULL */
+    Pointer find(const TMatrixKey& key) {
+        lock_guard<mutex> guard(lock);
+        map<TMatrixKey, list<Entry>::iterator>::iterator it = index.find(key);
+        if (it == index.end())
+            return Pointer();
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+    }
+    /* Add a T-matrix, dropping the least recently used to make room */
+    void insert(const TMatrixKey& key, const Pointer& tm) {
+        lock_guard<mutex> guard(lock);
+        if (index.count(key) > 0)
+            return;
+        entries.push_front(Entry(key, tm));
+        index[key] = entries.begin();
+        bytes += tm->bytes();
+        while (bytes > TMATRIX_CACHE_BYTES && entries.size() > 1) {
+            bytes -= entries.back().second->bytes();
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+    void clear() {
+        lock_guard<mutex> guard(lock);
+        entries.clear();
+        index.clear();
+        bytes = 0;
+    }
+    int size() {
+        lock_guard<mutex> guard(lock);
+        return static_cast<int>(entries.size());
+    }
+private:
+    mutex lock;
+    list<Entry> entries;
+    map<TMatrixKey, list<Entry>::iterator> index;
+    size_t bytes;
+};
+
+static TMatrixCache cache;
+
+int tmatrix (const complex<double> refrac_indx, /* Relative refractive index */
+             const double size_param[2],        /* Along the Z and XY axes */
+             double *extinct,                   /* Extinction */
+             double *scat,                      /* Scattering */
+             double *absorb)                    /* Absorption */
+{
+
+    NPSPEC_COUNT(TMatrixCalls);
+    NPSPEC_TIME(PhaseTMatrix);
+
+    /* Efficiencies are relative to the sphere of the same volume */
+    const double xv = cbrt(size_param[0] * sqr(size_param[1]));
+
+    TMatrixKey key = { size_param[0], size_param[1],
+                       real(refrac_indx), imag(refrac_indx) };
+    TMatrixCache::Pointer found = cache.find(key);
+    if (found) {
+        NPSPEC_COUNT(TMatrixCacheHits);
+    } else {
+        shared_ptr<TMatrix> tm(new TMatrix());
+
+        /* Start from the terms needed for the longest axis and add more
+           until two solutions agree.  Elongated particles need more than
+           that axis suggests, but past TMATRIX_MAXTERMS the method loses
+           accuracy to round off, so the particle is too large or too
+           elongated if they have not agreed by then. */
+        int nmax = min(tmatrix_terms(max(size_param[0], size_param[1])),
+                       TMATRIX_MAXTERMS - TMATRIX_CHECKTERMS);
+        double ext0, sca0, ext1, sca1;
+        solve_tmatrix(refrac_indx, size_param[0], size_param[1], nmax, *tm);
+        tmatrix_efficiencies(*tm, xv, &ext0, &sca0);
+        tm->converged = false;
+        while (!tm->converged && nmax + TMATRIX_CHECKTERMS <= TMATRIX_MAXTERMS) {
+            nmax += TMATRIX_CHECKTERMS;
+            solve_tmatrix(refrac_indx, size_param[0], size_param[1], nmax, *tm);
+            tmatrix_efficiencies(*tm, xv, &ext1, &sca1);
+            tm->converged = fabs(ext1 - ext0) <= TMATRIX_TOLERANCE * fabs(ext1)
+                         && fabs(sca1 - sca0) <= TMATRIX_TOLERANCE * fabs(sca1);
+            ext0 = ext1;
+            sca0 = sca1;
+        }
+        cache.insert(key, tm);
+        found = tm;
+    }
+
+    tmatrix_efficiencies(*found, xv, extinct, scat);
+    *absorb = *extinct - *scat;
+
+    return found->converged ? 0 : 1;
+
+}
+
+void npspec_tmatrix_cache_clear(void) {
+    cache.clear();
+}
+
+int npspec_tmatrix_cache_size(void) {
+    return cache.size();
+}
@@ -45,6 +45,9 @@ contains
         call run_test_case(TestCrossSection, 'TestCrossSection')
         call run_test_case(TestMolar, 'TestMolar')
         call run_test_case(TestAbsorption, 'TestAbsorption')
+        call run_test_case(TestBatch, 'TestBatch')
+        call run_test_case(TestThreadedScalar, 'TestThreadedScalar')
+        call run_test_case(TestThreadedBatch, 'TestThreadedBatch')
     end subroutine
 
     subroutine setup
@@ -246,8 +249,10 @@ contains
                          medium_refrac, size_correct, 1, 1.0d0, 1.0d0, Efficiency,&
                          qext, qscat, qabs)
 
-        ! This should fail
-        call assert_equals(InvalidNumberOfLayers, retval)
+        ! Any number of layers is solved
+        call assert_equals(NoError, retval)
+        call assert_true(all(qabs > 0.0d0))
+        call assert_equals(qext, qabs + qscat, NLAMBDA, 1d-14)
 
     end subroutine
 
@@ -413,17 +418,17 @@ contains
 
         call assert_equals(NoError, retval)
         ! Extinction
-        call assert_equals(2.8328562530696506d0, qext(1),   1d-14)
-        call assert_equals(2.0565291634339800d0, qext(251), 1d-14)
-        call assert_equals(0.0970864882507346d0, qext(501), 1d-14)
+        call assert_equals(1.5067119967850175d0, qext(1),   1d-14)
+        call assert_equals(2.6863112245281928d0, qext(251), 1d-14)
+        call assert_equals(0.4513551852244120d0, qext(501), 1d-14)
         ! Scattering
-        call assert_equals(1.0698792522825473d0, qscat(1),   1d-14)
-        call assert_equals(1.4426586799505641d0, qscat(251), 1d-14)
-        call assert_equals(0.0718406948561757d0, qscat(501), 1d-14)
+        call assert_equals(0.5179788913931199d0, qscat(1),   1d-14)
+        call assert_equals(1.1588662887245067d0, qscat(251), 1d-14)
+        call assert_equals(0.2416484775550201d0, qscat(501), 1d-14)
         ! Absorption
-        call assert_equals(1.7629770007871033d0, qabs(1),   1d-14)
-        call assert_equals(0.6138704834834159d0, qabs(251), 1d-14)
-        call assert_equals(0.0252457933945589d0, qabs(501), 1d-14)
+        call assert_equals(0.9887331053918976d0, qabs(1),   1d-14)
+        call assert_equals(1.5274449358036861d0, qabs(251), 1d-14)
+        call assert_equals(0.2097067076693919d0, qabs(501), 1d-14)
 
     end subroutine
 
@@ -483,11 +488,11 @@ contains
                          qext2, qscat2, qabs2)
         call assert_equals(NoError, retval)
         ! Extinction
-        call assert_equals(qext2, qext * pi * radius(1)**2, NLAMBDA, 1d-14)
+        call assert_equals(qext2, qext * (pi * radius(1)**2), NLAMBDA, 1d-14)
         ! Scattering
-        call assert_equals(qscat2, qscat * pi * radius(1)**2, NLAMBDA, 1d-14)
+        call assert_equals(qscat2, qscat * (pi * radius(1)**2), NLAMBDA, 1d-14)
         ! Absorbance
-        call assert_equals(qabs2, qabs * pi * radius(1)**2, NLAMBDA, 1d-14)
+        call assert_equals(qabs2, qabs * (pi * radius(1)**2), NLAMBDA, 1d-14)
     end subroutine
 
     subroutine TestMolar
@@ -557,6 +562,142 @@ contains
                                        * path_length * molarity, NLAMBDA, 1d-7)
     end subroutine
 
+    subroutine TestBatch
+        integer(C_INT),  parameter :: nlayers = 2
+        integer(C_INT),  parameter :: nparticles = 3
+        real(C_DOUBLE),  parameter :: medium_refrac = 1.0d0
+        logical(C_BOOL), parameter :: size_correct = .false.
+        real(C_DOUBLE) :: radius(2,nparticles), rel_rad(2,nlayers,nparticles)
+        integer(C_INT) :: indx(nlayers,nparticles), retcodes(nparticles)
+        real(C_DOUBLE) :: bext(NLAMBDA,nparticles), bscat(NLAMBDA,nparticles)
+        real(C_DOUBLE) :: babs(NLAMBDA,nparticles)
+        integer(C_INT) :: retval, i
+        call setup
+!       A sphere, a bigger sphere and an ellipsoid
+        radius(:,1) = (/ 10.0d0, -1.0d0 /)
+        radius(:,2) = (/ 30.0d0, -1.0d0 /)
+        radius(:,3) = (/ 15.0d0, 10.0d0 /)
+        do i = 1, nparticles
+            rel_rad(:,:,i) = relative_radius_spheroid2
+            indx(:,i) = index2
+        end do
+        retval = npspec_batch(nparticles, nlayers, radius, rel_rad, indx, &
+                              medium_refrac, size_correct, 1, 1.0d0, 1.0d0, &
+                              Efficiency, bext, bscat, babs, retcodes)
+        call assert_equals(NoError, retval)
+!       Each column must be the same as calling npspec on its own
+        do i = 1, nparticles
+            call assert_equals(NoError, retcodes(i))
+            retval = npspec(nlayers, radius(:,i), rel_rad(:,:,i), indx(:,i), &
+                            medium_refrac, size_correct, 1, 1.0d0, 1.0d0, &
+                            Efficiency, qext, qscat, qabs)
+            call assert_equals(qext,  bext(:,i),  NLAMBDA, 1d-14)
+            call assert_equals(qscat, bscat(:,i), NLAMBDA, 1d-14)
+            call assert_equals(qabs,  babs(:,i),  NLAMBDA, 1d-14)
+        end do
+!       Errors are reported per particle
+        radius(1,2) = -5.0d0
+        retval = npspec_batch(nparticles, nlayers, radius, rel_rad, indx, &
+                              medium_refrac, size_correct, 1, 1.0d0, 1.0d0, &
+                              Efficiency, bext, bscat, babs, retcodes)
+        call assert_equals(InvalidRadius, retval)
+        call assert_equals(NoError, retcodes(1))
+        call assert_equals(InvalidRadius, retcodes(2))
+        call assert_equals(NoError, retcodes(3))
+    end subroutine
+
+    subroutine TestThreadedScalar
+        integer(C_INT),  parameter :: nlayers = 1
+        integer(C_INT),  parameter :: nparticles = 16
+        real(C_DOUBLE),  parameter :: medium_refrac = 1.0d0
+        logical(C_BOOL), parameter :: size_correct = .true.
+        real(C_DOUBLE) :: radius(2), text(NLAMBDA), tscat(NLAMBDA), tabs(NLAMBDA)
+        real(C_DOUBLE) :: sabs(NLAMBDA,nparticles), pabs(NLAMBDA,nparticles)
+        real(C_DOUBLE) :: scolor(6,nparticles), pcolor(6,nparticles)
+        integer(C_INT) :: sret(nparticles), pret(nparticles)
+        integer :: i
+        call setup
+!       Serial reference
+        do i = 1, nparticles
+            radius = (/ 2.0d0 * i, -1.0d0 /)
+            sret(i) = npspec(nlayers, radius, relative_radius_spheroid1, index1, &
+                             medium_refrac, size_correct, 1, 1.0d0, 1.0d0, &
+                             Efficiency, text, tscat, tabs)
+            sabs(:,i) = tabs
+            call RGB(tabs, 1, .false._C_BOOL, scolor(1,i), scolor(2,i), scolor(3,i))
+            call RGB_to_HSV(scolor(1,i), scolor(2,i), scolor(3,i), &
+                            scolor(4,i), scolor(5,i), scolor(6,i))
+        end do
+!       The same thing from a threaded loop must give identical answers
+        !$omp parallel do private(i, radius, text, tscat, tabs) schedule(dynamic)
+        do i = 1, nparticles
+            radius = (/ 2.0d0 * i, -1.0d0 /)
+            pret(i) = npspec(nlayers, radius, relative_radius_spheroid1, index1, &
+                             medium_refrac, size_correct, 1, 1.0d0, 1.0d0, &
+                             Efficiency, text, tscat, tabs)
+            pabs(:,i) = tabs
+            call RGB(tabs, 1, .false._C_BOOL, pcolor(1,i), pcolor(2,i), pcolor(3,i))
+            call RGB_to_HSV(pcolor(1,i), pcolor(2,i), pcolor(3,i), &
+                            pcolor(4,i), pcolor(5,i), pcolor(6,i))
+        end do
+        !$omp end parallel do
+        do i = 1, nparticles
+            call assert_equals(sret(i), pret(i))
+            call assert_equals(sabs(:,i), pabs(:,i), NLAMBDA, 0d0)
+            call assert_equals(scolor(:,i), pcolor(:,i), 6, 0d0)
+        end do
+    end subroutine
+
+    subroutine TestThreadedBatch
+        integer(C_INT),  parameter :: nlayers = 2
+        integer(C_INT),  parameter :: nchunks = 8
+        integer(C_INT),  parameter :: chunk = 4
+        integer(C_INT),  parameter :: nparticles = nchunks * chunk
+        real(C_DOUBLE),  parameter :: medium_refrac = 1.33d0
+        logical(C_BOOL), parameter :: size_correct = .true.
+        real(C_DOUBLE) :: radius(2,nparticles), rel_rad(2,nlayers,nparticles)
+        integer(C_INT) :: indx(nlayers,nparticles), retcodes(nparticles)
+        real(C_DOUBLE) :: sext(NLAMBDA,nparticles), sscat(NLAMBDA,nparticles)
+        real(C_DOUBLE) :: sabs(NLAMBDA,nparticles)
+        real(C_DOUBLE) :: pext(NLAMBDA,nparticles), pscat(NLAMBDA,nparticles)
+        real(C_DOUBLE) :: pabs(NLAMBDA,nparticles)
+        integer(C_INT) :: retval, chunkret(nchunks)
+        integer :: i, first, last
+        call setup
+        do i = 1, nparticles
+            radius(:,i) = (/ 5.0d0 + i, -1.0d0 /)
+            rel_rad(:,:,i) = relative_radius_spheroid2
+            indx(:,i) = index2
+        end do
+!       One batch for everything
+        retval = npspec_batch(nparticles, nlayers, radius, rel_rad, indx, &
+                              medium_refrac, size_correct, 5, 1.0d0, 1.0d0, &
+                              CrossSection, sext, sscat, sabs, retcodes)
+        call assert_equals(NoError, retval)
+!       Each thread takes a contiguous slice of the columns
+        !$omp parallel do private(i, first, last) schedule(static, 1)
+        do i = 1, nchunks
+            first = ( i - 1 ) * chunk + 1
+            last  = i * chunk
+            chunkret(i) = npspec_batch(chunk, nlayers, radius(:,first:last),     &
+                                       rel_rad(:,:,first:last),                  &
+                                       indx(:,first:last), medium_refrac,        &
+                                       size_correct, 5, 1.0d0, 1.0d0,            &
+                                       CrossSection, pext(:,first:last),         &
+                                       pscat(:,first:last), pabs(:,first:last),  &
+                                       retcodes(first:last))
+        end do
+        !$omp end parallel do
+        do i = 1, nchunks
+            call assert_equals(NoError, chunkret(i))
+        end do
+        do i = 1, nparticles
+            call assert_equals(sext(1:NLAMBDA:5,i),  pext(1:NLAMBDA:5,i),  NLAMBDA/5, 0d0)
+            call assert_equals(sscat(1:NLAMBDA:5,i), pscat(1:NLAMBDA:5,i), NLAMBDA/5, 0d0)
+            call assert_equals(sabs(1:NLAMBDA:5,i),  pabs(1:NLAMBDA:5,i),  NLAMBDA/5, 0d0)
+        end do
+    end subroutine
+
 end module test_fortran_wrapper
 
 program fruit_driver
@@ -47,6 +47,10 @@ TEST(SetterGetterTest, TestShape) {
     Nanoparticle np;
     np.setShape(Ellipsoid);
     EXPECT_EQ(Ellipsoid, np.getShape());
+    np.setShape(Spheroid);
+    EXPECT_EQ(Spheroid, np.getShape());
+    np.setShape(Cube);
+    EXPECT_EQ(Cube, np.getShape());
     np.setShape(Sphere);
     EXPECT_EQ(Sphere, np.getShape());
 }
@@ -71,6 +75,11 @@ TEST(SetterGetterTest, TestSpectraProperty) {
     EXPECT_EQ(Absorbance, np.getSpectraProperty());
     np.setSpectraProperty(Extinction);
     EXPECT_EQ(Extinction, np.getSpectraProperty());
+    np.setSpectraProperty(Asymmetry);
+    EXPECT_EQ(Asymmetry, np.getSpectraProperty());
+    EXPECT_EQ(false, np.getExtraProperties());
+    np.setExtraProperties(true);
+    EXPECT_EQ(true, np.getExtraProperties());
 }
 
 TEST(SetterGetterTest, TestSphereRadius) {
@@ -276,9 +285,9 @@ TEST(CalculatorTest, TestMediumRefractiveIndex) {
     EXPECT_NO_THROW(np.setMediumRefractiveIndex(2.0));
     EXPECT_NO_THROW(np.calculateSpectrum());
     np.getSpectrum(spec);
-    EXPECT_NEAR(1.0698792522825473, spec[0],   1e-14);
-    EXPECT_NEAR(1.4426586799505641, spec[250], 1e-14);
-    EXPECT_NEAR(0.0718406948561757, spec[500], 1e-14);
+    EXPECT_NEAR(0.5179788913931199, spec[0],   1e-14);
+    EXPECT_NEAR(1.1588662887245067, spec[250], 1e-14);
+    EXPECT_NEAR(0.2416484775550201, spec[500], 1e-14);
 }
 
 TEST(CalculatorTest, TestColor) {
@@ -297,6 +306,65 @@ TEST(CalculatorTest, TestColor) {
     EXPECT_FLOAT_EQ(0.48082513, np.getOpacity());
 }
 
+TEST(CalculatorTest, TestExtraProperties) {
+    Nanoparticle np;
+    double ext[NLAMBDA], scat[NLAMBDA], spec[NLAMBDA];
+    np.setSpectraType(CrossSection);
+    np.calculateSpectrum();
+    // Extra properties are not calculated by default
+    EXPECT_THROW(np.getPropertySpectrum(Backscattering, spec), std::invalid_argument);
+    np.getPropertySpectrum(Extinction, ext);
+    np.getPropertySpectrum(Scattering, scat);
+    // Asking for one calculates all of them from the same solve
+    np.setSpectraProperty(Albedo);
+    np.calculateSpectrum();
+    np.getSpectrum(spec);
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_DOUBLE_EQ(scat[i] / ext[i], spec[i]);
+    np.getPropertySpectrum(Extinction, spec);
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_DOUBLE_EQ(ext[i], spec[i]);
+    // A 10 nm sphere is nearly a dipole
+    np.getPropertySpectrum(Backscattering, spec);
+    EXPECT_NEAR(1.5 * scat[300], spec[300], 0.05 * scat[300]);
+    np.getPropertySpectrum(Asymmetry, spec);
+    EXPECT_NEAR(0.0, spec[300], 0.05);
+}
+
+TEST(CalculatorTest, TestDDAShapes) {
+    Nanoparticle np;
+    double spec[NLAMBDA];
+    // The extra properties are refused for a shape without them
+    np.setSpectraProperty(Albedo);
+    EXPECT_THROW(np.setShape(Cube), std::invalid_argument);
+    EXPECT_THROW(np.setShape(Spheroid), std::invalid_argument);
+    EXPECT_EQ(Sphere, np.getShape());
+    np.setSpectraProperty(Extinction);
+    np.setShape(Cube);
+    EXPECT_THROW(np.setSpectraProperty(Asymmetry), std::invalid_argument);
+    EXPECT_EQ(Extinction, np.getSpectraProperty());
+    // Only one layer, and rods no shorter than they are wide
+    np.setNLayers(2);
+    EXPECT_THROW(np.calculateSpectrum(), std::out_of_range);
+    np.setNLayers(1);
+    np.setShape(Rod);
+    np.setEllipsoidRadius(5.0, 10.0);
+    EXPECT_THROW(np.calculateSpectrum(), std::domain_error);
+    // A dielectric is trusted and metals are not.  Wavelengths between
+    // those solved are interpolated.
+    np.setEllipsoidRadius(10.0, 10.0);
+    np.setLayerMaterial(1, "Quartz");
+    EXPECT_EQ(0, np.calculateSpectrum());
+    np.getSpectrum(spec);
+    EXPECT_GT(spec[0], 0.0);
+    EXPECT_DOUBLE_EQ(0.5 * ( spec[0] + spec[DDA_INCREMENT] ),
+                     spec[DDA_INCREMENT / 2]);
+    EXPECT_DOUBLE_EQ(spec[NLAMBDA - DDA_INCREMENT], spec[NLAMBDA - 1]);
+    np.setLayerMaterial(1, "Au");
+    np.setIncrement(100);
+    EXPECT_EQ(1, np.calculateSpectrum());
+}
+
 // Run tests
 int main (int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
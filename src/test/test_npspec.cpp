@@ -1,5 +1,11 @@
 #include "npspec/npspec.h"
+#include "npspec/instrument.h"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <vector>
 
 using namespace NPSpec;
 
@@ -152,20 +158,23 @@ TEST(SanityTest, ErrorCodes) {
                     1.0, false, 1, 1.0, 1.0, Efficiency,
                     qext, qscat, qabs);
     EXPECT_EQ(InvalidNumberOfLayers, result);
-    result = npspec(11, radius, relative_radius, matIndx,
-                    1.0, false, 1, 1.0, 1.0, Efficiency,
-                    qext, qscat, qabs);
-    EXPECT_EQ(InvalidNumberOfLayers, result);
     radius[0] = 0.0;
     result = npspec(1, radius, relative_radius, matIndx,
                     1.0, false, 1, 1.0, 1.0, Efficiency,
                     qext, qscat, qabs);
     EXPECT_EQ(InvalidRadius, result);
+    // Strong absorption (k x > 20) is evaluated stably, and the series
+    // is summed up to where geometric optics is accurate
     radius[0] = 500.0;
     result = npspec(1, radius, relative_radius, matIndx,
                     1.0, false, 1, 1.0, 1.0, Efficiency,
                     qext, qscat, qabs);
-    EXPECT_EQ(SizeWarning, result);
+    EXPECT_EQ(NoError, result);
+    radius[0] = 5000.0;
+    result = npspec(1, radius, relative_radius, matIndx,
+                    1.0, false, 1, 1.0, 1.0, Efficiency,
+                    qext, qscat, qabs);
+    EXPECT_EQ(NoError, result);
     radius[0] = 20.0;
     radius[1] = 20.0;
     result = npspec(1, radius, relative_radius, matIndx,
@@ -193,8 +202,7 @@ TEST(SanityTest, ErrorCodes) {
     result = npspec(3, radius, relative_radius, matIndx,
                     1.0, false, 1, 1.0, 1.0, Efficiency,
                     qext, qscat, qabs);
-    EXPECT_EQ(InvalidNumberOfLayers, result); // 3 layers too
-                                              // many for quasistatic
+    EXPECT_EQ(NoError, result);
 }
 
 TEST_F(TestSolver, Mie1Layer) {
@@ -329,10 +337,93 @@ TEST_F(TestSolver, Quasi3Layer) {
                          medium_refrac, false, 1, 1.0, 1.0, Efficiency,
                          qext, qscat, qabs);
 
-    EXPECT_EQ(InvalidNumberOfLayers, result);
+    EXPECT_EQ(NoError, result);
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_GT(qabs[i], 0.0);
+        EXPECT_NEAR(qext[i], qabs[i] + qscat[i], 1e-14);
+    }
+
+    // Splitting the shell of a nanorod in two changes nothing
+    const double rod[2] = { 20.0, 10.0 };
+    const double split[3][2] = { { 0.6, 0.6 }, { 0.25, 0.25 }, { 0.15, 0.15 } };
+    const int index[3] = { index2[0], index2[1], index2[1] };
+    double qext2[NLAMBDA], qscat2[NLAMBDA], qabs2[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(2, rod, relative_radius_spheroid2, index2,
+                              medium_refrac, false, 1, 1.0, 1.0, Efficiency,
+                              qext2, qscat2, qabs2));
+    EXPECT_EQ(NoError, npspec(nlayers, rod, split, index,
+                              medium_refrac, false, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_NEAR(qext2[i],  qext[i],  1e-12 * qext2[i]);
+        EXPECT_NEAR(qscat2[i], qscat[i], 1e-12 * qscat2[i]);
+    }
 
 }
 
+TEST_F(TestSolver, QuasiPolarized) {
+    const double medium_refrac = 1.0;
+    const double rod[2] = { 20.0, 10.0 };
+    const double pi = 4.0 * atan(1.0);
+    double abs_axes[2*NLAMBDA], sca_axes[2*NLAMBDA];
+    double abs_pol[NLAMBDA], sca_pol[NLAMBDA];
+    ErrorCode result = npspec(2, rod, relative_radius_spheroid2, index2,
+                              medium_refrac, false, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs);
+    EXPECT_EQ(NoError, result);
+    result = npspec_polarized(2, rod, relative_radius_spheroid2, index2,
+                              medium_refrac, false, 1, 1.0, 1.0, Efficiency,
+                              0.0, abs_axes, sca_axes, abs_pol, sca_pol);
+    EXPECT_EQ(NoError, result);
+
+    // Random orientation is one part Z to two parts XY, and the
+    // longitudinal resonance of a rod lies to the red of the transverse
+    int peak[2] = { 0, 0 };
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_NEAR(qabs[i], ( abs_axes[2*i] + 2.0 * abs_axes[2*i+1] ) / 3.0,
+                    1e-13 * qabs[i]);
+        EXPECT_DOUBLE_EQ(abs_axes[2*i], abs_pol[i]);
+        EXPECT_DOUBLE_EQ(sca_axes[2*i], sca_pol[i]);
+        for (int k = 0; k < 2; ++k)
+            if (abs_axes[2*i+k] > abs_axes[2*peak[k]+k]) peak[k] = i;
+    }
+    EXPECT_GT(wavelengths[peak[0]], wavelengths[peak[1]]);
+
+    // Perpendicular to Z is the XY axis, and in between is a mixture
+    result = npspec_polarized(2, rod, relative_radius_spheroid2, index2,
+                              medium_refrac, false, 1, 1.0, 1.0, Efficiency,
+                              pi / 2.0, NULL, NULL, abs_pol, sca_pol);
+    EXPECT_EQ(NoError, result);
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_NEAR(abs_axes[2*i+1], abs_pol[i], 1e-14 * abs_axes[2*i+1]);
+        EXPECT_NEAR(sca_axes[2*i+1], sca_pol[i], 1e-14 * sca_axes[2*i+1]);
+    }
+    result = npspec_polarized(2, rod, relative_radius_spheroid2, index2,
+                              medium_refrac, false, 1, 1.0, 1.0, Efficiency,
+                              pi / 3.0, NULL, NULL, abs_pol, NULL);
+    EXPECT_EQ(NoError, result);
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_NEAR(0.25 * abs_axes[2*i] + 0.75 * abs_axes[2*i+1], abs_pol[i],
+                    1e-13 * abs_pol[i]);
+
+    // A sphere is the same for every polarization
+    const double sphere[2] = { 20.0, -1.0 };
+    result = npspec(2, sphere, relative_radius_spheroid2, index2,
+                    medium_refrac, false, 1, 1.0, 1.0, Efficiency,
+                    qext, qscat, qabs);
+    EXPECT_EQ(NoError, result);
+    result = npspec_polarized(2, sphere, relative_radius_spheroid2, index2,
+                              medium_refrac, false, 1, 1.0, 1.0, Efficiency,
+                              1.0, abs_axes, sca_axes, abs_pol, sca_pol);
+    EXPECT_EQ(NoError, result);
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_DOUBLE_EQ(qabs[i], abs_axes[2*i]);
+        EXPECT_DOUBLE_EQ(qabs[i], abs_axes[2*i+1]);
+        EXPECT_DOUBLE_EQ(qscat[i], sca_axes[2*i+1]);
+        EXPECT_NEAR(qabs[i], abs_pol[i], 1e-14 * qabs[i]);
+    }
+}
+
 TEST_F(TestSolver, QuasiProlate) {
     const int nlayers = 1;
     const double medium_refrac = 1.0;
@@ -492,17 +583,17 @@ TEST_F(TestSolver, TestMediumRefractiveIndex) {
     // Checks
     EXPECT_EQ(NoError, result);
     // Extinction
-    EXPECT_NEAR(2.8328562530696506, qext[0],   1e-14);
-    EXPECT_NEAR(2.0565291634339800, qext[250], 1e-14);
-    EXPECT_NEAR(0.0970864882507346, qext[500], 1e-14);
+    EXPECT_NEAR(1.5067119967850175, qext[0],   1e-14);
+    EXPECT_NEAR(2.6863112245281928, qext[250], 1e-14);
+    EXPECT_NEAR(0.4513551852244120, qext[500], 1e-14);
     // Scattering
-    EXPECT_NEAR(1.0698792522825473, qscat[0],   1e-14);
-    EXPECT_NEAR(1.4426586799505641, qscat[250], 1e-14);
-    EXPECT_NEAR(0.0718406948561757, qscat[500], 1e-14);
+    EXPECT_NEAR(0.5179788913931199, qscat[0],   1e-14);
+    EXPECT_NEAR(1.1588662887245067, qscat[250], 1e-14);
+    EXPECT_NEAR(0.2416484775550201, qscat[500], 1e-14);
     // Absorption
-    EXPECT_NEAR(1.7629770007871033, qabs[0],   1e-14);
-    EXPECT_NEAR(0.6138704834834159, qabs[250], 1e-14);
-    EXPECT_NEAR(0.0252457933945589, qabs[500], 1e-14);
+    EXPECT_NEAR(0.9887331053918976, qabs[0],   1e-14);
+    EXPECT_NEAR(1.5274449358036861, qabs[250], 1e-14);
+    EXPECT_NEAR(0.2097067076693919, qabs[500], 1e-14);
 
 }
 
@@ -537,6 +628,57 @@ TEST_F(TestSolver, TestMieQuasiSmall) {
 
 }
 
+TEST_F(TestSolver, TestBatch) {
+    const int nlayers = 2;
+    const int nparticles = 3;
+    const double radius[nparticles][2] = { { 10.0, -1.0 },
+                                           { 30.0, -1.0 },
+                                           { 15.0, 10.0 } };
+    double relative_radius[nparticles * nlayers][2];
+    int index[nparticles * nlayers];
+    for (int p = 0; p < nparticles; ++p) {
+        for (int l = 0; l < nlayers; ++l) {
+            relative_radius[p * nlayers + l][0] = relative_radius_spheroid2[l][0];
+            relative_radius[p * nlayers + l][1] = relative_radius_spheroid2[l][1];
+            index[p * nlayers + l] = index2[l];
+        }
+    }
+    double bext[nparticles * NLAMBDA], bscat[nparticles * NLAMBDA];
+    double babs[nparticles * NLAMBDA];
+    int retcodes[nparticles];
+    ErrorCode result = npspec_batch(nparticles, nlayers, radius,
+                                    relative_radius, index, 1.0, true, 1,
+                                    1.0, 1.0, Efficiency, bext, bscat, babs,
+                                    retcodes);
+    EXPECT_EQ(NoError, result);
+
+    // Each particle must be identical to a single call
+    for (int p = 0; p < nparticles; ++p) {
+        EXPECT_EQ(NoError, retcodes[p]);
+        result = npspec(nlayers, radius[p], relative_radius_spheroid2, index2,
+                        1.0, true, 1, 1.0, 1.0, Efficiency, qext, qscat, qabs);
+        for (int i = 0; i < NLAMBDA; ++i) {
+            EXPECT_EQ(qext[i],  bext[p * NLAMBDA + i]);
+            EXPECT_EQ(qscat[i], bscat[p * NLAMBDA + i]);
+            EXPECT_EQ(qabs[i],  babs[p * NLAMBDA + i]);
+        }
+    }
+
+    // The first error is returned, but each particle has its own code
+    double bad_radius[nparticles][2] = { { 10.0, -1.0 },
+                                         { -1.0, -1.0 },
+                                         { 15.0, 10.0 } };
+    result = npspec_batch(nparticles, nlayers, bad_radius,
+                          relative_radius, index, 1.0, true, 1,
+                          1.0, 1.0, Efficiency, bext, bscat, babs,
+                          retcodes);
+    EXPECT_EQ(InvalidRadius, result);
+    EXPECT_EQ(NoError, retcodes[0]);
+    EXPECT_EQ(InvalidRadius, retcodes[1]);
+    EXPECT_EQ(NoError, retcodes[2]);
+
+}
+
 TEST_F(TestSpectraTypes, TestCrossSection) {
     ErrorCode result = npspec(nlayers, radius, relative_radius, index,
                          medium_refrac, false, inc, 1.0, 1.0, CrossSection,
@@ -698,6 +840,856 @@ TEST_F(TestColors, Test20nmAg) {
     EXPECT_FLOAT_EQ(0.48082513, v);
 }
 
+TEST_F(TestSolver, TestSelectedOutputs) {
+    // Spectra that are not wanted may be NULL, and the rest are unchanged
+    const double radius[2] = { 40.0, -1.0 };
+    double ext[NLAMBDA], scat[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(2, radius, relative_radius_spheroid2, index2,
+                              1.0, true, 1, 1.0, 1.0, CrossSection,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec(2, radius, relative_radius_spheroid2, index2,
+                              1.0, true, 1, 1.0, 1.0, CrossSection,
+                              ext, NULL, NULL));
+    EXPECT_EQ(NoError, npspec(2, radius, relative_radius_spheroid2, index2,
+                              1.0, true, 1, 1.0, 1.0, CrossSection,
+                              NULL, scat, NULL));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_DOUBLE_EQ(qext[i], ext[i]);
+        EXPECT_DOUBLE_EQ(qscat[i], scat[i]);
+    }
+}
+
+TEST_F(TestSolver, TestProperties) {
+    // The extra properties come from the same solve as the usual spectra
+    const double sphere[2] = { 40.0, -1.0 };
+    const double ellipsoid[2] = { 20.0, 10.0 };
+    double ext[NLAMBDA], scat[NLAMBDA], abs[NLAMBDA];
+    double back[NLAMBDA], pres[NLAMBDA], alb[NLAMBDA], asym[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(2, sphere, relative_radius_spheroid2, index2,
+                              1.0, true, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_properties(2, sphere, relative_radius_spheroid2,
+                                         index2, 1.0, true, 1, 1.0, 1.0,
+                                         Efficiency, ext, scat, abs,
+                                         back, pres, alb, asym));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_DOUBLE_EQ(qext[i], ext[i]);
+        EXPECT_DOUBLE_EQ(qscat[i], scat[i]);
+        EXPECT_DOUBLE_EQ(qabs[i], abs[i]);
+        EXPECT_DOUBLE_EQ(scat[i] / ext[i], alb[i]);
+        EXPECT_DOUBLE_EQ(( ext[i] - pres[i] ) / scat[i], asym[i]);
+        EXPECT_GT(back[i], 0.0);
+        EXPECT_LT(std::fabs(asym[i]), 1.0);
+    }
+    // Only some may be requested
+    EXPECT_EQ(NoError, npspec_properties(2, sphere, relative_radius_spheroid2,
+                                         index2, 1.0, true, 1, 1.0, 1.0,
+                                         Efficiency, NULL, NULL, NULL,
+                                         qext, NULL, NULL, NULL));
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_DOUBLE_EQ(back[i], qext[i]);
+    // An ellipsoid is a point dipole
+    EXPECT_EQ(NoError, npspec_properties(2, ellipsoid, relative_radius_spheroid2,
+                                         index2, 1.0, true, 1, 1.0, 1.0,
+                                         CrossSection, ext, scat, abs,
+                                         back, pres, alb, asym));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_DOUBLE_EQ(1.5 * scat[i], back[i]);
+        EXPECT_DOUBLE_EQ(ext[i], pres[i]);
+        EXPECT_DOUBLE_EQ(0.0, asym[i]);
+    }
+}
+
+TEST_F(TestSolver, TestAngular) {
+    // The amplitudes satisfy the optical theorem and give the backscattering
+    const double sphere[2] = { 40.0, -1.0 };
+    const double rel_rad[2] = { relative_radius_spheroid2[0][0],
+                                relative_radius_spheroid2[1][0] };
+    const double theta[3] = { 0.0, 0.5 * M_PI, M_PI };
+    double back[NLAMBDA];
+    std::vector<double> s1(2 * 3 * NLAMBDA), s2(2 * 3 * NLAMBDA);
+    EXPECT_EQ(NoError, npspec_properties(2, sphere, relative_radius_spheroid2,
+                                         index2, 1.0, true, 1, 1.0, 1.0,
+                                         Efficiency, qext, NULL, NULL,
+                                         back, NULL, NULL, NULL));
+    EXPECT_EQ(NoError, npspec_angular(2, sphere[0], rel_rad, index2, 1.0,
+                                      true, 1, 3, theta, &s1[0], &s2[0]));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        double x = 2.0 * M_PI * sphere[0] / wavelengths[i];
+        const double *a1 = &s1[6 * i], *a2 = &s2[6 * i];
+        EXPECT_DOUBLE_EQ(a1[0], a2[0]);
+        EXPECT_DOUBLE_EQ(a1[1], a2[1]);
+        EXPECT_NEAR(qext[i], 4.0 * a1[0] / ( x * x ), 1e-10 * qext[i]);
+        EXPECT_NEAR(back[i], 4.0 * ( a1[4] * a1[4] + a1[5] * a1[5] ) / ( x * x ),
+                    1e-10 * back[i]);
+        EXPECT_DOUBLE_EQ(-a1[4], a2[4]);
+        EXPECT_DOUBLE_EQ(-a1[5], a2[5]);
+    }
+    // Either amplitude may be left out
+    EXPECT_EQ(NoError, npspec_angular(2, sphere[0], rel_rad, index2, 1.0,
+                                      true, 1, 3, theta, NULL, &s1[0]));
+    for (size_t k = 0; k < s1.size(); ++k)
+        EXPECT_DOUBLE_EQ(s2[k], s1[k]);
+    EXPECT_EQ(InvalidNumberOfLayers,
+              npspec_angular(0, sphere[0], rel_rad, index2, 1.0, true, 1, 3,
+                             theta, &s1[0], &s2[0]));
+}
+
+TEST_F(TestSolver, TestCoefficients) {
+    // The coefficients reproduce the efficiencies of the same sphere
+    const double sphere[2] = { 40.0, -1.0 };
+    const double rel_rad[2] = { relative_radius_spheroid2[0][0],
+                                relative_radius_spheroid2[1][0] };
+    std::vector<double> an(2 * MAXTERMS * NLAMBDA), bn(2 * MAXTERMS * NLAMBDA);
+    int nterms[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(2, sphere, relative_radius_spheroid2, index2,
+                              1.0, true, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_coefficients(2, sphere[0], rel_rad, index2, 1.0,
+                                           true, 1, MAXTERMS, &an[0], &bn[0],
+                                           nterms));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        double x = 2.0 * M_PI * sphere[0] / wavelengths[i];
+        const double *a = &an[2 * MAXTERMS * i], *b = &bn[2 * MAXTERMS * i];
+        EXPECT_GT(nterms[i], 1);
+        EXPECT_LE(nterms[i], MAXTERMS);
+        double ext = 0.0, sca = 0.0;
+        for (int n = 1; n <= nterms[i]; ++n) {
+            const double *ai = &a[2 * ( n - 1 )], *bi = &b[2 * ( n - 1 )];
+            ext += ( 2 * n + 1 ) * ( ai[0] + bi[0] );
+            sca += ( 2 * n + 1 ) * ( ai[0] * ai[0] + ai[1] * ai[1]
+                                   + bi[0] * bi[0] + bi[1] * bi[1] );
+        }
+        EXPECT_NEAR(qext[i], 2.0 * ext / ( x * x ), 1e-10 * qext[i]);
+        EXPECT_NEAR(qscat[i], 2.0 * sca / ( x * x ), 1e-10 * qscat[i]);
+        // Padded with zeros
+        for (int k = 2 * nterms[i]; k < 2 * MAXTERMS; ++k) {
+            EXPECT_EQ(0.0, a[k]);
+            EXPECT_EQ(0.0, b[k]);
+        }
+    }
+    // A shorter stride truncates the series
+    EXPECT_EQ(NoError, npspec_coefficients(2, sphere[0], rel_rad, index2, 1.0,
+                                           true, 1, 2, &an[0], NULL, nterms));
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_EQ(2, nterms[i]);
+}
+
+TEST_F(TestSolver, TestMultipoles) {
+    // Summed over every order the multipoles give the totals
+    const double sphere[2] = { 80.0, -1.0 };
+    const double rel_rad[2] = { relative_radius_spheroid2[0][0],
+                                relative_radius_spheroid2[1][0] };
+    const int norders = MAXTERMS;
+    std::vector<double> ee(norders * NLAMBDA), em(norders * NLAMBDA),
+                        se(norders * NLAMBDA), sm(norders * NLAMBDA);
+    EXPECT_EQ(NoError, npspec(2, sphere, relative_radius_spheroid2, index2,
+                              1.0, true, 1, 1.0, 1.0, CrossSection,
+                              qext, qscat, qabs));
+    double ext[NLAMBDA], scat[NLAMBDA];
+    EXPECT_EQ(NoError, npspec_multipoles(2, sphere[0], rel_rad, index2, 1.0,
+                                         true, 1, 1.0, 1.0, CrossSection,
+                                         ext, scat, norders, &ee[0], &em[0],
+                                         &se[0], &sm[0]));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_DOUBLE_EQ(qext[i], ext[i]);
+        EXPECT_DOUBLE_EQ(qscat[i], scat[i]);
+        double esum = 0.0, ssum = 0.0;
+        for (int n = 0; n < norders; ++n) {
+            esum += ee[i * norders + n] + em[i * norders + n];
+            ssum += se[i * norders + n] + sm[i * norders + n];
+            EXPECT_GE(se[i * norders + n], 0.0);
+            EXPECT_GE(sm[i * norders + n], 0.0);
+        }
+        EXPECT_NEAR(ext[i], esum, 1e-10 * ext[i]);
+        EXPECT_NEAR(scat[i], ssum, 1e-10 * scat[i]);
+    }
+    // A small sphere is dominated by its electric dipole
+    const double small[2] = { 5.0, -1.0 };
+    EXPECT_EQ(NoError, npspec_multipoles(2, small[0], rel_rad, index2, 1.0,
+                                         true, 1, 1.0, 1.0, Efficiency,
+                                         ext, NULL, 2, &ee[0], NULL, NULL,
+                                         NULL));
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_NEAR(ext[i], ee[2 * i], 0.01 * ext[i]);
+}
+
+TEST_F(TestSolver, TestNearField) {
+    // A small sphere has the dipole enhancement 1 + 2|g|^2, where g is
+    // found from a(1), up to corrections of order x^2
+    const double small = 2.0;
+    const double rel_rad[1] = { 1.0 };
+    const int au[1] = { material_index("Au") };
+    double enh[NLAMBDA];
+    std::vector<double> an(2 * MAXTERMS * NLAMBDA);
+    int nterms[NLAMBDA];
+    EXPECT_EQ(NoError, npspec_nearfield(1, small, rel_rad, au, 1.0, true, 1,
+                                        1.0, 1.0, Efficiency, qext, qscat,
+                                        qabs, enh));
+    EXPECT_EQ(NoError, npspec_coefficients(1, small, rel_rad, au, 1.0, true, 1,
+                                           MAXTERMS, &an[0], NULL, nterms));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        double x = 2.0 * M_PI * small / wavelengths[i];
+        std::complex<double> a1(an[2 * MAXTERMS * i], an[2 * MAXTERMS * i + 1]);
+        std::complex<double> g = a1 * std::complex<double>(0.0, 1.5) / ( x * x * x );
+        EXPECT_NEAR(1.0 + 2.0 * std::norm(g), enh[i], 1e-2 * enh[i]);
+    }
+    // The plasmon enhances the field of a larger sphere
+    const double sphere = 30.0;
+    const int ag[1] = { material_index("Ag") };
+    EXPECT_EQ(NoError, npspec_nearfield(1, sphere, rel_rad, ag, 1.0, true, 1,
+                                        1.0, 1.0, Efficiency, NULL, NULL,
+                                        NULL, enh));
+    double peak = 0.0;
+    for (int i = 0; i < NLAMBDA; ++i)
+        peak = std::max(peak, enh[i]);
+    EXPECT_GT(peak, 10.0);
+    // At x = pi, here 100 nm at 200 nm and 200 nm at 400 nm, j(0)
+    // vanishes and must not scale the other j(n).  The reference sums
+    // the same series with std::sph_bessel and std::sph_neumann.
+    const int quartz[1] = { material_index("Quartz") };
+    EXPECT_EQ(NoError, npspec_nearfield(1, 100.0, rel_rad, quartz, 1.0, false,
+                                        1, 1.0, 1.0, Efficiency, NULL, NULL,
+                                        NULL, enh));
+    EXPECT_NEAR(2.125758147062196, enh[0], 1e-12);
+    EXPECT_EQ(NoError, npspec_nearfield(1, 200.0, rel_rad, quartz, 1.0, false,
+                                        1, 1.0, 1.0, Efficiency, NULL, NULL,
+                                        NULL, enh));
+    EXPECT_NEAR(1.744245716914999, enh[200], 1e-12);
+    EXPECT_NEAR(1.989222389967826, enh[0], 1e-12);
+}
+
+static void faint(const double r, const double wavelength, void *data,
+                  double *n, double *k) {
+    *n = 1.01;
+    *k = 0.0;
+}
+
+TEST_F(TestSolver, TestLargeSphere) {
+    // A sphere of 50 microns is past the series, so geometric optics is
+    // used at every wavelength
+    const double sphere[2] = { 50000.0, -1.0 };
+    const int au[1] = { material_index("Au") };
+    double back[NLAMBDA], pres[NLAMBDA], alb[NLAMBDA], asym[NLAMBDA];
+    EXPECT_EQ(NoError, npspec_properties(1, sphere, relative_radius_spheroid1,
+                                         au, 1.0, true, 1, 1.0, 1.0,
+                                         Efficiency, qext, qscat, qabs,
+                                         back, pres, alb, asym));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_GT(qext[i], 2.0);
+        EXPECT_LT(qext[i], 2.25);
+        EXPECT_GT(qabs[i], 0.0);
+        EXPECT_LT(qabs[i], 1.0);
+        EXPECT_NEAR(qext[i], qscat[i] + qabs[i], 1e-12);
+        EXPECT_GT(back[i], 0.0);
+        EXPECT_GT(asym[i], 0.0);
+        EXPECT_LT(asym[i], 1.0);
+    }
+    // There are no coefficients to return
+    int nterms[NLAMBDA];
+    const double rel_rad[1] = { 1.0 };
+    EXPECT_EQ(NoError, npspec_coefficients(1, sphere[0], rel_rad, au, 1.0,
+                                           true, 1, 0, NULL, NULL, nterms));
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_EQ(0, nterms[i]);
+    // A sphere of nearly the index of the medium shifts the phase too
+    // little for geometric optics to be accurate
+    EXPECT_EQ(SizeWarning, npspec_profile(sphere[0], faint, NULL, 1.0, 1,
+                                          1.0, 1.0, Efficiency, 1e-6, qext,
+                                          qscat, qabs, NULL));
+}
+
+TEST_F(TestSolver, TestThickShell) {
+    // Light does not reach through a thick gold shell, so the core is
+    // invisible and the particle looks like a solid gold sphere.  The
+    // shell absorbs strongly (k*x > 20), which the scaled ratios handle
+    // without a warning.
+    const double sphere[2] = { 600.0, -1.0 };
+    const double solid_rad[1][2] = { { 1.0, 1.0 } };
+    const double shell_rad[2][2] = { { 0.5, 0.5 }, { 0.5, 0.5 } };
+    const int solid[1] = { material_index("Au") };
+    const int shell[2] = { material_index("Quartz"), material_index("Au") };
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(1, sphere, solid_rad, solid, 1.0, false, 1,
+                              1.0, 1.0, Efficiency, qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec(2, sphere, shell_rad, shell, 1.0, false, 1,
+                              1.0, 1.0, Efficiency, ext, sca, abso));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_NEAR(qext[i], ext[i], 1e-6 * fabs(qext[i]));
+        EXPECT_NEAR(qscat[i], sca[i], 1e-6 * fabs(qscat[i]));
+        EXPECT_NEAR(qabs[i], abso[i], 1e-6 * fabs(qabs[i]));
+    }
+}
+
+static void uniform(const double r, const double wavelength, void *data,
+                    double *n, double *k) {
+    *n = 1.5;
+    *k = 0.1;
+}
+
+TEST_F(TestSolver, TestSizeParameterNPi) {
+    // At x = n pi, here 600 nm at 200 and 300 nm, sin(x) vanishes and
+    // the first ratio psi/xi must not be found from it.  The reference
+    // is the series of Bohren and Huffman in long double.
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    EXPECT_EQ(NoError, npspec_profile(600.0, uniform, NULL, 1.0, 1, 1.0, 1.0,
+                                      Efficiency, 1e-6, ext, sca, abso, NULL));
+    EXPECT_NEAR(2.271443760404652, ext[0], 1e-9);
+    EXPECT_NEAR(1.159948158947197, sca[0], 1e-9);
+    EXPECT_NEAR(2.360288595952850, ext[100], 1e-9);
+    EXPECT_NEAR(1.181239584487427, sca[100], 1e-9);
+}
+
+TEST_F(TestSolver, TestMidSizeSphere) {
+    // A sphere of 5 microns, x = 157 at 200 nm and 79 at 400 nm, is
+    // still summed as a series rather than by geometric optics.  The
+    // reference is the series of Bohren and Huffman in long double.
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    EXPECT_EQ(NoError, npspec_profile(5000.0, uniform, NULL, 1.0, 200, 1.0,
+                                      1.0, Efficiency, 1e-6, ext, sca, abso,
+                                      NULL));
+    EXPECT_NEAR(2.066780181189773, ext[0], 1e-9);
+    EXPECT_NEAR(1.125754554407718, sca[0], 1e-9);
+    EXPECT_NEAR(2.105246666294050, ext[200], 1e-9);
+    EXPECT_NEAR(1.135741186090311, sca[200], 1e-9);
+}
+
+TEST_F(TestSolver, TestManyLayers) {
+    // Any number of layers may be given for a sphere.  Splitting a gold
+    // sphere into hundreds of identical shells must not change it.
+    const int nlayers = 200;
+    const double sphere[2] = { 40.0, -1.0 };
+    static double rel_rad[nlayers][2];
+    static int indx[nlayers];
+    for (int j = 0; j < nlayers; ++j) {
+        rel_rad[j][0] = rel_rad[j][1] = 1.0 / nlayers;
+        indx[j] = material_index("Au");
+    }
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(1, sphere, relative_radius_spheroid1, indx,
+                              1.0, false, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec(nlayers, sphere, rel_rad, indx, 1.0, false, 1,
+                              1.0, 1.0, Efficiency, ext, sca, abso));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_NEAR(qext[i], ext[i], 1e-8 * qext[i]);
+        EXPECT_NEAR(qscat[i], sca[i], 1e-8 * qscat[i]);
+        EXPECT_NEAR(qabs[i], abso[i], 1e-8 * qabs[i]);
+    }
+}
+
+// A refractive index graded from the core to the surface, which also
+// records the radii it is asked for
+struct Graded {
+    double slope;
+    double rmin, rmax;
+};
+
+static void graded(const double r, const double wavelength, void *data,
+                   double *n, double *k) {
+    Graded *g = static_cast<Graded*>(data);
+    g->rmin = std::min(g->rmin, r);
+    g->rmax = std::max(g->rmax, r);
+    *n = 1.4 + g->slope * r / 50.0;
+    *k = 0.05 + 0.3 * r / 50.0 * 500.0 / wavelength;
+}
+
+TEST_F(TestSolver, TestProfile) {
+    Graded g = { 1.2, 1e10, -1e10 };
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    int nshells[NLAMBDA], nfine[NLAMBDA];
+    EXPECT_EQ(InvalidRefractiveIndex,
+              npspec_profile(50.0, NULL, &g, 1.0, 1, 1.0, 1.0, Efficiency,
+                             1e-3, ext, sca, abso, nshells));
+    EXPECT_EQ(InvalidRadius,
+              npspec_profile(0.0, graded, &g, 1.0, 1, 1.0, 1.0, Efficiency,
+                             1e-3, ext, sca, abso, nshells));
+    // A sphere of one index is exact from the start
+    g.slope = 0.0;
+    EXPECT_EQ(NoError, npspec_profile(50.0, graded, &g, 1.0, 40, 1.0, 1.0,
+                                      Efficiency, 1e-3, ext, sca, abso,
+                                      nshells));
+    EXPECT_DOUBLE_EQ(0.0, g.rmin);
+    EXPECT_DOUBLE_EQ(50.0, g.rmax);
+    for (int i = 0; i < NLAMBDA; i += 40)
+        EXPECT_EQ(nshells[0], nshells[i]);
+    // A graded sphere is divided further, and agrees with a much finer
+    // division to within the tolerance
+    g.slope = 1.2;
+    const double tol = 1e-3;
+    EXPECT_EQ(NoError, npspec_profile(50.0, graded, &g, 1.0, 40, 1.0, 1.0,
+                                      Efficiency, tol, ext, sca, abso,
+                                      nshells));
+    EXPECT_EQ(NoError, npspec_profile(50.0, graded, &g, 1.0, 40, 1.0, 1.0,
+                                      Efficiency, 1e-5, qext, qscat, qabs,
+                                      nfine));
+    for (int i = 0; i < NLAMBDA; i += 40) {
+        EXPECT_GT(nshells[i], nshells[0] / 2);
+        EXPECT_LT(nshells[i], nfine[i]);
+        EXPECT_NEAR(qext[i], ext[i], tol * qext[i]);
+        EXPECT_NEAR(qscat[i], sca[i], tol * qscat[i]);
+        EXPECT_NEAR(qabs[i], abso[i], tol * qabs[i]);
+    }
+}
+
+TEST_F(TestSolver, TestAuto) {
+    const double tol = 1e-3;
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    int model[NLAMBDA];
+    // A small sphere uses the cheap models for at least some wavelengths,
+    // and stays within the tolerance of the full solver
+    const double small[2] = { 2.0, -1.0 };
+    EXPECT_EQ(NoError, npspec(1, small, relative_radius_spheroid1, index1,
+                              1.0, true, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_auto(1, small, relative_radius_spheroid1, index1,
+                                   1.0, true, 1, 1.0, 1.0, Efficiency, tol,
+                                   ext, sca, abso, model, NULL));
+    int cheap = 0;
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_GE(model[i], ModelQuasistatic);
+        EXPECT_LE(model[i], ModelMie);
+        if (model[i] != ModelMie) ++cheap;
+        EXPECT_NEAR(qext[i], ext[i], tol * qext[i]);
+        EXPECT_NEAR(qscat[i], sca[i], tol * qscat[i]);
+    }
+    EXPECT_GT(cheap, NLAMBDA / 2);
+    // The same for a layered sphere
+    EXPECT_EQ(NoError, npspec(3, small, relative_radius_spheroid3, index3,
+                              1.0, true, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_auto(3, small, relative_radius_spheroid3, index3,
+                                   1.0, true, 1, 1.0, 1.0, Efficiency, tol,
+                                   ext, sca, abso, model, NULL));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_NEAR(qext[i], ext[i], tol * qext[i]);
+        EXPECT_NEAR(qscat[i], sca[i], tol * qscat[i]);
+    }
+    // A larger sphere, or no tolerance, needs the full solver
+    const double large[2] = { 50.0, -1.0 };
+    EXPECT_EQ(NoError, npspec(1, large, relative_radius_spheroid1, index1,
+                              1.0, true, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_auto(1, large, relative_radius_spheroid1, index1,
+                                   1.0, true, 1, 1.0, 1.0, Efficiency, tol,
+                                   ext, sca, abso, model, NULL));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_EQ(ModelMie, model[i]);
+        EXPECT_NEAR(qext[i], ext[i], tol * qext[i]);
+    }
+    EXPECT_EQ(NoError, npspec_auto(1, small, relative_radius_spheroid1, index1,
+                                   1.0, true, 1, 1.0, 1.0, Efficiency, 0.0,
+                                   ext, sca, abso, model, NULL));
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_EQ(ModelMie, model[i]);
+    // An ellipsoid is always quasistatic, and warns if that is not enough
+    const double ellipsoid[2] = { 20.0, 10.0 };
+    EXPECT_EQ(NoError, npspec_auto(1, ellipsoid, relative_radius_spheroid1,
+                                   index1, 1.0, true, 1, 1.0, 1.0, Efficiency,
+                                   1.0, ext, sca, abso, model, NULL));
+    for (int i = 0; i < NLAMBDA; ++i)
+        EXPECT_EQ(ModelQuasistatic, model[i]);
+    EXPECT_EQ(SizeWarning, npspec_auto(1, ellipsoid, relative_radius_spheroid1,
+                                       index1, 1.0, true, 1, 1.0, 1.0,
+                                       Efficiency, tol, ext, sca, abso,
+                                       model, NULL));
+}
+
+TEST_F(TestSolver, TestTruncation) {
+    // The Mie series cut to a tolerance stays within it of the full
+    // series, with fewer terms
+    const double tol = 1e-6;
+    const double radius[2] = { 80.0, -1.0 };
+    const double one[1] = { 1.0 };
+    const double rel_rad[3] = { 0.2, 0.3, 0.5 };
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    int model[NLAMBDA], nterms[NLAMBDA], nfull[NLAMBDA];
+    for (int nlayers = 1; nlayers <= 3; nlayers += 2) {
+        const int *indx = nlayers == 1 ? index1 : index3;
+        const double (*rrad)[2] = nlayers == 1 ? relative_radius_spheroid1
+                                               : relative_radius_spheroid3;
+        EXPECT_EQ(NoError, npspec(nlayers, radius, rrad, indx, 1.0, true, 1,
+                                  1.0, 1.0, Efficiency, qext, qscat, qabs));
+        EXPECT_EQ(NoError, npspec_auto(nlayers, radius, rrad, indx, 1.0, true,
+                                       1, 1.0, 1.0, Efficiency, tol,
+                                       ext, sca, abso, model, nterms));
+        EXPECT_EQ(NoError, npspec_coefficients(nlayers, radius[0],
+                                               nlayers == 1 ? one : rel_rad,
+                                               indx, 1.0, true, 1, MAXTERMS,
+                                               NULL, NULL, nfull));
+        int saved = 0;
+        for (int i = 0; i < NLAMBDA; ++i) {
+            EXPECT_EQ(ModelMie, model[i]);
+            EXPECT_NEAR(qext[i], ext[i], tol * qext[i]);
+            EXPECT_NEAR(qscat[i], sca[i], tol * qscat[i]);
+            EXPECT_GT(nterms[i], 1);
+            EXPECT_LE(nterms[i], nfull[i]);
+            saved += nfull[i] - nterms[i];
+        }
+        EXPECT_GT(saved, NLAMBDA);
+    }
+}
+
+TEST_F(TestSolver, TestHighIndex) {
+    // For a high-index sphere |m| x is several times x, so the
+    // recurrences must start well below nm(|m| x) without losing
+    // accuracy in the series cut to a tolerance
+    const double tol = 1e-8;
+    const double radius[2] = { 150.0, -1.0 };
+    const int indx[1] = { material_index((char*) "GaAs") };
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    int model[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(1, radius, relative_radius_spheroid1, indx,
+                              1.0, true, 1, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_auto(1, radius, relative_radius_spheroid1, indx,
+                                   1.0, true, 1, 1.0, 1.0, Efficiency, tol,
+                                   ext, sca, abso, model, NULL));
+    for (int i = 0; i < NLAMBDA; ++i) {
+        EXPECT_EQ(ModelMie, model[i]);
+        EXPECT_NEAR(qext[i], ext[i], tol * qext[i]);
+        EXPECT_NEAR(qscat[i], sca[i], tol * qscat[i]);
+    }
+}
+
+TEST_F(TestSolver, TestTMatrix) {
+    // A spheroid with equal axes is a sphere, so agrees with Mie theory
+    const double sphere[2] = { 20.0, -1.0 };
+    const double round[2] = { 20.0, 20.0 };
+    double text[NLAMBDA], tsca[NLAMBDA], tabs[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(1, sphere, relative_radius_spheroid1, index1,
+                              1.0, false, 20, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_tmatrix(round, index1[0], 1.0, false, 20, 1.0,
+                                      1.0, Efficiency, text, tsca, tabs));
+    for (int i = 0; i < NLAMBDA; i += 20) {
+        EXPECT_NEAR(qext[i], text[i], 1e-8 * qext[i]);
+        EXPECT_NEAR(qscat[i], tsca[i], 1e-8 * qscat[i]);
+        EXPECT_NEAR(qabs[i], tabs[i], 1e-8 * qabs[i]);
+    }
+    // Also at x = pi, here 100 nm at 200 nm, where j(0) vanishes
+    const int quartz[1] = { material_index("Quartz") };
+    const double pi_sphere[2] = { 100.0, -1.0 };
+    const double pi_round[2] = { 100.0, 100.0 };
+    EXPECT_EQ(NoError, npspec(1, pi_sphere, relative_radius_spheroid1, quartz,
+                              1.0, false, 100, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_tmatrix(pi_round, quartz[0], 1.0, false, 100,
+                                      1.0, 1.0, Efficiency, text, tsca, tabs));
+    for (int i = 0; i < NLAMBDA; i += 100) {
+        EXPECT_NEAR(qext[i], text[i], 1e-8 * qext[i]);
+        EXPECT_NEAR(qscat[i], tsca[i], 1e-8 * qscat[i]);
+    }
+
+    // The longitudinal resonance of a gold rod lies to the red of a sphere
+    const int au = material_index("Au");
+    const double rod[2] = { 40.0, 10.0 };
+    EXPECT_EQ(NoError, npspec_tmatrix(round, au, 1.33, false, 10, 1.0, 1.0,
+                                      Efficiency, qext, NULL, NULL));
+    EXPECT_EQ(NoError, npspec_tmatrix(rod, au, 1.33, false, 10, 1.0, 1.0,
+                                      Efficiency, text, tsca, tabs));
+    int peak[2] = { 0, 0 };
+    for (int i = 0; i < NLAMBDA; i += 10) {
+        EXPECT_GT(tabs[i], 0.0);
+        EXPECT_GT(tsca[i], 0.0);
+        EXPECT_NEAR(text[i], tsca[i] + tabs[i], 1e-12 * text[i]);
+        if (qext[i] > qext[peak[0]]) peak[0] = i;
+        if (text[i] > text[peak[1]]) peak[1] = i;
+    }
+    EXPECT_GT(wavelengths[peak[1]], wavelengths[peak[0]] + 100.0);
+
+    // Each wavelength is cached, and reused when asked again
+    npspec_tmatrix_cache_clear();
+    EXPECT_EQ(0, npspec_tmatrix_cache_size());
+    EXPECT_EQ(NoError, npspec_tmatrix(rod, au, 1.33, false, 100, 1.0, 1.0,
+                                      Efficiency, text, NULL, NULL));
+    EXPECT_EQ(NLAMBDA / 100, npspec_tmatrix_cache_size());
+    EXPECT_EQ(NoError, npspec_tmatrix(rod, au, 1.33, false, 100, 1.0, 1.0,
+                                      Efficiency, qext, NULL, NULL));
+    EXPECT_EQ(NLAMBDA / 100, npspec_tmatrix_cache_size());
+    for (int i = 0; i < NLAMBDA; i += 100)
+        EXPECT_EQ(text[i], qext[i]);
+    npspec_tmatrix_cache_clear();
+    EXPECT_EQ(0, npspec_tmatrix_cache_size());
+
+    // Both radii must be given
+    EXPECT_EQ(InvalidRadius, npspec_tmatrix(sphere, au, 1.33, false, 100, 1.0,
+                                            1.0, Efficiency, qext, qscat, qabs));
+    EXPECT_EQ(InvalidIncrement, npspec_tmatrix(rod, au, 1.33, false, 7, 1.0,
+                                               1.0, Efficiency, qext, qscat,
+                                               qabs));
+}
+
+TEST_F(TestSolver, TestDDA) {
+    // A single dipole is a small sphere in the quasistatic limit
+    const int quartz = material_index("Quartz");
+    const double small[2] = { 5.0, -1.0 };
+    const int index[1] = { quartz };
+    double dext[NLAMBDA], dsca[NLAMBDA], dabs[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(1, small, relative_radius_spheroid1, index, 1.0,
+                              false, 100, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_dda(Sphere, small, quartz, 1.0, false, 100, 1.0,
+                                  1.0, Efficiency, 1, dext, dsca, dabs));
+    for (int i = 0; i < NLAMBDA; i += 100) {
+        EXPECT_NEAR(qext[i], dext[i], 2e-2 * qext[i]);
+        EXPECT_NEAR(qscat[i], dsca[i], 2e-2 * qscat[i]);
+    }
+
+    // Finer dipoles approach Mie theory for a larger dielectric sphere,
+    // where |m| k d is small.  TiO2 absorbs strongly in the ultraviolet,
+    // where |m - 1| is too large to be trusted, so that is warned of.
+    const int tio2 = material_index("TiO2");
+    const double sphere[2] = { 40.0, -1.0 };
+    const int tindex[1] = { tio2 };
+    EXPECT_EQ(NoError, npspec(1, sphere, relative_radius_spheroid1, tindex,
+                              1.0, false, 100, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(SizeWarning, npspec_dda(Sphere, sphere, tio2, 1.0, false, 100,
+                                      1.0, 1.0, Efficiency, 12, dext, dsca,
+                                      dabs));
+    for (int i = 0; i < NLAMBDA; i += 100) {
+        if (wavelengths[i] >= 500.0) {
+            EXPECT_NEAR(qext[i], dext[i], 0.1 * qext[i]);
+        }
+        EXPECT_NEAR(dext[i], dsca[i] + dabs[i], 1e-12 * dext[i]);
+    }
+
+    // The longitudinal resonance of a gold rod lies to the red of a cube.
+    // Gold is warned of, as |m - 1| is beyond what the DDA is accurate for.
+    const int au = material_index("Au");
+    const double cube[2] = { 10.0, 10.0 };
+    const double rod[2] = { 40.0, 10.0 };
+    const double prism[2] = { 5.0, 20.0 };
+    EXPECT_EQ(SizeWarning, npspec_dda(Cube, cube, au, 1.33, false, 20, 1.0, 1.0,
+                                      Efficiency, 6, qext, NULL, NULL));
+    EXPECT_EQ(SizeWarning, npspec_dda(Rod, rod, au, 1.33, false, 20, 1.0, 1.0,
+                                      Efficiency, 12, dext, dsca, dabs));
+    int peak[2] = { 0, 0 };
+    for (int i = 0; i < NLAMBDA; i += 20) {
+        EXPECT_GT(dabs[i], 0.0);
+        EXPECT_GT(dsca[i], 0.0);
+        if (qext[i] > qext[peak[0]]) peak[0] = i;
+        if (dext[i] > dext[peak[1]]) peak[1] = i;
+    }
+    EXPECT_GT(wavelengths[peak[1]], wavelengths[peak[0]] + 100.0);
+    EXPECT_EQ(SizeWarning, npspec_dda(Prism, prism, au, 1.33, false, 100, 1.0,
+                                      1.0, Efficiency, 8, dext, dsca, dabs));
+    for (int i = 0; i < NLAMBDA; i += 100)
+        EXPECT_GT(dabs[i], 0.0);
+
+    // Errors
+    EXPECT_EQ(InvalidResolution, npspec_dda(Cube, cube, au, 1.33, false, 100,
+                                            1.0, 1.0, Efficiency, 0,
+                                            qext, qscat, qabs));
+    EXPECT_EQ(InvalidRadius, npspec_dda(Rod, prism, au, 1.33, false, 100, 1.0,
+                                        1.0, Efficiency, 8, qext, qscat, qabs));
+    EXPECT_EQ(InvalidRadius, npspec_dda(Cube, small, au, 1.33, false, 100, 1.0,
+                                        1.0, Efficiency, 8, qext, qscat, qabs));
+    EXPECT_EQ(InvalidIncrement, npspec_dda(Cube, cube, au, 1.33, false, 7, 1.0,
+                                           1.0, Efficiency, 8, qext, qscat,
+                                           qabs));
+}
+
+TEST_F(TestSolver, TestCluster) {
+    // A single sphere is Mie theory, as are two far apart
+    const double radius[2] = { 20.0, -1.0 };
+    const double rel_rad[1] = { 1.0 };
+    double cext[NLAMBDA], csca[NLAMBDA], cabs[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(1, radius, relative_radius_spheroid1, index1,
+                              1.0, false, 20, 1.0, 1.0, CrossSection,
+                              qext, qscat, qabs));
+    const double one[1][3] = { { 10.0, -5.0, 3.0 } };
+    EXPECT_EQ(NoError, npspec_cluster(1, one, 1, 20.0, rel_rad, index1, 1.0,
+                                      false, 20, 1.0, 1.0, CrossSection,
+                                      cext, csca, cabs));
+    for (int i = 0; i < NLAMBDA; i += 20) {
+        EXPECT_NEAR(qext[i], cext[i], 1e-10 * qext[i]);
+        EXPECT_NEAR(qscat[i], csca[i], 1e-10 * qscat[i]);
+        EXPECT_NEAR(qabs[i], cabs[i], 1e-10 * qabs[i]);
+    }
+    const double far[2][3] = { { 0.0, 0.0, 0.0 }, { 2.0E4, 0.0, 0.0 } };
+    EXPECT_EQ(NoError, npspec_cluster(2, far, 1, 20.0, rel_rad, index1, 1.0,
+                                      false, 20, 1.0, 1.0, CrossSection,
+                                      cext, csca, cabs));
+    for (int i = 0; i < NLAMBDA; i += 20)
+        EXPECT_NEAR(2.0 * qext[i], cext[i], 1e-2 * qext[i]);
+
+    // Layers are solved as in npspec
+    double rrad2[2] = { 0.6, 0.4 };
+    EXPECT_EQ(NoError, npspec(2, radius, relative_radius_spheroid2, index2,
+                              1.0, false, 100, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_cluster(1, one, 2, 20.0, rrad2, index2, 1.0,
+                                      false, 100, 1.0, 1.0, Efficiency,
+                                      cext, csca, cabs));
+    for (int i = 0; i < NLAMBDA; i += 100)
+        EXPECT_NEAR(qext[i], cext[i], 1e-10 * qext[i]);
+
+    // A dimer off the lattice is summed directly, and agrees with the FFT
+    const double dimer[2][3] = { { 0.0, 0.0, 0.0 }, { 45.0, 0.0, 0.0 } };
+    const double skew[2][3] = { { 0.0, 0.0, 0.0 }, { 45.0, 1e-3, 0.0 } };
+    EXPECT_EQ(NoError, npspec_cluster(2, dimer, 1, 20.0, rel_rad, index1, 1.0,
+                                      false, 20, 1.0, 1.0, Efficiency,
+                                      cext, csca, cabs));
+    EXPECT_EQ(NoError, npspec_cluster(2, skew, 1, 20.0, rel_rad, index1, 1.0,
+                                      false, 20, 1.0, 1.0, Efficiency,
+                                      qext, qscat, qabs));
+    for (int i = 0; i < NLAMBDA; i += 20) {
+        EXPECT_NEAR(qext[i], cext[i], 1e-6 * qext[i]);
+        EXPECT_NEAR(cext[i], csca[i] + cabs[i], 1e-12 * cext[i]);
+        EXPECT_GT(cabs[i], 0.0);
+    }
+
+    // Coupling across the gap brings out a mode to the red of the sphere
+    EXPECT_EQ(NoError, npspec(1, radius, relative_radius_spheroid1, index1,
+                              1.0, false, 20, 1.0, 1.0, CrossSection,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_cluster(2, dimer, 1, 20.0, rel_rad, index1, 1.0,
+                                      false, 20, 1.0, 1.0, CrossSection,
+                                      cext, NULL, NULL));
+    const int i400 = 200;
+    EXPECT_EQ(400.0, wavelengths[i400]);
+    EXPECT_GT(cext[i400], 4.0 * qext[i400]);
+
+    // A long chain on a lattice
+    std::vector<double> chain(3 * 1000, 0.0);
+    for (int i = 0; i < 1000; ++i)
+        chain[3*i] = 50.0 * i;
+    EXPECT_EQ(NoError, npspec_cluster(1000,
+                                      reinterpret_cast<double(*)[3]>(&chain[0]),
+                                      1, 20.0, rel_rad, index1, 1.0, false,
+                                      100, 1.0, 1.0, Efficiency,
+                                      cext, csca, cabs));
+    for (int i = 0; i < NLAMBDA; i += 100)
+        EXPECT_GT(cabs[i], 0.0);
+
+    // Errors
+    const double overlap[2][3] = { { 0.0, 0.0, 0.0 }, { 30.0, 0.0, 0.0 } };
+    const double touch[2][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 40.0 } };
+    EXPECT_EQ(InvalidPositions, npspec_cluster(2, overlap, 1, 20.0, rel_rad,
+                                               index1, 1.0, false, 100, 1.0,
+                                               1.0, Efficiency, cext, csca,
+                                               cabs));
+    EXPECT_EQ(NoError, npspec_cluster(2, touch, 1, 20.0, rel_rad, index1, 1.0,
+                                      false, 100, 1.0, 1.0, Efficiency,
+                                      cext, csca, cabs));
+    EXPECT_EQ(InvalidPositions, npspec_cluster(0, touch, 1, 20.0, rel_rad,
+                                               index1, 1.0, false, 100, 1.0,
+                                               1.0, Efficiency, cext, csca,
+                                               cabs));
+    EXPECT_EQ(InvalidRadius, npspec_cluster(2, touch, 1, 0.0, rel_rad, index1,
+                                            1.0, false, 100, 1.0, 1.0,
+                                            Efficiency, cext, csca, cabs));
+    rrad2[1] = 0.5;
+    EXPECT_EQ(InvalidRelativeRadius, npspec_cluster(2, touch, 2, 20.0, rrad2,
+                                                    index2, 1.0, false, 100,
+                                                    1.0, 1.0, Efficiency,
+                                                    cext, csca, cabs));
+    EXPECT_EQ(InvalidIncrement, npspec_cluster(2, touch, 1, 20.0, rel_rad,
+                                               index1, 1.0, false, 7, 1.0, 1.0,
+                                               Efficiency, cext, csca, cabs));
+}
+
+static void uniform_scaled(const double r, const double wavelength,
+                           void *data, double *n, double *k) {
+    uniform(r, wavelength, NULL, n, k);
+    *n /= *static_cast<double*>(data);
+    *k /= *static_cast<double*>(data);
+}
+
+TEST_F(TestSolver, TestMediumAllSolvers) {
+    // Every solver takes the index relative to the medium, so a sphere
+    // in water agrees between them as it does in vacuum
+    const int au = material_index("Au");
+    const double medium = 1.33;
+    const double sphere[2] = { 20.0, -1.0 };
+    const double round[2] = { 20.0, 20.0 };
+    const double one[1][3] = { { 0.0, 0.0, 0.0 } };
+    const double rel_rad[1] = { 1.0 };
+    double text[NLAMBDA], tsca[NLAMBDA], tabs[NLAMBDA];
+    double cext[NLAMBDA], csca[NLAMBDA], cabs[NLAMBDA];
+    EXPECT_EQ(NoError, npspec(1, sphere, relative_radius_spheroid1, &au,
+                              medium, false, 20, 1.0, 1.0, Efficiency,
+                              qext, qscat, qabs));
+    EXPECT_EQ(NoError, npspec_tmatrix(round, au, medium, false, 20, 1.0, 1.0,
+                                      Efficiency, text, tsca, tabs));
+    EXPECT_EQ(NoError, npspec_cluster(1, one, 1, 20.0, rel_rad, &au, medium,
+                                      false, 20, 1.0, 1.0, Efficiency,
+                                      cext, csca, cabs));
+    for (int i = 0; i < NLAMBDA; i += 20) {
+        EXPECT_NEAR(qext[i], text[i], 1e-8 * qext[i]);
+        EXPECT_NEAR(qscat[i], tsca[i], 1e-8 * qscat[i]);
+        EXPECT_NEAR(qabs[i], tabs[i], 1e-8 * qabs[i]);
+        EXPECT_NEAR(qext[i], cext[i], 1e-10 * qext[i]);
+        EXPECT_NEAR(qscat[i], csca[i], 1e-10 * qscat[i]);
+        EXPECT_NEAR(qabs[i], cabs[i], 1e-10 * qabs[i]);
+    }
+
+    // A profile in a medium is the same as one in vacuum with its index
+    // divided by that of the medium and its radius multiplied by it
+    double scale = medium;
+    double ext[NLAMBDA], sca[NLAMBDA], abso[NLAMBDA];
+    EXPECT_EQ(NoError, npspec_profile(100.0, uniform, NULL, medium, 100,
+                                      1.0, 1.0, Efficiency, 1e-9,
+                                      ext, sca, abso, NULL));
+    EXPECT_EQ(NoError, npspec_profile(100.0 * medium, uniform_scaled,
+                                      &scale, 1.0,
+                                      100, 1.0, 1.0, Efficiency, 1e-9,
+                                      qext, qscat, qabs, NULL));
+    for (int i = 0; i < NLAMBDA; i += 100) {
+        EXPECT_NEAR(qext[i], ext[i], 1e-9 * qext[i]);
+        EXPECT_NEAR(qscat[i], sca[i], 1e-9 * qscat[i]);
+        EXPECT_NEAR(qabs[i], abso[i], 1e-9 * qabs[i]);
+    }
+}
+
+TEST_F(TestSolver, TestInstrument) {
+    const double radius[2] = { 20.0, -1.0 };
+    double r, g, b, h, s, v;
+    InstrumentCounters c;
+    npspec_counters_reset();
+    npspec(1, radius, relative_radius_spheroid1, index1, 1.0, true, 1, 1.0,
+           1.0, Efficiency, qext, qscat, qabs);
+    RGB(qabs, 1, false, &r, &g, &b);
+    RGB_to_HSV(r, g, b, &h, &s, &v);
+    npspec_counters_thread(&c);
+    char json[2048];
+    int len = npspec_counters_json(json, sizeof(json));
+    EXPECT_GT(len, 0);
+    EXPECT_LT(len, static_cast<int>(sizeof(json)));
+    if (!npspec_instrument_enabled()) {
+        EXPECT_EQ(0, c.npspec_calls);
+        EXPECT_EQ(0, c.mie_calls);
+        EXPECT_EQ(0, c.color_calls);
+        EXPECT_TRUE(strstr(json, "\"enabled\": false") != NULL);
+        return;
+    }
+    EXPECT_EQ(1, c.npspec_calls);
+    EXPECT_EQ(NLAMBDA, c.mie_calls);
+    EXPECT_EQ(0, c.quasi_calls);
+    EXPECT_EQ(NLAMBDA, c.wavelengths_evaluated);
+    EXPECT_EQ(0, c.wavelengths_skipped);
+    EXPECT_EQ(NLAMBDA, c.size_corrections);
+    EXPECT_EQ(0, c.size_warnings);
+    EXPECT_EQ(2, c.color_calls);
+    long long nnum = 0, nnum1 = 0;
+    for (int i = 0; i < NumOrderBins; ++i) {
+        nnum  += c.num_histogram[i];
+        nnum1 += c.num1_histogram[i];
+    }
+    EXPECT_EQ(NLAMBDA, nnum);
+    EXPECT_EQ(NLAMBDA, nnum1);
+    EXPECT_GT(c.seconds[PhaseTotal], 0.0);
+    EXPECT_GE(c.seconds[PhaseTotal], c.seconds[PhaseMie]);
+    EXPECT_TRUE(strstr(json, "\"mie_calls\": 800") != NULL);
+    // A reset clears everything
+    npspec_counters_reset();
+    npspec_counters_total(&c);
+    EXPECT_EQ(0, c.npspec_calls);
+    EXPECT_EQ(0.0, c.seconds[PhaseTotal]);
+}
+
 // Run the tests
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
@@ -1,5 +1,6 @@
 #include "npspec/npspec.h"
 #include "npspec/private/solvers.hpp"
+#include "npspec/private/mie.hpp"
 #include "gtest/gtest.h"
 #include <cstdio>
 #include <cmath>
@@ -163,6 +164,40 @@ TEST_F(VerifyAgainstFortran, MieMediumDielectric) {
 
 }
 
+TEST_F(VerifyAgainstFortran, MieSmallParticle) {
+
+    // Particles of a nanometre or so take the small-particle path, which
+    // must agree with the full solver to within SMALLX_TOLERANCE
+    const int nlayers[2] = { 1, 3 };
+    const complex<double> *refrac[2] = { refrac1, refrac3 };
+    const double *rel_rad[2] = { rel_rad_sphere1, rel_rad_sphere3 };
+    const double radii[2] = { 1.0, 1.4 };
+
+    for (int n = 0; n < 2; ++n) {
+        int nl = nlayers[n];
+        for (int r = 0; r < 2; ++r) {
+            double size_param = 2.0 * pi * radii[r] / wavelength;
+
+            // Few enough terms that the full recurrences were not used
+            complex<double> ra[MAXNUM], rb[MAXNUM];
+            int nterms;
+            mie_coefficients(nl, refrac[n], rel_rad[n], size_param,
+                             ra, rb, &nterms);
+            EXPECT_LT(nterms, SMALLX_ORDERS);
+
+            mie(nl,        refrac[n], rel_rad[n], size_param,
+                &cextinct, &cscat,  &cabs, &back, &radpres, &alb, &asym);
+            miefort(&nl,       const_cast<complex<double>*>(refrac[n]),
+                    const_cast<double*>(rel_rad[n]), &size_param,
+                    &fextinct, &fscat,  &fabs, &back, &radpres, &alb, &asym);
+            EXPECT_NEAR(fextinct, cextinct, SMALLX_TOLERANCE * fextinct);
+            EXPECT_NEAR(fscat,    cscat,    SMALLX_TOLERANCE * fscat);
+            EXPECT_NEAR(fabs,     cabs,     SMALLX_TOLERANCE * fabs);
+        }
+    }
+
+}
+
 TEST_F(VerifyAgainstFortran, Quasi1LayerSphere) {
 
     // Variables